@@ -0,0 +1,176 @@
+#include "access_log.h"
+
+#include "json_logger.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+
+namespace access_log {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr std::array<std::string_view, ENDPOINT_CLASS_COUNT> ENDPOINT_CLASS_NAMES{"static", "api", "poll"};
+
+constexpr std::uint64_t SAMPLE_RANGE = std::uint64_t{1} << 32;
+
+// xorshift: выборке не нужна криптостойкость, а у каждого потока своё состояние без блокировок
+std::uint32_t NextRandom() noexcept {
+    thread_local std::uint64_t state = std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<std::uint32_t>(state >> 32);
+}
+
+template <typename Number>
+void AppendNumber(std::string& out, Number value) {
+    char buffer[24];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void AppendAddress(std::string& out, const net::ip::address& address) {
+    char buffer[INET6_ADDRSTRLEN];
+    const char* text = nullptr;
+    if (address.is_v4()) {
+        const auto bytes = address.to_v4().to_bytes();
+        text = ::inet_ntop(AF_INET, bytes.data(), buffer, sizeof(buffer));
+    } else {
+        const auto bytes = address.to_v6().to_bytes();
+        text = ::inet_ntop(AF_INET6, bytes.data(), buffer, sizeof(buffer));
+    }
+    out += '"';
+    out += text ? std::string_view(text) : "unknown"sv;
+    out += '"';
+}
+
+}  // namespace
+
+std::string_view GetEndpointClassName(EndpointClass endpoint_class) noexcept {
+    return ENDPOINT_CLASS_NAMES[static_cast<size_t>(endpoint_class)];
+}
+
+std::optional<EndpointClass> ParseEndpointClass(std::string_view name) noexcept {
+    const auto it = std::find(ENDPOINT_CLASS_NAMES.begin(), ENDPOINT_CLASS_NAMES.end(), name);
+    if (it == ENDPOINT_CLASS_NAMES.end()) {
+        return std::nullopt;
+    }
+    return static_cast<EndpointClass>(it - ENDPOINT_CLASS_NAMES.begin());
+}
+
+net::ip::address GetClientAddress(const net::ip::address& remote, std::string_view forwarded_for,
+                                  bool trust_forwarded_for) noexcept {
+    if (!trust_forwarded_for || forwarded_for.empty()) {
+        return remote;
+    }
+    // Первый адрес добавил ближайший к клиенту прокси
+    const auto first = router::TrimSpaces(forwarded_for.substr(0, forwarded_for.find(',')));
+    char buffer[INET6_ADDRSTRLEN];
+    if (first.empty() || first.size() >= sizeof(buffer)) {
+        return remote;
+    }
+    std::memcpy(buffer, first.data(), first.size());
+    buffer[first.size()] = '\0';
+
+    boost::system::error_code ec;
+    const auto address = net::ip::make_address(buffer, ec);
+    return ec ? remote : address;
+}
+
+void SetSampleRate(Options& options, std::string_view spec) {
+    const auto separator = spec.find('=');
+    if (separator == std::string_view::npos) {
+        throw std::invalid_argument("Expected class=rate, got " + std::string(spec));
+    }
+    const auto endpoint_class = ParseEndpointClass(spec.substr(0, separator));
+    if (!endpoint_class) {
+        throw std::invalid_argument("Unknown endpoint class in " + std::string(spec));
+    }
+    const auto rate_text = spec.substr(separator + 1);
+    double rate = 0;
+    const auto [ptr, ec] = std::from_chars(rate_text.data(), rate_text.data() + rate_text.size(), rate);
+    if (ec != std::errc{} || ptr != rate_text.data() + rate_text.size() || !(rate >= 0.0 && rate <= 1.0)) {
+        throw std::invalid_argument("Sample rate must be between 0 and 1 in " + std::string(spec));
+    }
+    options.sample_rates[static_cast<size_t>(*endpoint_class)] = rate;
+}
+
+RequestInfo::RequestInfo(const net::ip::address& client, http::verb method, std::string_view target) noexcept
+    : start_(std::chrono::steady_clock::now())
+    , client_(client)
+    , method_(method)
+    , endpoint_class_(ClassifyRequest(method, target))
+    , target_size_(static_cast<std::uint16_t>(std::min(target.size(), MAX_TARGET_SIZE))) {
+    std::memcpy(target_.data(), target.data(), target_size_);
+}
+
+AccessLog::AccessLog(const Options& options)
+    : slow_threshold_(options.slow_threshold)
+    , trust_forwarded_for_(options.trust_forwarded_for) {
+    for (size_t i = 0; i < ENDPOINT_CLASS_COUNT; ++i) {
+        const auto rate = std::clamp(options.sample_rates[i], 0.0, 1.0);
+        thresholds_[i] = static_cast<std::uint64_t>(std::llround(rate * static_cast<double>(SAMPLE_RANGE)));
+    }
+}
+
+bool AccessLog::ShouldLog(EndpointClass endpoint_class, const ResponseInfo& response) const noexcept {
+    if (response.status >= 400 || response.latency >= slow_threshold_) {
+        return true;
+    }
+    const auto threshold = thresholds_[static_cast<size_t>(endpoint_class)];
+    if (threshold >= SAMPLE_RANGE) {
+        return true;
+    }
+    return threshold > 0 && NextRandom() < threshold;
+}
+
+void AccessLog::Log(const RequestInfo& request, unsigned status, std::string_view content_type,
+                    std::uint64_t bytes) const {
+    const ResponseInfo response{
+        status, content_type, bytes,
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.GetStart())};
+    if (!ShouldLog(request.GetEndpointClass(), response)) {
+        return;
+    }
+
+    thread_local std::string data;
+    data.clear();
+    AppendData(data, request, response);
+    json_logger::LogPreformatted("request served"sv, data);
+}
+
+void AccessLog::AppendData(std::string& out, const RequestInfo& request, const ResponseInfo& response) {
+    out += R"({"ip":)";
+    AppendAddress(out, request.GetClient());
+    const auto method = http::to_string(request.GetMethod());
+    out += R"(,"method":)";
+    json_logger::AppendJsonString(out, std::string_view(method.data(), method.size()));
+    out += R"(,"URI":)";
+    json_logger::AppendJsonString(out, request.GetTarget());
+    out += R"(,"class":")";
+    out += GetEndpointClassName(request.GetEndpointClass());
+    out += R"(","code":)";
+    AppendNumber(out, response.status);
+    out += R"(,"content_type":)";
+    if (response.content_type.empty()) {
+        out += "null";
+    } else {
+        json_logger::AppendJsonString(out, response.content_type);
+    }
+    out += R"(,"bytes":)";
+    AppendNumber(out, response.bytes);
+    out += R"(,"response_time_us":)";
+    AppendNumber(out, response.latency.count());
+    out += '}';
+}
+
+}  // namespace access_log
@@ -0,0 +1,144 @@
+#pragma once
+// Как в http_server.h: заголовки Beast во всех единицах трансляции должны видеть std::string_view
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/beast/http/verb.hpp>
+
+#include "router.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace access_log {
+
+namespace net = boost::asio;
+namespace http = boost::beast::http;
+
+// Группы запросов, для которых задаётся своя доля записей в журнале
+enum class EndpointClass {
+    // Файлы статики
+    STATIC,
+    // Запросы API, кроме опроса состояния
+    API,
+    // Списки игроков и состояние игры, которые клиенты запрашивают каждый тик
+    POLL
+};
+
+inline constexpr size_t ENDPOINT_CLASS_COUNT = 3;
+
+std::string_view GetEndpointClassName(EndpointClass endpoint_class) noexcept;
+std::optional<EndpointClass> ParseEndpointClass(std::string_view name) noexcept;
+
+constexpr EndpointClass ClassifyRequest(http::verb method, std::string_view target) {
+    if (target.rfind("/api/", 0) != 0) {
+        return EndpointClass::STATIC;
+    }
+    const auto match = router::MatchApiRoute(method, target);
+    if (match.route && (match.route->endpoint == router::Endpoint::PLAYERS
+                        || match.route->endpoint == router::Endpoint::STATE)) {
+        return EndpointClass::POLL;
+    }
+    return EndpointClass::API;
+}
+
+/*
+ * Адрес клиента. Если сервер стоит за доверенным прокси, берётся первый адрес
+ * из X-Forwarded-For, а при его отсутствии или ошибке — адрес соединения
+ */
+net::ip::address GetClientAddress(const net::ip::address& remote, std::string_view forwarded_for,
+                                  bool trust_forwarded_for) noexcept;
+
+struct Options {
+    // Доля записываемых запросов каждого класса от 0 до 1
+    std::array<double, ENDPOINT_CLASS_COUNT> sample_rates{1.0, 1.0, 1.0};
+    // Медленные запросы записываются всегда
+    std::chrono::microseconds slow_threshold{std::chrono::milliseconds{100}};
+    bool trust_forwarded_for = false;
+};
+
+// Разбирает "класс=доля", например "poll=0.01". При ошибке бросает std::invalid_argument
+void SetSampleRate(Options& options, std::string_view spec);
+
+/*
+ * Сведения о запросе, которые нужны для записи после ответа.
+ * Хранит всё внутри себя, чтобы копирование в обработчик ответа не выделяло память.
+ * Длинный путь обрезается до MAX_TARGET_SIZE байт
+ */
+class RequestInfo {
+public:
+    static constexpr size_t MAX_TARGET_SIZE = 256;
+
+    RequestInfo(const net::ip::address& client, http::verb method, std::string_view target) noexcept;
+
+    const net::ip::address& GetClient() const noexcept {
+        return client_;
+    }
+
+    http::verb GetMethod() const noexcept {
+        return method_;
+    }
+
+    std::string_view GetTarget() const noexcept {
+        return {target_.data(), target_size_};
+    }
+
+    EndpointClass GetEndpointClass() const noexcept {
+        return endpoint_class_;
+    }
+
+    std::chrono::steady_clock::time_point GetStart() const noexcept {
+        return start_;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    net::ip::address client_;
+    http::verb method_;
+    EndpointClass endpoint_class_;
+    std::uint16_t target_size_;
+    std::array<char, MAX_TARGET_SIZE> target_;
+};
+
+struct ResponseInfo {
+    unsigned status = 0;
+    // Пустой тип — заголовка Content-Type в ответе нет
+    std::string_view content_type;
+    std::uint64_t bytes = 0;
+    std::chrono::microseconds latency{0};
+};
+
+/*
+ * Журнал запросов: одна запись на запрос с адресом клиента, кодом ответа и временем
+ * обработки в микросекундах. Ответы с ошибкой (4xx, 5xx) и медленные записываются всегда,
+ * остальные — с долей своего класса. Запись собирается в буфере потока без выделения памяти
+ */
+class AccessLog {
+public:
+    explicit AccessLog(const Options& options = {});
+
+    bool ShouldLog(EndpointClass endpoint_class, const ResponseInfo& response) const noexcept;
+
+    // Засекает время ответа и, если запрос попал в выборку, пишет его в лог
+    void Log(const RequestInfo& request, unsigned status, std::string_view content_type,
+             std::uint64_t bytes) const;
+
+    // Дописывает к out поле data записи в формате JSON
+    static void AppendData(std::string& out, const RequestInfo& request, const ResponseInfo& response);
+
+    bool TrustsForwardedFor() const noexcept {
+        return trust_forwarded_for_;
+    }
+
+private:
+    // Порог для 32-битного случайного числа: запись делается, если число меньше порога
+    std::array<std::uint64_t, ENDPOINT_CLASS_COUNT> thresholds_;
+    std::chrono::microseconds slow_threshold_;
+    bool trust_forwarded_for_;
+};
+
+}  // namespace access_log
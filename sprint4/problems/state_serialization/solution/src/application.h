@@ -6,12 +6,28 @@
 #include "model.h"
 #include "player.h"
 #include "extra_data.h"
-
+#include "etag.h"
+#include "json_writer.h"
+#include "cbor_writer.h"
+#include "compression.h"
+#include "metrics.h"
+#include "fixed_timestep.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/json.hpp>
+#include <exception>
+#include <latch>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
 #include <chrono>
 #include <functional>
+#include <unordered_map>
+#include <vector>
 
 class AppErrorException : public std::invalid_argument {
 public:
@@ -33,19 +49,102 @@ private:
     Category category_;
 };
 
+/*
+ * Запросы игроков одной сессии вызывающая сторона выполняет последовательно
+ * (на strand этой сессии), запросы разных сессий — параллельно.
+ * Вход в игру и тик меняют набор сессий и собак, поэтому берут мьютекс эксклюзивно.
+ */
 class Application {
 public:
     using TickObserver = std::function<void(std::chrono::milliseconds)>;
 
+    // Заранее сформированное тело ответа со строгим ETag
+    struct PreparedBody {
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+        // Сжатые варианты, если они заметно меньше исходного. У каждого свой ETag
+        std::shared_ptr<const std::string> gzip_body;
+        std::string gzip_etag;
+        std::shared_ptr<const std::string> deflate_body;
+        std::string deflate_etag;
+
+        // Запрошенное сжатие, если его вариант хранится, иначе IDENTITY
+        compression::Encoding SelectEncoding(compression::Encoding encoding) const noexcept {
+            if ((encoding == compression::Encoding::GZIP && gzip_body)
+                || (encoding == compression::Encoding::DEFLATE && deflate_body)) {
+                return encoding;
+            }
+            return compression::Encoding::IDENTITY;
+        }
+
+        // Вариант для сжатия, которое вернул SelectEncoding
+        const std::shared_ptr<const std::string>& GetBody(compression::Encoding encoding) const noexcept {
+            switch (encoding) {
+                case compression::Encoding::GZIP:
+                    return gzip_body;
+                case compression::Encoding::DEFLATE:
+                    return deflate_body;
+                case compression::Encoding::IDENTITY:
+                    break;
+            }
+            return body;
+        }
+
+        const std::string& GetEtag(compression::Encoding encoding) const noexcept {
+            switch (encoding) {
+                case compression::Encoding::GZIP:
+                    return gzip_etag;
+                case compression::Encoding::DEFLATE:
+                    return deflate_etag;
+                case compression::Encoding::IDENTITY:
+                    break;
+            }
+            return etag;
+        }
+    };
+
+    // Тело ответа о состоянии игры
+    struct StateBody {
+        model::GameSession::StateSnapshot body;
+        // true — опубликованный снимок, общий для всех игроков сессии; false — собран для этого запроса
+        bool published = false;
+    };
+
     Application(model::Game&& game, bool spawn = false, bool auto_tick_enabled = false)
         : game_(std::move(game))
         , spawn_(spawn)
-        , auto_tick_enabled_(auto_tick_enabled) {}
+        , auto_tick_enabled_(auto_tick_enabled)
+        , tick_metrics_(MakeTickMetrics()) {
+        PrepareMaps();
+    }
 
     Application(const Application&) = delete;
     Application& operator=(const Application&) = delete;
 
-    void SetTickObserver(TickObserver observer) { tick_observer_ = std::move(observer); }
+    // Наблюдатели вызываются после каждого тика в порядке добавления.
+    // Добавлять их нужно до запуска сервера. Время каждого попадает в метрики этапов тика под именем name
+    void AddTickObserver(TickObserver observer, const std::string& name = "observer") {
+        tick_observers_.push_back({std::move(observer), &GetPhaseHistogram(name)});
+    }
+
+    // При threads > 1 сессии обрабатываются в тике параллельно. Сессии независимы,
+    // поэтому результат совпадает с последовательным тиком
+    void SetTickThreads(unsigned threads) {
+        tick_pool_.reset();
+        if (threads > 1) {
+            tick_pool_ = std::make_unique<boost::asio::thread_pool>(threads);
+        }
+    }
+
+    /*
+     * Симуляция идёт шагами длины step независимо от того, сколько времени передано в Tick,
+     * не больше max_steps шагов за тик. Нулевой шаг возвращает один шаг на всё время тика.
+     * Таймер тиков время не дробит: все шаги идут под одной блокировкой с одной публикацией
+     */
+    void SetFixedStep(std::chrono::milliseconds step, unsigned max_steps = model::FixedTimestep::DEFAULT_MAX_STEPS) {
+        std::unique_lock lock{mutex_};
+        timestep_ = model::FixedTimestep{step, max_steps};
+    }
 
     [[nodiscard]] bool GetAutoTick() const noexcept { return auto_tick_enabled_; }
     [[nodiscard]] const model::Game& GetGame() const noexcept { return game_; }
@@ -53,37 +152,35 @@ public:
     [[nodiscard]] const player::Players& GetPlayers() const noexcept { return players_; }
     [[nodiscard]] player::Players& GetPlayers() noexcept { return players_; }
 
-    [[nodiscard]] std::string GetMapsShortInfo() const noexcept {
-        return json_serializer::SerializeMaps(game_.GetMaps());
+    // Карты не меняются после загрузки, поэтому ответы о них формируются один раз
+    [[nodiscard]] const PreparedBody& GetMapsShortInfo() const noexcept {
+        return maps_body_;
     }
 
-[[nodiscard]] std::string GetMapInfo(const std::string& map_id) const {
-    auto map = game_.FindMap(model::Map::Id{map_id});
-    if (!map) {
-        throw AppErrorException("Map not found", AppErrorException::Category::InvalidMapId);
+    [[nodiscard]] const PreparedBody& GetMapInfo(const std::string& map_id) const {
+        auto it = map_bodies_.find(map_id);
+        if (it == map_bodies_.end()) {
+            throw AppErrorException("Map not found", AppErrorException::Category::InvalidMapId);
+        }
+        return it->second;
     }
 
-    boost::json::object map_json;
-    map_json["id"] = *map->GetId();
-    map_json["name"] = map->GetName();
-
-    json_serializer::SerializeBuildings(*map, map_json);
-    json_serializer::SerializeRoads(*map, map_json);
-    json_serializer::SerializeOffices(*map, map_json);
-    json_serializer::SerializeLootTypes(*map, map_json);
-
-    if (const auto *loot_types_ptr = extra_data::ExtraDataRepository::GetInstance().GetLootTypes(map->GetId())) {
-        map_json["lootTypes"] = *loot_types_ptr;
-    } else {
-        map_json["lootTypes"] = boost::json::array{};
+    [[nodiscard]] const PreparedBody& GetMapInfoCbor(const std::string& map_id) const {
+        auto it = map_cbor_bodies_.find(map_id);
+        if (it == map_cbor_bodies_.end()) {
+            throw AppErrorException("Map not found", AppErrorException::Category::InvalidMapId);
+        }
+        return it->second;
     }
 
-    return boost::json::serialize(map_json);
-}
-
-
+    [[nodiscard]] model::GameSession* FindSession(const player::Players::Token& token) const {
+        std::shared_lock lock{mutex_};
+        auto player = players_.FindByToken(token);
+        return player ? player->GetSession() : nullptr;
+    }
 
     [[nodiscard]] boost::json::value GetPlayers(const std::string& token) {
+        std::shared_lock lock{mutex_};
         auto player = players_.FindByToken(token);
         if (!player) {
             throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
@@ -98,6 +195,19 @@ public:
         return result;
     }
 
+    // То же, что GetPlayers, в CBOR. Пишется прямо из собак сессии, без дерева boost::json
+    [[nodiscard]] std::string GetPlayersCbor(const std::string& token) {
+        std::shared_lock lock{mutex_};
+        auto player = players_.FindByToken(token);
+        if (!player) {
+            throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
+        }
+
+        std::string result;
+        cbor_writer::WritePlayers(*player->GetSession(), result);
+        return result;
+    }
+
     [[nodiscard]] boost::json::value JoinGame(const std::string& user_name, const std::string& map_id) {
         if (user_name.empty()) {
             throw AppErrorException("Empty player name", AppErrorException::Category::EmptyPlayerName);
@@ -108,6 +218,7 @@ public:
             throw AppErrorException("Map not found", AppErrorException::Category::InvalidMapId);
         }
 
+        std::unique_lock lock{mutex_};
         auto session = game_.FindSession(map);
         if (!session) {
             session = game_.CreateSession(map);
@@ -115,6 +226,7 @@ public:
 
         auto dog = session->CreateDog(user_name, spawn_);
         std::pair<player::Player*, std::string> player_info = players_.Add(dog, session);
+        PublishSnapshot(*session);
 
         return boost::json::object{
             {"authToken", player_info.second},
@@ -122,54 +234,92 @@ public:
         };
     }
 
-    [[nodiscard]] boost::json::value GetGameState(const player::Players::Token& token) {
+    /*
+     * Возвращает последнее опубликованное состояние сессии игрока.
+     * Не берёт мьютекс приложения: снимок неизменяем и подменяется атомарно.
+     * С радиусом (из запроса или из настроек карты) в ответе только объекты рядом с собакой игрока
+     */
+    [[nodiscard]] StateBody GetGameStateSnapshot(const player::Players::Token& token,
+                                                 std::optional<double> radius = std::nullopt) const {
         auto player = players_.FindByToken(token);
         if (!player) {
             throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
         }
 
-        boost::json::object players_by_id;
-        if (auto session = player->GetSession()) {
-            for (const auto& dog : session->GetDogs()) {
-                boost::json::array bag_array;
-                for (const auto& item : dog->GetBag()) {
-                    bag_array.push_back(boost::json::object{
-                        {"id", item.id},
-                        {"type", item.type}
-                    });
+        auto& session = *player->GetSession();
+        if (!radius) {
+            radius = session.GetMap()->GetStateRadius();
+        }
+        if (radius) {
+            // Пока сетка сессии не опубликована, отдаётся полное состояние
+            session.RequestSpatialState();
+            if (auto spatial = session.GetSpatialState()) {
+                std::string body;
+                if (json_writer::WriteNearbyState(*spatial, player->GetDog()->GetIndex(), *radius, body)) {
+                    return {std::make_shared<const std::string>(std::move(body)), false};
                 }
-                players_by_id[std::to_string(dog->GetToken())] = boost::json::object {
-                    {"pos", boost::json::array{ static_cast<double>(dog->GetCoord().x),
-                                            static_cast<double>(dog->GetCoord().y) }},
-                    {"speed", boost::json::array{ static_cast<double>(dog->GetSpeed().x),
-                                                static_cast<double>(dog->GetSpeed().y) }},
-                    {"dir", player::GetDirAsStr(dog->GetDir())},
-                    {"bag", std::move(bag_array)},
-                    {"score", dog->GetScore()}
-                };
             }
         }
 
-        boost::json::array lost_objects_json;
-        if (auto session = player->GetSession()) {
-            auto lost_objects = session->GetLostObjects();
-            for (const auto& [id, obj] : lost_objects) {
-            lost_objects_json.push_back(boost::json::object{
-                {"id", id},
-                {"type", obj.type},
-                {"pos", boost::json::array{obj.position.x, obj.position.y }}
-            });
-            }
+        if (auto snapshot = session.GetSnapshot()) {
+            return {std::move(snapshot), true};
         }
+        static const auto empty = std::make_shared<const std::string>(R"({"players":{},"lostObjects":{}})");
+        return {empty, true};
+    }
 
-        return boost::json::object{
-            {"players", std::move(players_by_id)},
-            {"lostObjects", std::move(lost_objects_json)}
-        };
+    /*
+     * Последнее опубликованное состояние сессии игрока в CBOR. Первый запрос включает
+     * публикацию CBOR для сессии, и до ближайшей публикации возвращается пустое тело
+     */
+    [[nodiscard]] StateBody GetGameStateCbor(const player::Players::Token& token) const {
+        auto player = players_.FindByToken(token);
+        if (!player) {
+            throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
+        }
+
+        auto& session = *player->GetSession();
+        session.RequestCborSnapshot();
+        return {session.GetCborSnapshot(), true};
+    }
+
+    /*
+     * Изменения состояния сессии игрока после публикации since по журналу сессии.
+     * Как и GetGameStateSnapshot, не берёт мьютекс приложения
+     */
+    [[nodiscard]] StateBody GetGameStateDelta(const player::Players::Token& token, std::uint64_t since) const {
+        auto player = players_.FindByToken(token);
+        if (!player) {
+            throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
+        }
+
+        static const model::StateJournal empty_journal;
+        auto journal = player->GetSession()->GetJournal();
+        std::string body;
+        json_writer::WriteStateDelta(journal ? *journal : empty_journal, since, body);
+        return {std::make_shared<const std::string>(std::move(body)), false};
+    }
+
+    // Публикует снимки всех сессий, например после загрузки сохранённого состояния
+    void PublishSnapshots() {
+        std::unique_lock lock{mutex_};
+        for (auto* session : game_.GetSessions()) {
+            PublishSnapshot(*session);
+        }
     }
 
 
-    void ActionPlayer(const player::Players::Token& token, const std::string& direction_str) {
+    struct ActionQueueStats {
+        size_t depth = 0;
+        std::uint64_t dropped = 0;
+    };
+
+    /*
+     * Проверяет команду и ставит её в очередь сессии игрока, не дожидаясь тика.
+     * Команды применяются в начале тика, а при ручном тике — вызовом ApplyActions.
+     * Возвращает сессию игрока
+     */
+    model::GameSession* ActionPlayer(const player::Players::Token& token, const std::string& direction_str) {
         std::optional<model::Direction> dir;
         if (!direction_str.empty()) {
             try {
@@ -179,45 +329,79 @@ public:
             }
         }
 
+        // Сессии и индексы собак не меняются после создания, поэтому мьютекс приложения не нужен
         auto player = players_.FindByToken(token);
         if (!player) {
             throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
         }
 
-        if (dir) {
-            player->ChangeDir(*dir);
-        } else {
-            player->SetSpeed(model::Dog::Speed{0.0, 0.0});
+        auto session = player->GetSession();
+        session->PushAction({player->GetDog()->GetIndex(), dir});
+        return session;
+    }
+
+    // Вызовы для одной сессии выполняются последовательно (на её strand)
+    void ApplyActions(model::GameSession& session) {
+        std::shared_lock lock{mutex_};
+        session.ApplyActions();
+        PublishSnapshot(session);
+    }
+
+    ActionQueueStats GetActionQueueStats() const {
+        std::shared_lock lock{mutex_};
+        ActionQueueStats stats;
+        for (const auto* session : game_.GetSessions()) {
+            stats.depth += session->GetActionQueueDepth();
+            stats.dropped += session->GetDroppedActionCount();
         }
+        return stats;
     }
 
+    // В режиме постоянного шага время меньше шага копится до следующего тика,
+    // а наблюдатели получают время, которое действительно прошло в игре, возможно нулевое.
+    // Команды игроков применяются и состояние публикуется в каждом тике, даже без шагов симуляции
     void Tick(std::chrono::milliseconds delta) {
         if (delta < static_cast<std::chrono::milliseconds>(0)) {
             throw AppErrorException("Negative time delta", AppErrorException::Category::InvalidTime);
         }
-        players_.MovePlayers(delta);
-
-        for (auto& session : game_.GetSessions()) {
-            session->AddRandomLoot(delta);
-            session->HandleCollisions(delta);
+        std::unique_lock lock{mutex_};
+        // Ожидание блокировки в длительность тика не входит
+        metrics::ScopedTimer tick_timer{tick_metrics_.total};
+        const auto steps = timestep_.Advance(delta);
+        tick_metrics_.steps.Increment(steps.count);
+        tick_metrics_.dropped_steps.Increment(steps.dropped);
+        auto sessions = game_.GetSessions();
+        if (tick_pool_ && sessions.size() > 1) {
+            std::latch done(static_cast<std::ptrdiff_t>(sessions.size()));
+            std::vector<std::exception_ptr> errors(sessions.size());
+            for (size_t i = 0; i < sessions.size(); ++i) {
+                boost::asio::post(*tick_pool_, [this, &sessions, &errors, &done, i, steps] {
+                    try {
+                        TickSession(*sessions[i], steps, tick_metrics_);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                    done.count_down();
+                });
+            }
+            done.wait();
+            for (const auto& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        } else {
+            for (auto* session : sessions) {
+                TickSession(*session, steps, tick_metrics_);
+            }
         }
-        if (tick_observer_) {
-            tick_observer_(delta);
+        const auto simulated = steps.step * steps.count;
+        for (const auto& [observer, duration] : tick_observers_) {
+            metrics::ScopedTimer timer{*duration};
+            observer(simulated);
         }
     }
 
-    [[nodiscard]] std::unordered_map<int, model::LostObject> GetLostObjects(const player::Players::Token& token) {
-        auto player = players_.FindByToken(token);
-        if (!player) {
-            throw AppErrorException("No player with such token", AppErrorException::Category::NoPlayerWithToken);
-        }
-
-        auto session = player->GetSession();
-        if (!session) return {};
-
-        return session->GetLostObjects();
-    }
-
     struct MapLostObjectsInfo {
         int loot_type_count;
     };
@@ -231,9 +415,146 @@ public:
     }
 
 private:
+    // Тела готовятся один раз, поэтому сжимаются с наибольшей степенью
+    static PreparedBody MakePreparedBody(std::string body) {
+        PreparedBody prepared;
+        prepared.etag = util::MakeEtag(body);
+        if (auto gzip = compression::Compress(body, compression::Encoding::GZIP, compression::BEST_COMPRESSION);
+            compression::IsWorthStoring(gzip.size(), body.size())) {
+            prepared.gzip_etag = util::MakeEtag(body, "-gz");
+            prepared.gzip_body = std::make_shared<const std::string>(std::move(gzip));
+        }
+        if (auto deflate = compression::Compress(body, compression::Encoding::DEFLATE, compression::BEST_COMPRESSION);
+            compression::IsWorthStoring(deflate.size(), body.size())) {
+            prepared.deflate_etag = util::MakeEtag(body, "-df");
+            prepared.deflate_body = std::make_shared<const std::string>(std::move(deflate));
+        }
+        prepared.body = std::make_shared<const std::string>(std::move(body));
+        return prepared;
+    }
+
+    static boost::json::object RenderMap(const model::Map& map) {
+        boost::json::object map_json;
+        map_json["id"] = *map.GetId();
+        map_json["name"] = map.GetName();
+
+        json_serializer::SerializeBuildings(map, map_json);
+        json_serializer::SerializeRoads(map, map_json);
+        json_serializer::SerializeOffices(map, map_json);
+        json_serializer::SerializeLootTypes(map, map_json);
+
+        if (const auto *loot_types_ptr = extra_data::ExtraDataRepository::GetInstance().GetLootTypes(map.GetId())) {
+            map_json["lootTypes"] = *loot_types_ptr;
+        } else {
+            map_json["lootTypes"] = boost::json::array{};
+        }
+        return map_json;
+    }
+
+    void PrepareMaps() {
+        maps_body_ = MakePreparedBody(json_serializer::SerializeMaps(game_.GetMaps()));
+        for (const auto& map : game_.GetMaps()) {
+            map_bodies_.emplace(*map.GetId(), MakePreparedBody(boost::json::serialize(RenderMap(map))));
+            std::string cbor;
+            cbor_writer::WriteMap(map, cbor);
+            map_cbor_bodies_.emplace(*map.GetId(), MakePreparedBody(std::move(cbor)));
+        }
+    }
+
+    // Длительности тика целиком и его этапов. Этапы сессий измеряются по отдельности
+    struct TickMetrics {
+        metrics::Histogram& total;
+        metrics::Histogram& apply_actions;
+        metrics::Histogram& move_dogs;
+        metrics::Histogram& add_loot;
+        metrics::Histogram& collisions;
+        metrics::Histogram& publish;
+        metrics::Counter& steps;
+        metrics::Counter& dropped_steps;
+    };
+
+    static metrics::Histogram& GetPhaseHistogram(const std::string& phase) {
+        return metrics::Registry::GetInstance().GetHistogram(
+            "game_tick_phase_duration_seconds",
+            "Duration of a tick phase: per session step for simulation phases, per call for the rest",
+            {{"phase", phase}});
+    }
+
+    static TickMetrics MakeTickMetrics() {
+        return {metrics::Registry::GetInstance().GetHistogram("game_tick_duration_seconds",
+                                                              "Duration of a whole game tick"),
+                GetPhaseHistogram("apply_actions"), GetPhaseHistogram("move_dogs"), GetPhaseHistogram("add_loot"),
+                GetPhaseHistogram("collisions"), GetPhaseHistogram("publish"),
+                metrics::Registry::GetInstance().GetCounter("game_simulation_steps_total", "Simulation steps run"),
+                metrics::Registry::GetInstance().GetCounter("game_simulation_dropped_steps_total",
+                                                            "Fixed simulation steps dropped over the per-tick limit")};
+    }
+
+    // Команды игроков применяются один раз перед шагами, состояние публикуется один раз после них
+    static void TickSession(model::GameSession& session, const model::FixedTimestep::Steps& steps,
+                            const TickMetrics& tick_metrics) {
+        {
+            metrics::ScopedTimer timer{tick_metrics.apply_actions};
+            session.ApplyActions();
+        }
+        for (unsigned i = 0; i < steps.count; ++i) {
+            {
+                metrics::ScopedTimer timer{tick_metrics.move_dogs};
+                session.MoveDogs(steps.step);
+            }
+            {
+                metrics::ScopedTimer timer{tick_metrics.add_loot};
+                session.AddRandomLoot(steps.step);
+            }
+            {
+                metrics::ScopedTimer timer{tick_metrics.collisions};
+                session.HandleCollisions(steps.step);
+            }
+        }
+        metrics::ScopedTimer timer{tick_metrics.publish};
+        PublishSnapshot(session);
+    }
+
+    // Вызывающий отвечает за то, чтобы сессию в это время никто не менял
+    static void PublishSnapshot(model::GameSession& session) {
+        std::string body;
+        // Размер состояния от тика к тику меняется мало, поэтому буфер сразу берётся с запасом
+        if (auto previous = session.GetSnapshot()) {
+            body.reserve(previous->size() + previous->size() / 8);
+        }
+        auto delta = std::make_shared<model::StateDelta>();
+        json_writer::WriteGameState(session, body, session.GetDogChanges(), session.GetLootChanges(), *delta);
+        session.PublishSnapshot(std::make_shared<const std::string>(std::move(body)), std::move(delta));
+
+        if (session.IsSpatialStateNeeded()) {
+            auto spatial = std::make_shared<model::SpatialState>();
+            if (auto previous = session.GetSpatialState()) {
+                spatial->fragments.reserve(previous->fragments.size());
+            }
+            json_writer::WriteSpatialState(session, *spatial);
+            session.PublishSpatialState(std::move(spatial));
+        }
+
+        if (session.IsCborSnapshotNeeded()) {
+            std::string cbor;
+            if (auto previous = session.GetCborSnapshot()) {
+                cbor.reserve(previous->size() + previous->size() / 8);
+            }
+            cbor_writer::WriteGameState(session, cbor);
+            session.PublishCborSnapshot(std::make_shared<const std::string>(std::move(cbor)));
+        }
+    }
+
     model::Game game_;
+    PreparedBody maps_body_;
+    std::unordered_map<std::string, PreparedBody> map_bodies_;
+    std::unordered_map<std::string, PreparedBody> map_cbor_bodies_;
     player::Players players_;
     bool spawn_;
     bool auto_tick_enabled_;
-    TickObserver tick_observer_;
+    std::vector<std::pair<TickObserver, metrics::Histogram*>> tick_observers_;
+    mutable std::shared_mutex mutex_;
+    std::unique_ptr<boost::asio::thread_pool> tick_pool_;
+    model::FixedTimestep timestep_;
+    TickMetrics tick_metrics_;
 };
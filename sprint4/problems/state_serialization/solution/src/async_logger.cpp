@@ -0,0 +1,188 @@
+#include "async_logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <utility>
+
+#include <unistd.h>
+
+namespace json_logger {
+
+namespace {
+
+std::atomic<std::uint64_t> next_logger_id{1};
+
+// Сколько кусков отдаётся одному вызову writev
+constexpr size_t MAX_BATCH_PARTS = IOV_MAX;
+
+}  // namespace
+
+AsyncLogger::AsyncLogger(int fd, OverflowPolicy policy, size_t ring_capacity)
+    : fd_(fd)
+    , policy_(policy)
+    , ring_capacity_(ring_capacity)
+    , id_(next_logger_id.fetch_add(1, std::memory_order_relaxed)) {
+    writer_ = std::thread([this] {
+        Run();
+    });
+}
+
+AsyncLogger::~AsyncLogger() {
+    Stop();
+}
+
+void AsyncLogger::Write(std::string_view record) {
+    if (record.size() > ring_capacity_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (stopping_.load(std::memory_order_acquire)) {
+        // Поток записи остановлен: запись выводится сразу
+        iovec part{const_cast<char*>(record.data()), record.size()};
+        WriteAll(&part, 1);
+        records_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(record.size(), std::memory_order_relaxed);
+        return;
+    }
+
+    auto& ring = GetThreadRing();
+    while (!ring.TryWrite(record)) {
+        if (policy_ == OverflowPolicy::DROP || stopping_.load(std::memory_order_acquire)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::unique_lock lock{wake_mutex_};
+        wake_.notify_one();
+        space_.wait_for(lock, FLUSH_INTERVAL);
+    }
+    records_.fetch_add(1, std::memory_order_relaxed);
+
+    if (ring.Size() > ring.Capacity() / 2) {
+        wake_.notify_one();
+    }
+}
+
+void AsyncLogger::Stop() {
+    if (stopping_.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    // Записи, попавшие в кольца, пока поток записи завершался
+    while (WriteBatch() > 0) {
+    }
+}
+
+AsyncLoggerStats AsyncLogger::GetStats() const noexcept {
+    AsyncLoggerStats stats;
+    stats.records = records_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.write_errors = write_errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Кольцо создаётся при первой записи потока в этот логгер и живёт, пока жив логгер
+AsyncLogger::Ring& AsyncLogger::GetThreadRing() {
+    thread_local std::vector<std::pair<std::uint64_t, Ring*>> thread_rings;
+    for (const auto& [id, ring] : thread_rings) {
+        if (id == id_) {
+            return *ring;
+        }
+    }
+
+    auto ring = std::make_unique<Ring>(ring_capacity_);
+    auto* result = ring.get();
+    {
+        std::lock_guard lock{rings_mutex_};
+        rings_.push_back(std::move(ring));
+    }
+    thread_rings.emplace_back(id_, result);
+    return *result;
+}
+
+void AsyncLogger::Run() {
+    for (;;) {
+        const bool stopping = stopping_.load(std::memory_order_acquire);
+        if (WriteBatch() > 0) {
+            space_.notify_all();
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        std::unique_lock lock{wake_mutex_};
+        wake_.wait_for(lock, FLUSH_INTERVAL);
+    }
+}
+
+size_t AsyncLogger::WriteBatch() {
+    batch_rings_.clear();
+    {
+        std::lock_guard lock{rings_mutex_};
+        for (const auto& ring : rings_) {
+            batch_rings_.push_back(ring.get());
+        }
+    }
+
+    batch_sizes_.clear();
+    batch_parts_.clear();
+    size_t total = 0;
+    for (auto* ring : batch_rings_) {
+        if (batch_parts_.size() + 2 > MAX_BATCH_PARTS) {
+            break;
+        }
+        size_t size = 0;
+        for (auto part : ring->Peek()) {
+            if (!part.empty()) {
+                batch_parts_.push_back({const_cast<char*>(part.data()), part.size()});
+                size += part.size();
+            }
+        }
+        batch_sizes_.push_back(size);
+        total += size;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    WriteAll(batch_parts_.data(), batch_parts_.size());
+    for (size_t i = 0; i < batch_sizes_.size(); ++i) {
+        batch_rings_[i]->Consume(batch_sizes_[i]);
+    }
+    bytes_.fetch_add(total, std::memory_order_relaxed);
+    return total;
+}
+
+// Дописывает куски целиком: после частичной записи продолжает с места остановки
+void AsyncLogger::WriteAll(iovec* parts, size_t count) {
+    auto* part = parts;
+    auto* end = parts + count;
+    while (part != end) {
+        const auto written = ::writev(fd_, part, static_cast<int>(end - part));
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Вывод недоступен: записи теряются, чтобы источники не ждали бесконечно
+            write_errors_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto remaining = static_cast<size_t>(written);
+        while (part != end && remaining >= part->iov_len) {
+            remaining -= part->iov_len;
+            ++part;
+        }
+        if (part != end) {
+            part->iov_base = static_cast<char*>(part->iov_base) + remaining;
+            part->iov_len -= remaining;
+        }
+    }
+}
+
+}  // namespace json_logger
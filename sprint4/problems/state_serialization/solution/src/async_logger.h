@@ -0,0 +1,108 @@
+#pragma once
+
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace json_logger {
+
+// Что делать с записью, если кольцо потока заполнено
+enum class OverflowPolicy {
+    // Запись отбрасывается и учитывается в счётчике dropped
+    DROP,
+    // Поток ждёт, пока писатель освободит место
+    BLOCK
+};
+
+struct AsyncLoggerStats {
+    std::uint64_t records = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t bytes = 0;
+    // Число вызовов writev
+    std::uint64_t batches = 0;
+    std::uint64_t write_errors = 0;
+};
+
+/*
+ * Асинхронная запись готовых строк лога в файловый дескриптор.
+ * Каждый поток-источник пишет в своё кольцо байт без блокировок, а отдельный поток
+ * собирает непрочитанные байты всех колец и отдаёт их одним вызовом writev.
+ * Записи одного потока выводятся по порядку, записи разных потоков могут перемешиваться
+ */
+class AsyncLogger {
+public:
+    static constexpr size_t DEFAULT_RING_CAPACITY = 64 * 1024;
+    // Как долго накопленные записи могут ждать вывода
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+
+    // Дескриптор логгер не закрывает. Ёмкость кольца — степень двойки
+    explicit AsyncLogger(int fd, OverflowPolicy policy = OverflowPolicy::DROP,
+                         size_t ring_capacity = DEFAULT_RING_CAPACITY);
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    ~AsyncLogger();
+
+    /*
+     * Ставит в очередь готовую запись вместе с завершающим переводом строки.
+     * Можно вызывать из любого потока. Запись длиннее кольца отбрасывается при любой политике
+     */
+    void Write(std::string_view record);
+
+    // Выводит накопленное и останавливает поток записи.
+    // Вызывается, когда другие потоки больше не пишут в лог
+    void Stop();
+
+    AsyncLoggerStats GetStats() const noexcept;
+
+private:
+    using Ring = util::SpscByteRing;
+
+    Ring& GetThreadRing();
+    void Run();
+    // Выводит всё, что есть в кольцах на момент вызова. Возвращает число байт
+    size_t WriteBatch();
+    void WriteAll(iovec* parts, size_t count);
+
+    const int fd_;
+    const OverflowPolicy policy_;
+    const size_t ring_capacity_;
+    // Отличает логгер от уничтоженного ранее по тому же адресу
+    const std::uint64_t id_;
+
+    std::mutex rings_mutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    std::mutex wake_mutex_;
+    // Будит поток записи раньше срока, когда кольцо заполнено наполовину
+    std::condition_variable wake_;
+    // Будит источники, ждущие места в кольце
+    std::condition_variable space_;
+    std::atomic<bool> stopping_{false};
+
+    std::atomic<std::uint64_t> records_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> bytes_{0};
+    std::atomic<std::uint64_t> batches_{0};
+    std::atomic<std::uint64_t> write_errors_{0};
+
+    // Используются только потоком записи
+    std::vector<Ring*> batch_rings_;
+    std::vector<size_t> batch_sizes_;
+    std::vector<iovec> batch_parts_;
+
+    std::thread writer_;
+};
+
+}  // namespace json_logger
@@ -0,0 +1,224 @@
+#include "cbor_writer.h"
+
+#include "extra_data.h"
+#include "json_loader.h"
+
+#include <bit>
+
+namespace cbor_writer {
+
+void CborWriter::Double(double value) {
+    out_.push_back(static_cast<char>(0xfb));
+    WriteBigEndian(std::bit_cast<std::uint64_t>(value), 8);
+}
+
+void CborWriter::Value(const boost::json::value& value) {
+    switch (value.kind()) {
+        case boost::json::kind::null:
+            Null();
+            break;
+        case boost::json::kind::bool_:
+            Bool(value.get_bool());
+            break;
+        case boost::json::kind::int64:
+            Int(value.get_int64());
+            break;
+        case boost::json::kind::uint64:
+            Uint(value.get_uint64());
+            break;
+        case boost::json::kind::double_:
+            Double(value.get_double());
+            break;
+        case boost::json::kind::string:
+            String(value.get_string());
+            break;
+        case boost::json::kind::array:
+            BeginArray(value.get_array().size());
+            for (const auto& item : value.get_array()) {
+                Value(item);
+            }
+            break;
+        case boost::json::kind::object:
+            BeginMap(value.get_object().size());
+            for (const auto& [key, item] : value.get_object()) {
+                String(key);
+                Value(item);
+            }
+            break;
+    }
+}
+
+// Заголовок элемента: тип и аргумент в кратчайшей форме
+void CborWriter::WriteHead(MajorType type, std::uint64_t value) {
+    const auto major = static_cast<std::uint8_t>(type << 5);
+    if (value < 24) {
+        out_.push_back(static_cast<char>(major | value));
+    } else if (value <= 0xff) {
+        out_.push_back(static_cast<char>(major | 24));
+        WriteBigEndian(value, 1);
+    } else if (value <= 0xffff) {
+        out_.push_back(static_cast<char>(major | 25));
+        WriteBigEndian(value, 2);
+    } else if (value <= 0xffffffff) {
+        out_.push_back(static_cast<char>(major | 26));
+        WriteBigEndian(value, 4);
+    } else {
+        out_.push_back(static_cast<char>(major | 27));
+        WriteBigEndian(value, 8);
+    }
+}
+
+void CborWriter::WriteBigEndian(std::uint64_t value, int bytes) {
+    char buffer[8];
+    for (int i = bytes - 1; i >= 0; --i) {
+        buffer[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    out_.append(buffer, bytes);
+}
+
+namespace {
+
+void WritePair(CborWriter& writer, double x, double y) {
+    writer.BeginArray(2);
+    writer.Double(x);
+    writer.Double(y);
+}
+
+void WriteDog(CborWriter& writer, const model::Dog& dog) {
+    writer.Uint(dog.GetToken());
+    writer.BeginMap(5);
+
+    writer.String("pos");
+    WritePair(writer, dog.GetCoord().x, dog.GetCoord().y);
+
+    writer.String("speed");
+    WritePair(writer, dog.GetSpeed().x, dog.GetSpeed().y);
+
+    writer.String("dir");
+    writer.String(model::GetDirAsStr(dog.GetDir()));
+
+    writer.String("bag");
+    writer.BeginArray(dog.GetBag().size());
+    for (const auto& item : dog.GetBag()) {
+        writer.BeginMap(2);
+        writer.String("id");
+        writer.Uint(item.id);
+        writer.String("type");
+        writer.Uint(item.type);
+    }
+
+    writer.String("score");
+    writer.Int(dog.GetScore());
+}
+
+void WriteLoot(CborWriter& writer, const model::LostObject& obj) {
+    writer.Uint(obj.id);
+    writer.BeginMap(2);
+    writer.String("type");
+    writer.Uint(obj.type);
+    writer.String("pos");
+    WritePair(writer, obj.position.x, obj.position.y);
+}
+
+}  // namespace
+
+void WriteGameState(const model::GameSession& session, std::string& out) {
+    CborWriter writer{out};
+    writer.BeginMap(2);
+
+    writer.String("players");
+    writer.BeginMap(session.GetDogs().size());
+    for (const auto* dog : session.GetDogs()) {
+        WriteDog(writer, *dog);
+    }
+
+    writer.String("lostObjects");
+    writer.BeginMap(session.GetLostObjects().Size());
+    for (const auto& obj : session.GetLostObjects()) {
+        WriteLoot(writer, obj);
+    }
+}
+
+void WritePlayers(const model::GameSession& session, std::string& out) {
+    CborWriter writer{out};
+    writer.BeginMap(session.GetDogs().size());
+    for (const auto* dog : session.GetDogs()) {
+        writer.Uint(dog->GetToken());
+        writer.BeginMap(1);
+        writer.String("name");
+        writer.String(dog->GetNickname());
+    }
+}
+
+void WriteMap(const model::Map& map, std::string& out) {
+    namespace keys = json_loader::keys;
+    CborWriter writer{out};
+    writer.BeginMap(6);
+
+    writer.String(keys::ID);
+    writer.String(*map.GetId());
+    writer.String(keys::NAME);
+    writer.String(map.GetName());
+
+    writer.String(keys::ROADS);
+    writer.BeginArray(map.GetRoads().size());
+    for (const auto& road : map.GetRoads()) {
+        const bool has_end = road.IsHorizontal() || road.IsVertical();
+        writer.BeginMap(has_end ? 3 : 2);
+        writer.String(keys::X0);
+        writer.Int(road.GetStart().x);
+        writer.String(keys::Y0);
+        writer.Int(road.GetStart().y);
+        if (road.IsHorizontal()) {
+            writer.String(keys::X1);
+            writer.Int(road.GetEnd().x);
+        } else if (road.IsVertical()) {
+            writer.String(keys::Y1);
+            writer.Int(road.GetEnd().y);
+        }
+    }
+
+    writer.String(keys::BUILDINGS);
+    writer.BeginArray(map.GetBuildings().size());
+    for (const auto& building : map.GetBuildings()) {
+        const auto& bounds = building.GetBounds();
+        writer.BeginMap(4);
+        writer.String(keys::X);
+        writer.Int(bounds.position.x);
+        writer.String(keys::Y);
+        writer.Int(bounds.position.y);
+        writer.String(keys::W);
+        writer.Int(bounds.size.width);
+        writer.String(keys::H);
+        writer.Int(bounds.size.height);
+    }
+
+    writer.String(keys::OFFICES);
+    writer.BeginArray(map.GetOffices().size());
+    for (const auto& office : map.GetOffices()) {
+        writer.BeginMap(5);
+        writer.String(keys::ID);
+        writer.String(*office.GetId());
+        writer.String(keys::X);
+        writer.Int(office.GetPosition().x);
+        writer.String(keys::Y);
+        writer.Int(office.GetPosition().y);
+        writer.String(keys::OFFSET_X);
+        writer.Int(office.GetOffset().dx);
+        writer.String(keys::OFFSET_Y);
+        writer.Int(office.GetOffset().dy);
+    }
+
+    writer.String(keys::LOOTS);
+    if (const auto* loot_types = extra_data::ExtraDataRepository::GetInstance().GetLootTypes(map.GetId())) {
+        writer.BeginArray(loot_types->size());
+        for (const auto& loot_type : *loot_types) {
+            writer.Value(loot_type);
+        }
+    } else {
+        writer.BeginArray(0);
+    }
+}
+
+}  // namespace cbor_writer
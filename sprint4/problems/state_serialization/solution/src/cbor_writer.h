@@ -0,0 +1,104 @@
+#pragma once
+
+#include <boost/json.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "model.h"
+
+namespace cbor_writer {
+
+inline constexpr std::string_view CONTENT_TYPE = "application/cbor";
+
+/*
+ * Потоковая запись CBOR (RFC 8949) в строку. Длины массивов и словарей
+ * указываются заранее; если длина неизвестна, BeginArray/BeginMap без
+ * аргумента открывают контейнер неопределённой длины, который закрывает End
+ */
+class CborWriter {
+public:
+    explicit CborWriter(std::string& out) noexcept
+        : out_(out) {
+    }
+
+    void BeginArray(std::uint64_t size) {
+        WriteHead(ARRAY, size);
+    }
+
+    void BeginArray() {
+        out_.push_back(static_cast<char>(ARRAY << 5 | INDEFINITE));
+    }
+
+    void BeginMap(std::uint64_t size) {
+        WriteHead(MAP, size);
+    }
+
+    void BeginMap() {
+        out_.push_back(static_cast<char>(MAP << 5 | INDEFINITE));
+    }
+
+    // Закрывает контейнер неопределённой длины
+    void End() {
+        out_.push_back(static_cast<char>(0xff));
+    }
+
+    void String(std::string_view value) {
+        WriteHead(TEXT, value.size());
+        out_.append(value);
+    }
+
+    void Uint(std::uint64_t value) {
+        WriteHead(UNSIGNED, value);
+    }
+
+    void Int(std::int64_t value) {
+        if (value >= 0) {
+            WriteHead(UNSIGNED, static_cast<std::uint64_t>(value));
+        } else {
+            WriteHead(NEGATIVE, static_cast<std::uint64_t>(-(value + 1)));
+        }
+    }
+
+    void Bool(bool value) {
+        out_.push_back(static_cast<char>(value ? 0xf5 : 0xf4));
+    }
+
+    void Null() {
+        out_.push_back(static_cast<char>(0xf6));
+    }
+
+    // Всегда восемь байт: клиент читает координаты без преобразований
+    void Double(double value);
+
+    // Переводит дерево boost::json, например дополнительные данные карты из конфига
+    void Value(const boost::json::value& value);
+
+private:
+    enum MajorType : std::uint8_t {
+        UNSIGNED = 0,
+        NEGATIVE = 1,
+        TEXT = 3,
+        ARRAY = 4,
+        MAP = 5
+    };
+
+    static constexpr std::uint8_t INDEFINITE = 31;
+
+    void WriteHead(MajorType type, std::uint64_t value);
+    void WriteBigEndian(std::uint64_t value, int bytes);
+
+    std::string& out_;
+};
+
+// Дописывает в out состояние сессии по схеме /api/v1/game/state. Ключи players и lostObjects — целые
+void WriteGameState(const model::GameSession& session, std::string& out);
+
+// Дописывает в out ответ /api/v1/game/players: {токен собаки: {"name": ...}}
+void WritePlayers(const model::GameSession& session, std::string& out);
+
+// Дописывает в out ответ /api/v1/maps/{id}
+void WriteMap(const model::Map& map, std::string& out);
+
+}  // namespace cbor_writer
@@ -0,0 +1,149 @@
+#include "compression.h"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+
+#include <time.h>
+#include <zlib.h>
+
+namespace compression {
+
+namespace {
+
+// windowBits 15 + 16 включает заголовок и контрольную сумму gzip, 15 — заголовок zlib
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+constexpr int DEFLATE_WINDOW_BITS = 15;
+constexpr int MEMORY_LEVEL = 8;
+
+struct Counters {
+    std::atomic<std::uint64_t> compressions{0};
+    std::atomic<std::uint64_t> bytes_in{0};
+    std::atomic<std::uint64_t> bytes_out{0};
+    std::atomic<std::uint64_t> cpu_time_ns{0};
+    std::atomic<std::uint64_t> cache_hits{0};
+};
+
+Counters counters;
+
+std::uint64_t GetThreadCpuTime() noexcept {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+// Поток сжатия zlib, который сбрасывается перед каждым вызовом вместо создания заново
+class Deflater {
+public:
+    Deflater(int window_bits, int level)
+        : level_(level) {
+        if (deflateInit2(&stream_, level, Z_DEFLATED, window_bits, MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialize deflate stream");
+        }
+    }
+
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    ~Deflater() {
+        deflateEnd(&stream_);
+    }
+
+    std::string Compress(std::string_view data, int level) {
+        deflateReset(&stream_);
+        if (level != level_) {
+            if (deflateParams(&stream_, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("Failed to change compression level");
+            }
+            level_ = level;
+        }
+
+        std::string result(deflateBound(&stream_, static_cast<uLong>(data.size())), '\0');
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream_.avail_in = static_cast<uInt>(data.size());
+        stream_.next_out = reinterpret_cast<Bytef*>(result.data());
+        stream_.avail_out = static_cast<uInt>(result.size());
+
+        if (deflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("Failed to compress data");
+        }
+        result.resize(stream_.total_out);
+        return result;
+    }
+
+private:
+    z_stream stream_{};
+    int level_;
+};
+
+Deflater& GetThreadDeflater(Encoding encoding, int level) {
+    thread_local std::optional<Deflater> gzip;
+    thread_local std::optional<Deflater> deflate;
+    auto& deflater = encoding == Encoding::GZIP ? gzip : deflate;
+    if (!deflater) {
+        deflater.emplace(encoding == Encoding::GZIP ? GZIP_WINDOW_BITS : DEFLATE_WINDOW_BITS, level);
+    }
+    return *deflater;
+}
+
+}  // namespace
+
+std::string_view GetEncodingName(Encoding encoding) noexcept {
+    switch (encoding) {
+        case Encoding::GZIP:
+            return "gzip";
+        case Encoding::DEFLATE:
+            return "deflate";
+        case Encoding::IDENTITY:
+            break;
+    }
+    return "identity";
+}
+
+std::string Compress(std::string_view data, Encoding encoding, int level) {
+    if (encoding == Encoding::IDENTITY) {
+        return std::string(data);
+    }
+
+    const auto start = GetThreadCpuTime();
+    auto result = GetThreadDeflater(encoding, level).Compress(data, level);
+    counters.cpu_time_ns.fetch_add(GetThreadCpuTime() - start, std::memory_order_relaxed);
+    counters.compressions.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes_in.fetch_add(data.size(), std::memory_order_relaxed);
+    counters.bytes_out.fetch_add(result.size(), std::memory_order_relaxed);
+    return result;
+}
+
+Stats GetStats() noexcept {
+    Stats stats;
+    stats.compressions = counters.compressions.load(std::memory_order_relaxed);
+    stats.bytes_in = counters.bytes_in.load(std::memory_order_relaxed);
+    stats.bytes_out = counters.bytes_out.load(std::memory_order_relaxed);
+    stats.cpu_time_ns = counters.cpu_time_ns.load(std::memory_order_relaxed);
+    stats.cache_hits = counters.cache_hits.load(std::memory_order_relaxed);
+    return stats;
+}
+
+SharedCache::SharedCache(size_t slot_count)
+    : slots_(slot_count) {
+}
+
+SharedCache::Body SharedCache::Get(const Body& body, Encoding encoding, int level) {
+    const auto hash = std::hash<const void*>{}(body.get()) ^ static_cast<size_t>(encoding);
+    auto& slot = slots_[hash % slots_.size()];
+
+    if (auto entry = std::atomic_load_explicit(&slot, std::memory_order_acquire);
+        entry && entry->source == body && entry->encoding == encoding && entry->level == level) {
+        counters.cache_hits.fetch_add(1, std::memory_order_relaxed);
+        return entry->compressed;
+    }
+
+    auto compressed = std::make_shared<const std::string>(Compress(*body, encoding, level));
+    std::atomic_store_explicit(&slot, std::make_shared<const Entry>(Entry{body, encoding, level, compressed}),
+                               std::memory_order_release);
+    return compressed;
+}
+
+}  // namespace compression
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace compression {
+
+// Степень сжатия zlib: 1 — быстрее, 9 — меньше
+constexpr int BEST_SPEED = 1;
+constexpr int BEST_COMPRESSION = 9;
+
+// Значения Content-Encoding, которые умеет сервер
+enum class Encoding {
+    IDENTITY,
+    GZIP,
+    DEFLATE
+};
+
+std::string_view GetEncodingName(Encoding encoding) noexcept;
+
+// Заранее сжатый вариант хранится, только если он меньше этой доли исходного:
+// иначе выигрыш в трафике не окупает лишнюю память и отдельный ETag
+constexpr double MIN_COMPRESSION_RATIO = 0.9;
+
+constexpr bool IsWorthStoring(std::size_t compressed_size, std::size_t original_size) noexcept {
+    return static_cast<double>(compressed_size) < static_cast<double>(original_size) * MIN_COMPRESSION_RATIO;
+}
+
+/*
+ * Сжимает данные в формат gzip (RFC 1952) или deflate (zlib, RFC 1950).
+ * Каждый поток переиспользует свой контекст zlib, не выделяя его заново
+ */
+std::string Compress(std::string_view data, Encoding encoding, int level = BEST_SPEED);
+
+inline std::string Gzip(std::string_view data, int level = BEST_COMPRESSION) {
+    return Compress(data, Encoding::GZIP, level);
+}
+
+struct Stats {
+    // Сколько раз вызывалось сжатие и сколько байт было до и после
+    std::uint64_t compressions = 0;
+    std::uint64_t bytes_in = 0;
+    std::uint64_t bytes_out = 0;
+    // Процессорное время потоков, потраченное на сжатие
+    std::uint64_t cpu_time_ns = 0;
+    // Сколько раз сжатое тело нашлось в SharedCache
+    std::uint64_t cache_hits = 0;
+
+    double GetRatio() const noexcept {
+        return bytes_in == 0 ? 1.0 : static_cast<double>(bytes_out) / static_cast<double>(bytes_in);
+    }
+};
+
+// Счётчики с запуска сервера по всем потокам
+Stats GetStats() noexcept;
+
+/*
+ * Сжатые варианты тел, которые отдаются многим клиентам, например снимка состояния сессии.
+ * Ключ — адрес тела: пока запись хранит тело, адрес не достаётся другой строке.
+ * Ячейки подменяются атомарно, поэтому при гонке тело может сжаться дважды, но не больше
+ */
+class SharedCache {
+public:
+    using Body = std::shared_ptr<const std::string>;
+
+    explicit SharedCache(size_t slot_count = 64);
+
+    Body Get(const Body& body, Encoding encoding, int level = BEST_SPEED);
+
+private:
+    struct Entry {
+        Body source;
+        Encoding encoding;
+        int level;
+        Body compressed;
+    };
+
+    std::vector<std::shared_ptr<const Entry>> slots_;
+};
+
+}  // namespace compression
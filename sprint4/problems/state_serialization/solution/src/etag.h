@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace util {
+
+// FNV-1a: ETag должен лишь различать версии данных, криптостойкость не нужна
+inline std::uint64_t Fnv1a(std::string_view data) noexcept {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Строгий ETag вида "0123456789abcdef" с необязательным суффиксом варианта
+inline std::string MakeEtag(std::string_view data, std::string_view suffix = {}) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    auto hash = Fnv1a(data);
+
+    std::string etag(18 + suffix.size(), '"');
+    for (int i = 16; i >= 1; --i) {
+        etag[i] = HEX[hash & 0xF];
+        hash >>= 4;
+    }
+    etag.replace(17, suffix.size(), suffix);
+    etag.back() = '"';
+    return etag;
+}
+
+}  // namespace util
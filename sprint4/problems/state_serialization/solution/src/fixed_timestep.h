@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+namespace model {
+
+/*
+ * Делит время тика на шаги симуляции постоянной длины. Остаток меньше шага
+ * переходит в следующий тик, а шаги сверх max_steps отбрасываются: после долгой
+ * остановки игра теряет это время, но тик не становится дольше и собаки не перескакивают
+ * через трофеи одним длинным отрезком
+ */
+class FixedTimestep {
+public:
+    static constexpr unsigned DEFAULT_MAX_STEPS = 10;
+
+    struct Steps {
+        // Число шагов и длина каждого
+        unsigned count = 0;
+        std::chrono::milliseconds step{0};
+        // Шаги, которые не поместились в max_steps
+        unsigned dropped = 0;
+    };
+
+    // Нулевой шаг выключает деление: всё время тика становится одним шагом
+    explicit FixedTimestep(std::chrono::milliseconds step = std::chrono::milliseconds{0},
+                           unsigned max_steps = DEFAULT_MAX_STEPS) noexcept
+        : step_(std::max(step, std::chrono::milliseconds{0}))
+        , max_steps_(std::max(max_steps, 1u)) {
+    }
+
+    [[nodiscard]] bool IsEnabled() const noexcept {
+        return step_.count() > 0;
+    }
+
+    [[nodiscard]] std::chrono::milliseconds GetStep() const noexcept {
+        return step_;
+    }
+
+    [[nodiscard]] unsigned GetMaxSteps() const noexcept {
+        return max_steps_;
+    }
+
+    // Время, которое ещё не хватило на целый шаг
+    [[nodiscard]] std::chrono::milliseconds GetAccumulated() const noexcept {
+        return accumulated_;
+    }
+
+    Steps Advance(std::chrono::milliseconds delta) noexcept {
+        if (!IsEnabled()) {
+            return {1, delta, 0};
+        }
+        accumulated_ += delta;
+        const auto steps = static_cast<unsigned long long>(accumulated_ / step_);
+        accumulated_ -= step_ * steps;
+
+        Steps result;
+        result.step = step_;
+        result.count = static_cast<unsigned>(std::min<unsigned long long>(steps, max_steps_));
+        result.dropped = static_cast<unsigned>(std::min<unsigned long long>(steps - result.count, UINT_MAX));
+        return result;
+    }
+
+private:
+    std::chrono::milliseconds step_;
+    unsigned max_steps_;
+    std::chrono::milliseconds accumulated_{0};
+};
+
+}  // namespace model
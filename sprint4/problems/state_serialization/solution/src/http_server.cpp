@@ -1,13 +1,58 @@
 #include "http_server.h"
 
+#include "metrics.h"
+
 #include <boost/asio/dispatch.hpp>
 #include <iostream>
 
+#ifdef __linux__
+#include <cerrno>
+#include <sys/sendfile.h>
+#endif
+
 namespace http_server {
+
+namespace {
+
+struct ServerMetrics {
+    metrics::Gauge& open_sessions;
+    metrics::Gauge& open_websockets;
+    metrics::Counter& bytes_received;
+    metrics::Counter& bytes_sent;
+    metrics::Counter& websocket_bytes_sent;
+};
+
+ServerMetrics& GetMetrics() {
+    auto& registry = metrics::Registry::GetInstance();
+    static ServerMetrics server_metrics{
+        registry.GetGauge("http_open_sessions", "Open HTTP connections"),
+        registry.GetGauge("websocket_open_sessions", "Open WebSocket connections"),
+        registry.GetCounter("http_received_bytes_total", "Bytes of HTTP requests read"),
+        registry.GetCounter("http_sent_bytes_total", "Bytes of HTTP responses written"),
+        registry.GetCounter("websocket_sent_bytes_total", "Bytes of WebSocket messages written"),
+    };
+    return server_metrics;
+}
+
+}  // namespace
+
 void ReportError(beast::error_code ec, std::string_view what) {
     std::cerr << what << ": "sv << ec.message() << std::endl;
 }
 
+SessionBase::SessionBase(tcp::socket&& socket)
+    : stream_(std::move(socket))
+    , send_timer_(stream_.get_executor()) {
+    // Клиент мог уже отключиться: тогда адрес остаётся пустым, а чтение завершится ошибкой
+    beast::error_code ec;
+    remote_endpoint_ = stream_.socket().remote_endpoint(ec);
+    GetMetrics().open_sessions.Add(1);
+}
+
+SessionBase::~SessionBase() {
+    GetMetrics().open_sessions.Add(-1);
+}
+
 void SessionBase::Read() { 
     using namespace std::literals;
     // Очищаем запрос от прежнего значения (метод Read может быть вызван несколько раз)
@@ -19,8 +64,9 @@ void SessionBase::Read() {
     beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
 }
 
-void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+void SessionBase::OnRead(beast::error_code ec, std::size_t bytes_read) {
     using namespace std::literals;
+    GetMetrics().bytes_received.Increment(bytes_read);
     if (ec == http::error::end_of_stream) {
         // Нормальная ситуация - клиент закрыл соединение
         return Close();
@@ -28,6 +74,9 @@ void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t byte
     if (ec) {
         return ReportError(ec, "read"sv);
     }
+    if (websocket::is_upgrade(request_)) {
+        return HandleUpgrade(std::move(request_));
+    }
     HandleRequest(std::move(request_));
 }
 
@@ -35,7 +84,8 @@ void SessionBase::Close() {
     stream_.socket().shutdown(tcp::socket::shutdown_send);
 }
 
-void SessionBase::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+void SessionBase::OnWrite(bool close, beast::error_code ec, std::size_t bytes_written) {
+    GetMetrics().bytes_sent.Increment(bytes_written);
     if (ec) {
         return ReportError(ec, "write"sv);
     }
@@ -54,6 +104,175 @@ void SessionBase::Run() {
                   beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
 }
 
-    
+void SessionBase::Write(http::response<FileRangeBody>&& response) {
+#ifdef __linux__
+    // Заголовок пишем обычным образом, а тело передаём ядру через sendfile
+    auto safe_response = std::make_shared<FileResponse>(std::move(response));
+    auto serializer = std::make_shared<http::response_serializer<FileRangeBody>>(*safe_response);
+
+    auto self = GetSharedThis();
+    http::async_write_header(stream_, *serializer,
+                             [safe_response, serializer, self](beast::error_code ec, std::size_t bytes_written) {
+                                 // Байты тела учитывает OnWrite после sendfile
+                                 GetMetrics().bytes_sent.Increment(bytes_written);
+                                 if (ec) {
+                                     return self->OnWrite(safe_response->need_eof(), ec, 0);
+                                 }
+                                 const auto& body = safe_response->body();
+                                 self->SendFile(safe_response, body.offset, body.size);
+                             });
+#else
+    Write<FileRangeBody, http::fields>(std::move(response));
+#endif
+}
+
+void SessionBase::SendFile(std::shared_ptr<FileResponse> response, std::uint64_t offset, std::uint64_t remaining) {
+#ifdef __linux__
+    auto& socket = stream_.socket();
+    beast::error_code ec;
+    socket.native_non_blocking(true, ec);
+
+    while (!ec && remaining > 0) {
+        auto file_offset = static_cast<off_t>(offset);
+        const auto sent = ::sendfile(socket.native_handle(), response->body().file.native_handle(), &file_offset,
+                                     static_cast<std::size_t>(remaining));
+        if (sent > 0) {
+            offset += sent;
+            remaining -= sent;
+        } else if (sent == 0) {
+            // Файл стал короче, чем был при формировании ответа
+            ec = http::error::short_read;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Клиент, который перестал читать, не должен держать сессию и файл бесконечно
+            send_timer_.expires_after(SEND_FILE_TIMEOUT);
+            send_timer_.async_wait([self = GetSharedThis()](beast::error_code ec) {
+                if (!ec) {
+                    self->stream_.socket().cancel(ec);
+                }
+            });
+            socket.async_wait(tcp::socket::wait_write,
+                              [response, offset, remaining, self = GetSharedThis()](beast::error_code ec) mutable {
+                                  self->send_timer_.cancel();
+                                  if (ec) {
+                                      // Ожидание сокета прерывает только таймер
+                                      if (ec == net::error::operation_aborted) {
+                                          ec = beast::error::timeout;
+                                      }
+                                      const auto sent = response->body().size - remaining;
+                                      return self->OnWrite(response->need_eof(), ec, sent);
+                                  }
+                                  self->SendFile(std::move(response), offset, remaining);
+                              });
+            return;
+        } else if (errno != EINTR) {
+            ec = beast::error_code(errno, boost::system::system_category());
+        }
+    }
+    OnWrite(response->need_eof(), ec, response->body().size - remaining);
+#endif
+}
+
+WebSocketSession::WebSocketSession(tcp::socket&& socket)
+    : ws_(std::move(socket)) {
+    GetMetrics().open_websockets.Add(1);
+}
+
+WebSocketSession::~WebSocketSession() {
+    GetMetrics().open_websockets.Add(-1);
+}
+
+void WebSocketSession::Run(http::request<http::string_body> request, OpenHandler on_open) {
+    ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    // Каждое состояние уходит одним кадром
+    ws_.auto_fragment(false);
+    ws_.set_option(websocket::stream_base::decorator([](websocket::response_type& res) {
+        res.set(http::field::server, "MyGameServer");
+    }));
+
+    // Запрос нужен рукопожатию до его завершения
+    auto safe_request = std::make_shared<http::request<http::string_body>>(std::move(request));
+    ws_.async_accept(*safe_request,
+        [self = shared_from_this(), safe_request, on_open = std::move(on_open)](beast::error_code ec) {
+            if (ec) {
+                return ReportError(ec, "websocket accept"sv);
+            }
+            self->open_.store(true, std::memory_order_relaxed);
+            if (on_open) {
+                on_open(self);
+            }
+            self->Read();
+        });
+}
+
+void WebSocketSession::Send(Message message) {
+    net::post(ws_.get_executor(), [self = shared_from_this(), message = std::move(message)]() mutable {
+        self->Enqueue(std::move(message));
+    });
+}
+
+void WebSocketSession::Read() {
+    // Клиент ничего не присылает, но читать нужно, чтобы обрабатывать ping и close
+    ws_.async_read(read_buffer_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+        if (ec) {
+            self->open_.store(false, std::memory_order_relaxed);
+            self->queue_.clear();
+            if (ec != websocket::error::closed) {
+                ReportError(ec, "websocket read"sv);
+            }
+            return;
+        }
+        self->read_buffer_.consume(self->read_buffer_.size());
+        self->Read();
+    });
+}
+
+void WebSocketSession::Enqueue(Message message) {
+    if (!IsOpen() || !message) {
+        return;
+    }
+    // Первое сообщение очереди уже пишется
+    if (queue_.size() > MAX_QUEUE_SIZE) {
+        return Shutdown(websocket::close_code::policy_error);
+    }
+    queue_.push_back(std::move(message));
+    if (queue_.size() == 1) {
+        WriteNext();
+    }
+}
+
+void WebSocketSession::WriteNext() {
+    ws_.text(true);
+    // Буфер держит сам обработчик: очередь могут очистить, пока идёт запись
+    auto message = queue_.front();
+    ws_.async_write(net::buffer(*message), [self = shared_from_this(), message](beast::error_code ec,
+                                                                                std::size_t bytes_written) {
+        GetMetrics().websocket_bytes_sent.Increment(bytes_written);
+        if (ec) {
+            self->open_.store(false, std::memory_order_relaxed);
+            self->queue_.clear();
+            return ReportError(ec, "websocket write"sv);
+        }
+        if (self->queue_.empty()) {
+            return;
+        }
+        self->queue_.pop_front();
+        if (!self->queue_.empty() && self->IsOpen()) {
+            self->WriteNext();
+        }
+    });
+}
+
+void WebSocketSession::Shutdown(websocket::close_code code) {
+    open_.store(false, std::memory_order_relaxed);
+    // Первое сообщение уже пишется: его убирает обработчик записи
+    if (queue_.size() > 1) {
+        queue_.erase(std::next(queue_.begin()), queue_.end());
+    }
+    ws_.async_close(code, [self = shared_from_this()](beast::error_code ec) {
+        if (ec && ec != websocket::error::closed && ec != net::error::operation_aborted) {
+            ReportError(ec, "websocket close"sv);
+        }
+    });
+}
 
-}  // namespace http_server
\ No newline at end of file
+}  // namespace http_server
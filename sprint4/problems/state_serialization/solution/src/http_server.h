@@ -4,10 +4,18 @@
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <string>
 
 namespace http_server {
 
@@ -16,18 +24,194 @@ using tcp = net::ip::tcp;
 using namespace std::literals;
 namespace beast = boost::beast;
 namespace http = beast::http;
+namespace websocket = beast::websocket;
 
 void ReportError(beast::error_code ec, std::string_view what);
 
+/*
+ * Тело ответа — диапазон байтов файла.
+ * На Linux SessionBase отправляет его через sendfile, минуя копирование в пространство
+ * пользователя. writer читает файл блоками и используется на остальных платформах
+ */
+struct FileRangeBody {
+    struct value_type {
+        beast::file file;
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    static std::uint64_t size(const value_type& body) noexcept {
+        return body.size;
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, typename Fields>
+        writer(http::header<isRequest, Fields>&, value_type& body)
+            : body_(body)
+            , remaining_(body.size) {
+        }
+
+        void init(beast::error_code& ec) {
+            body_.file.seek(body_.offset, ec);
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+            ec = {};
+            if (remaining_ == 0) {
+                return boost::none;
+            }
+            const auto amount = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, sizeof(buffer_)));
+            const auto read = body_.file.read(buffer_, amount, ec);
+            if (ec) {
+                return boost::none;
+            }
+            if (read == 0) {
+                ec = http::error::short_read;
+                return boost::none;
+            }
+            remaining_ -= read;
+            return {{const_buffers_type{buffer_, read}, remaining_ > 0}};
+        }
+
+    private:
+        value_type& body_;
+        std::uint64_t remaining_;
+        char buffer_[64 * 1024];
+    };
+};
+
+/*
+ * Тело ответа из неизменяемого буфера, который разделяют между собой ответы.
+ * Позволяет отдавать заранее подготовленные данные без копирования
+ */
+struct SharedBufferBody {
+    using value_type = std::shared_ptr<const std::string>;
+
+    static std::uint64_t size(const value_type& body) noexcept {
+        return body ? body->size() : 0;
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, typename Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body)
+            : body_(body) {
+        }
+
+        void init(beast::error_code& ec) {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+            ec = {};
+            if (written_ || !body_ || body_->empty()) {
+                return boost::none;
+            }
+            written_ = true;
+            return {{const_buffers_type{body_->data(), body_->size()}, false}};
+        }
+
+    private:
+        const value_type& body_;
+        bool written_ = false;
+    };
+};
+
+// Часть общего неизменяемого буфера, например диапазон файла из кэша статики
+struct SharedBufferRangeBody {
+    struct value_type {
+        std::shared_ptr<const std::string> buffer;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+    };
+
+    static std::uint64_t size(const value_type& body) noexcept {
+        return body.size;
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, typename Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body)
+            : body_(body) {
+        }
+
+        void init(beast::error_code& ec) {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+            ec = {};
+            if (written_ || !body_.buffer || body_.size == 0) {
+                return boost::none;
+            }
+            written_ = true;
+            return {{const_buffers_type{body_.buffer->data() + body_.offset, body_.size}, false}};
+        }
+
+    private:
+        const value_type& body_;
+        bool written_ = false;
+    };
+};
+
+/*
+ * Соединение WebSocket, в которое пишет сервер. Сообщения — неизменяемые буферы,
+ * общие для всех подписчиков, у каждого соединения своя очередь отправки.
+ * Клиент, у которого скопилось больше MAX_QUEUE_SIZE неотправленных сообщений,
+ * считается медленным и отключается
+ */
+class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
+public:
+    using Message = std::shared_ptr<const std::string>;
+    using OpenHandler = std::function<void(std::shared_ptr<WebSocketSession>)>;
+
+    static constexpr size_t MAX_QUEUE_SIZE = 16;
+
+    explicit WebSocketSession(tcp::socket&& socket);
+
+    WebSocketSession(const WebSocketSession&) = delete;
+    WebSocketSession& operator=(const WebSocketSession&) = delete;
+
+    ~WebSocketSession();
+
+    // Завершает рукопожатие по уже прочитанному запросу. on_open вызывается после него
+    void Run(http::request<http::string_body> request, OpenHandler on_open);
+
+    // Можно вызывать из любого потока
+    void Send(Message message);
+
+    bool IsOpen() const noexcept {
+        return open_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void Read();
+    void Enqueue(Message message);
+    void WriteNext();
+    void Shutdown(websocket::close_code code);
+
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer read_buffer_;
+    // Меняется только в executor соединения
+    std::deque<Message> queue_;
+    std::atomic<bool> open_{false};
+};
+
 class SessionBase {
 protected:
     using HttpRequest = http::request<http::string_body>;
     
-    explicit SessionBase(tcp::socket&& socket)
-        : stream_(std::move(socket)) {
-    }
+    explicit SessionBase(tcp::socket&& socket);
 
-    ~SessionBase() = default;
+    ~SessionBase();
 
 public:
     // Запрещаем копирование и присваивание объектов SessionBase и его наследников
@@ -49,22 +233,45 @@ protected:
                             });
     }
 
+    void Write(http::response<FileRangeBody>&& response);
+
+    // Передаёт сокет соединению WebSocket. После вызова сессия HTTP завершается
+    void UpgradeToWebSocket(HttpRequest&& request, WebSocketSession::OpenHandler on_open) {
+        std::make_shared<WebSocketSession>(stream_.release_socket())->Run(std::move(request), std::move(on_open));
+    }
+
+    const tcp::endpoint& GetRemoteEndpoint() const noexcept {
+        return remote_endpoint_;
+    }
+
 private:
     void Read();
 
-    void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
+    void OnRead(beast::error_code ec, std::size_t bytes_read);
 
     void Close();
 
     // Обработку запроса делегируем подклассу
     virtual void HandleRequest(HttpRequest&& request) = 0;
 
+    // Запрос на переход к WebSocket. Подкласс либо отвечает обычным HTTP-ответом,
+    // либо забирает сокет вызовом UpgradeToWebSocket
+    virtual void HandleUpgrade(HttpRequest&& request) = 0;
+
     virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
 
-    void OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written);
+    void OnWrite(bool close, beast::error_code ec, std::size_t bytes_written);
+
+    using FileResponse = http::response<FileRangeBody>;
+    // Сколько ждать, пока клиент освободит место в буфере сокета при отправке файла
+    static constexpr std::chrono::seconds SEND_FILE_TIMEOUT{30};
+    void SendFile(std::shared_ptr<FileResponse> response, std::uint64_t offset, std::uint64_t remaining);
 
     // tcp_stream содержит внутри себя сокет и добавляет поддержку таймаутов
     beast::tcp_stream stream_;
+    tcp::endpoint remote_endpoint_;
+    // sendfile пишет в сокет мимо tcp_stream, поэтому его ожидание ограничивает свой таймер
+    net::steady_timer send_timer_;
     beast::flat_buffer buffer_;
     HttpRequest request_;
 };
@@ -87,11 +294,25 @@ private:
         // Захватываем умный указатель на текущий объект Session в лямбде,
         // чтобы продлить время жизни сессии до вызова лямбды.
         // Используется generic-лямбда функция, способная принять response произвольного типа
-        request_handler_(std::move(request), [self = this->shared_from_this()](auto&& response) {
+        request_handler_(GetRemoteEndpoint(), std::move(request), [self = this->shared_from_this()](auto&& response) {
             self->Write(std::move(response));
         });
     }
 
+    // Обработчик получает последним аргументом функцию, которая принимает соединение WebSocket.
+    // Вызывать её можно только синхронно, пока сессия обрабатывает запрос
+    void HandleUpgrade(HttpRequest&& request) override {
+        auto safe_request = std::make_shared<HttpRequest>(std::move(request));
+        auto self = this->shared_from_this();
+        request_handler_(GetRemoteEndpoint(), *safe_request,
+            [self](auto&& response) {
+                self->Write(std::move(response));
+            },
+            [self, safe_request](WebSocketSession::OpenHandler on_open) {
+                self->UpgradeToWebSocket(std::move(*safe_request), std::move(on_open));
+            });
+    }
+
 private:
     RequestHandler request_handler_;
 };
@@ -166,6 +387,11 @@ private:
     RequestHandler request_handler_;
 };
 
+/*
+ * Обработчик вызывается как handler(remote_endpoint, request, send) для обычных запросов
+ * и как handler(remote_endpoint, request, send, accept) для запросов на переход к WebSocket.
+ * remote_endpoint — адрес клиента, с которого установлено соединение
+ */
 template <typename RequestHandler>
 void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
     // При помощи decay_t исключим ссылки из типа RequestHandler,
@@ -50,6 +50,13 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
             };
 
             mp.SetBagCapacity(bag_capacity);
+            if (obj.contains("stateRadius")) {
+                const double radius = obj.at("stateRadius").to_number<double>();
+                if (!(radius > 0.0)) {
+                    throw std::runtime_error("Invalid stateRadius");
+                }
+                mp.SetStateRadius(radius);
+            }
             LoadRoads(mp, obj);
             LoadBuildings(mp, obj);
             LoadOffices(mp, obj);
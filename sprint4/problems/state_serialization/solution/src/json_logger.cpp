@@ -1,47 +1,170 @@
 #include "json_logger.h"
 
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/date_time.hpp>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace json_logger {
 
 using namespace std::literals;
-namespace keywords = boost::log::keywords;
-namespace expr = boost::log::expressions;
-namespace logging = boost::log;
-namespace sinks = boost::log::sinks;
 namespace json = boost::json;
 
-BOOST_LOG_ATTRIBUTE_KEYWORD(timestamp, "TimeStamp", boost::posix_time::ptime)
+namespace {
+
+// Владеет логгером и файлом, в который он пишет
+struct LoggerHolder {
+    std::mutex mutex;
+    std::unique_ptr<AsyncLogger> logger;
+    int fd = -1;
+
+    void Reset(std::unique_ptr<AsyncLogger> new_logger = nullptr, int new_fd = -1) {
+        std::lock_guard lock{mutex};
+        current.store(new_logger.get(), std::memory_order_release);
+        if (logger) {
+            logger->Stop();
+        }
+        logger = std::move(new_logger);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        fd = new_fd;
+    }
+
+    ~LoggerHolder() {
+        Reset();
+    }
+
+    std::atomic<AsyncLogger*> current{nullptr};
+};
+
+LoggerHolder holder;
 
-void InitLogger() {
-    logging::add_common_attributes();
+// Время как у boost::posix_time::to_iso_extended_string: дробная часть только ненулевая
+void AppendTimestamp(std::string& out) {
+    const auto now = std::chrono::system_clock::now();
+    const auto time = std::chrono::system_clock::to_time_t(now);
+    const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() % 1'000'000;
+    std::tm tm{};
+    localtime_r(&time, &tm);
 
-    //set new format
-    logging::add_console_log(
-        std::clog,
-        keywords::format = &LogFormatter,
-        keywords::auto_flush = true
-    );
+    char buffer[40];
+    auto size = std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d", tm.tm_year + 1900,
+                              tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (micros != 0) {
+        size += std::snprintf(buffer + size, sizeof(buffer) - size, ".%06d", static_cast<int>(micros));
+    }
+    out.append(buffer, size);
 }
 
-void LogFormatter(boost::log::record_view const& rec, boost::log::formatting_ostream& strm) {
-    auto ts = *rec[timestamp];
+template <typename Value>
+void AppendJson(json::serializer& serializer, const Value& value, std::string& out) {
+    serializer.reset(value);
+    char buffer[256];
+    while (!serializer.done()) {
+        out.append(serializer.read(buffer, sizeof(buffer)));
+    }
+}
 
-    auto message_object = json::object{
-        {"timestamp"s, to_iso_extended_string(ts)}
-    };
+std::string& GetThreadRecord() {
+    thread_local std::string record;
+    return record;
+}
 
-    message_object["data"] = *rec[additional_data];
+void BeginRecord(std::string& record) {
+    record.clear();
+    record += R"({"timestamp":")";
+    AppendTimestamp(record);
+    record += R"(","data":)";
+}
 
-    message_object["message"] = *rec[logging::expressions::smessage];
+void EndRecord(std::string& record, std::string_view message) {
+    record += R"(,"message":)";
+    AppendJsonString(record, message);
+    record += "}\n";
 
-    strm << json::serialize(message_object);
+    if (auto* logger = holder.current.load(std::memory_order_acquire)) {
+        logger->Write(record);
+    } else {
+        [[maybe_unused]] auto written = ::write(STDERR_FILENO, record.data(), record.size());
+    }
+}
+
+}  // namespace
+
+void InitLogger(const LoggerOptions& options) {
+    int fd = -1;
+    if (!options.file.empty()) {
+        fd = ::open(options.file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open log file " + options.file.string());
+        }
+    }
+    holder.Reset(std::make_unique<AsyncLogger>(fd >= 0 ? fd : STDERR_FILENO, options.overflow, options.ring_capacity),
+                 fd);
+}
+
+void ShutdownLogger() {
+    holder.Reset();
+}
+
+AsyncLoggerStats GetLoggerStats() {
+    std::lock_guard lock{holder.mutex};
+    return holder.logger ? holder.logger->GetStats() : AsyncLoggerStats{};
 }
 
 void LogData(std::string_view message, const boost::json::value& additional_data_value) {
-    BOOST_LOG_TRIVIAL(info) << boost::log::add_value(additional_data, additional_data_value) << message;
+    // Буферы потока переиспользуются, поэтому форматирование обычно обходится без выделения памяти
+    thread_local json::serializer serializer;
+
+    auto& record = GetThreadRecord();
+    BeginRecord(record);
+    AppendJson(serializer, &additional_data_value, record);
+    EndRecord(record, message);
+}
+
+void LogPreformatted(std::string_view message, std::string_view data_json) {
+    auto& record = GetThreadRecord();
+    BeginRecord(record);
+    record += data_json;
+    EndRecord(record, message);
+}
+
+void AppendJsonString(std::string& out, std::string_view value) {
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    out += '"';
+    for (const char c : value) {
+        switch (c) {
+            case '"':
+                out += R"(\")";
+                break;
+            case '\\':
+                out += R"(\\)";
+                break;
+            case '\n':
+                out += R"(\n)";
+                break;
+            case '\r':
+                out += R"(\r)";
+                break;
+            case '\t':
+                out += R"(\t)";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    const char escaped[] = {'\\', 'u', '0', '0', HEX_DIGITS[(c >> 4) & 0xf], HEX_DIGITS[c & 0xf]};
+                    out.append(escaped, sizeof(escaped));
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
 }
 
-}  // namespace json_logger
\ No newline at end of file
+}  // namespace json_logger
@@ -1,21 +1,46 @@
 #pragma once
 
 #include <boost/json.hpp>
-#include <boost/log/core.hpp>
-#include <boost/log/trivial.hpp>
-#include <boost/log/utility/formatting_ostream.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/manipulators/add_value.hpp>
 
-BOOST_LOG_ATTRIBUTE_KEYWORD(additional_data, "AdditionalData", boost::json::value)
+#include "async_logger.h"
+
+#include <filesystem>
+#include <string_view>
 
 namespace json_logger {
-    
-void InitLogger();
 
-void LogFormatter(boost::log::record_view const& rec, boost::log::formatting_ostream& strm);
+struct LoggerOptions {
+    // Пустой путь — стандартный поток ошибок, куда лог писался всегда
+    std::filesystem::path file;
+    OverflowPolicy overflow = OverflowPolicy::DROP;
+    size_t ring_capacity = AsyncLogger::DEFAULT_RING_CAPACITY;
+};
+
+/*
+ * Запускает асинхронную запись лога. Повторный вызов выводит накопленное и меняет настройки.
+ * InitLogger и ShutdownLogger вызываются, когда другие потоки не пишут в лог
+ */
+void InitLogger(const LoggerOptions& options = {});
+
+// Выводит накопленное и останавливает запись. Дальше записи выводятся синхронно.
+// При завершении программы вызывается сам
+void ShutdownLogger();
 
+AsyncLoggerStats GetLoggerStats();
+
+/*
+ * Строка лога {"timestamp":...,"data":...,"message":...} форматируется в вызывающем потоке
+ * в его собственный буфер и ставится в очередь. До InitLogger записи выводятся синхронно
+ */
 void LogData(std::string_view message, const boost::json::value& additional_data_value);
 
-}  // namespace json_logger
\ No newline at end of file
+/*
+ * То же, но data — уже готовый JSON. Когда буфер потока разогрет, память не выделяется,
+ * поэтому так пишутся частые записи вроде журнала запросов
+ */
+void LogPreformatted(std::string_view message, std::string_view data_json);
+
+// Дописывает строку в кавычках, экранируя её по правилам JSON
+void AppendJsonString(std::string& out, std::string_view value);
+
+}  // namespace json_logger
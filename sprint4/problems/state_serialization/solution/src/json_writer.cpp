@@ -0,0 +1,403 @@
+#include "json_writer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace json_writer {
+
+void JsonWriter::String(std::string_view value) {
+    BeginValue();
+    serializer_.reset(value);
+    Flush();
+    need_comma_ = true;
+}
+
+void JsonWriter::Double(double value) {
+    BeginValue();
+    const boost::json::value json_value = value;
+    serializer_.reset(&json_value);
+    Flush();
+    need_comma_ = true;
+}
+
+void JsonWriter::Int(std::int64_t value) {
+    BeginValue();
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, result.ptr);
+    need_comma_ = true;
+}
+
+void JsonWriter::Uint(std::uint64_t value) {
+    BeginValue();
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, result.ptr);
+    need_comma_ = true;
+}
+
+void JsonWriter::Flush() {
+    char buffer[64];
+    while (!serializer_.done()) {
+        out_.append(serializer_.read(buffer, sizeof(buffer)));
+    }
+}
+
+namespace {
+
+std::string_view IdToKey(std::uint64_t id, char (&buffer)[24]) {
+    return std::string_view(buffer, std::to_chars(buffer, buffer + sizeof(buffer), id).ptr);
+}
+
+// Пара "токен": {...} из объекта players
+void WriteDog(JsonWriter& writer, const model::Dog& dog) {
+    char key[24];
+    writer.Key(IdToKey(dog.GetToken(), key));
+    writer.BeginObject();
+
+    writer.Key("pos");
+    writer.BeginArray();
+    writer.Double(dog.GetCoord().x);
+    writer.Double(dog.GetCoord().y);
+    writer.EndArray();
+
+    writer.Key("speed");
+    writer.BeginArray();
+    writer.Double(dog.GetSpeed().x);
+    writer.Double(dog.GetSpeed().y);
+    writer.EndArray();
+
+    writer.Key("dir");
+    writer.String(model::GetDirAsStr(dog.GetDir()));
+
+    writer.Key("bag");
+    writer.BeginArray();
+    for (const auto& item : dog.GetBag()) {
+        writer.BeginObject();
+        writer.Key("id");
+        writer.Uint(item.id);
+        writer.Key("type");
+        writer.Uint(item.type);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("score");
+    writer.Int(dog.GetScore());
+    writer.EndObject();
+}
+
+// Пара "id": {...} из объекта lostObjects
+void WriteLoot(JsonWriter& writer, const model::LostObject& obj) {
+    char key[24];
+    writer.Key(IdToKey(obj.id, key));
+    writer.BeginObject();
+    writer.Key("type");
+    writer.Uint(obj.type);
+    writer.Key("pos");
+    writer.BeginArray();
+    writer.Double(obj.position.x);
+    writer.Double(obj.position.y);
+    writer.EndArray();
+    writer.EndObject();
+}
+
+/*
+ * Заполняет слой по ячейкам сетки. Ячейки упорядочиваются по ключу, а объекты
+ * одной ячейки лежат в entities подряд. write_entity пишет объект по id
+ * и возвращает его позицию
+ */
+template <typename WriteEntity>
+void WriteLayer(const model::SpatialGrid& grid, std::string& fragments, model::SpatialState::Layer& layer,
+                WriteEntity&& write_entity) {
+    std::vector<std::pair<std::uint64_t, const model::SpatialGrid::Ids*>> cells;
+    cells.reserve(grid.GetCells().size());
+    for (const auto& [key, ids] : grid.GetCells()) {
+        cells.emplace_back(key, &ids);
+    }
+    std::sort(cells.begin(), cells.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    layer.cells.reserve(cells.size());
+    for (const auto& [key, ids] : cells) {
+        model::SpatialState::Cell cell{key, layer.entities.size(), 0};
+        for (auto id : *ids) {
+            model::SpatialState::Entity entity;
+            entity.begin = fragments.size();
+            entity.pos = write_entity(id);
+            entity.end = fragments.size();
+            layer.entities.push_back(entity);
+        }
+        cell.end = layer.entities.size();
+        layer.cells.push_back(cell);
+    }
+}
+
+// Дописывает через запятую объекты слоя не дальше radius от center
+void WriteLayerNear(const model::SpatialState& state, const model::SpatialState::Layer& layer,
+                    model::Position center, double radius, std::string& out) {
+    bool need_comma = false;
+    auto write_cell = [&](const model::SpatialState::Cell& cell) {
+        for (size_t i = cell.begin; i < cell.end; ++i) {
+            const auto& entity = layer.entities[i];
+            const double dx = entity.pos.x - center.x;
+            const double dy = entity.pos.y - center.y;
+            if (dx * dx + dy * dy > radius * radius) {
+                continue;
+            }
+            if (need_comma) {
+                out.push_back(',');
+            }
+            out.append(state.fragments, entity.begin, entity.end - entity.begin);
+            need_comma = true;
+        }
+    };
+
+    using model::SpatialGrid;
+    const auto min_x = SpatialGrid::GetCellIndex(center.x - radius, state.cell_size);
+    const auto max_x = SpatialGrid::GetCellIndex(center.x + radius, state.cell_size);
+    const auto min_y = SpatialGrid::GetCellIndex(center.y - radius, state.cell_size);
+    const auto max_y = SpatialGrid::GetCellIndex(center.y + radius, state.cell_size);
+
+    const auto cell_count = static_cast<double>(max_x - min_x + 1) * static_cast<double>(max_y - min_y + 1);
+    if (cell_count > static_cast<double>(layer.cells.size())) {
+        // Круг накрывает больше ячеек, чем заселено: дешевле пройти по всем
+        for (const auto& cell : layer.cells) {
+            write_cell(cell);
+        }
+        return;
+    }
+
+    for (auto cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        for (auto cell_y = min_y; cell_y <= max_y; ++cell_y) {
+            const auto key = SpatialGrid::MakeCellKey(cell_x, cell_y);
+            auto it = std::lower_bound(layer.cells.begin(), layer.cells.end(), key,
+                                       [](const auto& cell, std::uint64_t key) {
+                                           return cell.key < key;
+                                       });
+            if (it != layer.cells.end() && it->key == key) {
+                write_cell(*it);
+            }
+        }
+    }
+}
+
+using Deltas = std::vector<std::shared_ptr<const model::StateDelta>>;
+using Changes = std::vector<model::StateDelta::Change>;
+using Ids = std::vector<std::uint64_t>;
+
+/*
+ * Пишет объект с последними версиями объектов слоя, изменившихся после since,
+ * и собирает в removed пропавшие. Записи перебираются от новых к старым, так что
+ * судьбу объекта решает последняя запись с ним. Пропавший объект не возвращается:
+ * токены собак и id трофеев не переиспользуются
+ */
+void WriteLayerChanges(JsonWriter& writer, const Deltas& deltas, std::uint64_t since, Changes model::StateDelta::*changes,
+                       Ids model::StateDelta::*removed_ids, Ids& removed) {
+    std::unordered_set<std::uint64_t> seen;
+    writer.BeginObject();
+    for (auto it = deltas.rbegin(); it != deltas.rend() && (*it)->tick > since; ++it) {
+        const auto& delta = **it;
+        for (const auto& change : delta.*changes) {
+            if (seen.insert(change.id).second) {
+                writer.RawMember(std::string_view(delta.fragments).substr(change.begin, change.end - change.begin));
+            }
+        }
+        for (auto id : delta.*removed_ids) {
+            if (seen.insert(id).second) {
+                removed.push_back(id);
+            }
+        }
+    }
+    writer.EndObject();
+}
+
+}  // namespace
+
+void WriteGameState(const model::GameSession& session, std::string& out) {
+    JsonWriter writer{out};
+
+    writer.BeginObject();
+    writer.Key("players");
+    writer.BeginObject();
+    for (const auto* dog : session.GetDogs()) {
+        WriteDog(writer, *dog);
+    }
+    writer.EndObject();
+
+    writer.Key("lostObjects");
+    writer.BeginObject();
+    for (const auto& obj : session.GetLostObjects()) {
+        WriteLoot(writer, obj);
+    }
+    writer.EndObject();
+    writer.EndObject();
+}
+
+void WriteGameState(const model::GameSession& session, std::string& out, model::ChangeTracker& dog_changes,
+                    model::ChangeTracker& loot_changes, model::StateDelta& delta) {
+    JsonWriter writer{out};
+    // С позиции begin в out дописана пара "id": {...}, возможно, с запятой перед ней
+    auto track = [&out, &delta](model::ChangeTracker& tracker, std::vector<model::StateDelta::Change>& changes,
+                                std::uint64_t id, size_t begin) {
+        auto fragment = std::string_view(out).substr(begin);
+        if (fragment.front() == ',') {
+            fragment.remove_prefix(1);
+        }
+        if (tracker.Update(id, util::Fnv1a(fragment))) {
+            const auto offset = delta.fragments.size();
+            delta.fragments.append(fragment);
+            changes.push_back({id, offset, delta.fragments.size()});
+        }
+    };
+
+    writer.BeginObject();
+    writer.Key("players");
+    writer.BeginObject();
+    for (const auto* dog : session.GetDogs()) {
+        const auto begin = out.size();
+        WriteDog(writer, *dog);
+        track(dog_changes, delta.dogs, dog->GetToken(), begin);
+    }
+    writer.EndObject();
+
+    writer.Key("lostObjects");
+    writer.BeginObject();
+    for (const auto& obj : session.GetLostObjects()) {
+        const auto begin = out.size();
+        WriteLoot(writer, obj);
+        track(loot_changes, delta.loots, obj.id, begin);
+    }
+    writer.EndObject();
+    writer.EndObject();
+
+    delta.removed_dogs = dog_changes.TakeRemoved();
+    delta.removed_loots = loot_changes.TakeRemoved();
+}
+
+void WriteStateDelta(const model::StateJournal& journal, std::uint64_t since, std::string& out) {
+    JsonWriter writer{out};
+    writer.BeginObject();
+    writer.Key("tick");
+    writer.Uint(journal.tick);
+
+    const auto& deltas = journal.deltas;
+    // Нужна запись since + 1, иначе изменения каких-то публикаций уже забыты
+    const bool has_history = since <= journal.tick
+        && (since == journal.tick || (!deltas.empty() && deltas.front()->tick <= since + 1));
+    writer.Key("full");
+    writer.Bool(!has_history);
+
+    if (!has_history) {
+        if (journal.state && journal.state->size() > 2) {
+            // Члены полного состояния без его фигурных скобок
+            writer.RawMember(std::string_view(*journal.state).substr(1, journal.state->size() - 2));
+        } else {
+            writer.RawMember(R"("players":{},"lostObjects":{})");
+        }
+        writer.EndObject();
+        return;
+    }
+
+    std::vector<std::uint64_t> removed_dogs;
+    std::vector<std::uint64_t> removed_loots;
+    writer.Key("players");
+    WriteLayerChanges(writer, deltas, since, &model::StateDelta::dogs, &model::StateDelta::removed_dogs,
+                      removed_dogs);
+    writer.Key("lostObjects");
+    WriteLayerChanges(writer, deltas, since, &model::StateDelta::loots, &model::StateDelta::removed_loots,
+                      removed_loots);
+
+    char key[24];
+    writer.Key("removedPlayers");
+    writer.BeginArray();
+    for (auto id : removed_dogs) {
+        writer.String(IdToKey(id, key));
+    }
+    writer.EndArray();
+
+    writer.Key("removedLostObjects");
+    writer.BeginArray();
+    for (auto id : removed_loots) {
+        writer.String(IdToKey(id, key));
+    }
+    writer.EndArray();
+    writer.EndObject();
+}
+
+void WriteSpatialState(const model::GameSession& session, model::SpatialState& state) {
+    state.cell_size = session.GetDogGrid().GetCellSize();
+    JsonWriter writer{state.fragments};
+
+    state.dog_entities.assign(session.GetDogs().size(), 0);
+    WriteLayer(session.GetDogGrid(), state.fragments, state.dogs, [&](std::uint64_t index) {
+        const auto& dog = session.GetDogByIndex(index);
+        state.dog_entities[index] = state.dogs.entities.size();
+        writer.Reset();
+        WriteDog(writer, dog);
+        return model::Position{dog.GetCoord().x, dog.GetCoord().y};
+    });
+
+    WriteLayer(session.GetLootGrid(), state.fragments, state.loots, [&](std::uint64_t id) {
+        const auto* loot = session.FindLoot(id);
+        writer.Reset();
+        WriteLoot(writer, *loot);
+        return loot->position;
+    });
+}
+
+bool WriteNearbyState(const model::SpatialState& state, size_t dog_index, double radius, std::string& out) {
+    if (dog_index >= state.dog_entities.size()) {
+        return false;
+    }
+    const auto center = state.dogs.entities[state.dog_entities[dog_index]].pos;
+
+    out += R"({"players":{)";
+    WriteLayerNear(state, state.dogs, center, radius, out);
+    out += R"(},"lostObjects":{)";
+    WriteLayerNear(state, state.loots, center, radius, out);
+    out += "}}";
+    return true;
+}
+
+boost::json::object GameStateToJson(const model::GameSession& session) {
+    boost::json::object players_by_id;
+    for (const auto& dog : session.GetDogs()) {
+        boost::json::array bag_array;
+        for (const auto& item : dog->GetBag()) {
+            bag_array.push_back(boost::json::object{
+                {"id", item.id},
+                {"type", item.type}
+            });
+        }
+        players_by_id[std::to_string(dog->GetToken())] = boost::json::object {
+            {"pos", boost::json::array{ static_cast<double>(dog->GetCoord().x),
+                                    static_cast<double>(dog->GetCoord().y) }},
+            {"speed", boost::json::array{ static_cast<double>(dog->GetSpeed().x),
+                                        static_cast<double>(dog->GetSpeed().y) }},
+            {"dir", model::GetDirAsStr(dog->GetDir())},
+            {"bag", std::move(bag_array)},
+            {"score", dog->GetScore()}
+        };
+    }
+
+    boost::json::object lost_objects_json;
+    for (const auto& obj : session.GetLostObjects()) {
+        lost_objects_json[std::to_string(obj.id)] = boost::json::object{
+            {"type", obj.type},
+            {"pos", boost::json::array{obj.position.x, obj.position.y}}
+        };
+    }
+
+    return boost::json::object{
+        {"players", std::move(players_by_id)},
+        {"lostObjects", std::move(lost_objects_json)}
+    };
+}
+
+}  // namespace json_writer
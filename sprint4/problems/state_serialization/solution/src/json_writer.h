@@ -0,0 +1,119 @@
+#pragma once
+
+#include <boost/json.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "etag.h"
+#include "model.h"
+
+namespace json_writer {
+
+/*
+ * Потоковая запись JSON в строку без построения дерева boost::json.
+ * Числа с плавающей точкой и строки форматирует boost::json::serializer,
+ * поэтому результат побайтно совпадает с boost::json::serialize
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) noexcept
+        : out_(out) {
+    }
+
+    void BeginObject() {
+        BeginValue();
+        out_.push_back('{');
+        need_comma_ = false;
+    }
+
+    void EndObject() {
+        out_.push_back('}');
+        need_comma_ = true;
+    }
+
+    void BeginArray() {
+        BeginValue();
+        out_.push_back('[');
+        need_comma_ = false;
+    }
+
+    void EndArray() {
+        out_.push_back(']');
+        need_comma_ = true;
+    }
+
+    // Следующее значение пишется без запятой перед ним
+    void Reset() noexcept {
+        need_comma_ = false;
+    }
+
+    void Key(std::string_view key) {
+        String(key);
+        out_.push_back(':');
+        need_comma_ = false;
+    }
+
+    // Дописывает готовую пару "ключ":значение
+    void RawMember(std::string_view member) {
+        BeginValue();
+        out_.append(member);
+        need_comma_ = true;
+    }
+
+    void Bool(bool value) {
+        BeginValue();
+        out_.append(value ? "true" : "false");
+        need_comma_ = true;
+    }
+
+    void String(std::string_view value);
+    void Double(double value);
+    void Int(std::int64_t value);
+    void Uint(std::uint64_t value);
+
+private:
+    void BeginValue() {
+        if (need_comma_) {
+            out_.push_back(',');
+        }
+    }
+
+    void Flush();
+
+    std::string& out_;
+    boost::json::serializer serializer_;
+    bool need_comma_ = false;
+};
+
+// Дописывает в out ответ /api/v1/game/state для сессии
+void WriteGameState(const model::GameSession& session, std::string& out);
+
+/*
+ * То же, что WriteGameState, и заодно заполняет delta объектами, которые
+ * появились или изменились с прошлого вызова для тех же трекеров, и пропавшими
+ */
+void WriteGameState(const model::GameSession& session, std::string& out, model::ChangeTracker& dog_changes,
+                    model::ChangeTracker& loot_changes, model::StateDelta& delta);
+
+/*
+ * Дописывает в out изменения состояния после публикации since:
+ * {"tick":N,"full":false,"players":{...},"lostObjects":{...},"removedPlayers":[...],"removedLostObjects":[...]}.
+ * Если журнал не помнит публикацию since, пишет полное состояние с "full":true
+ */
+void WriteStateDelta(const model::StateJournal& journal, std::uint64_t since, std::string& out);
+
+// Раскладывает состояние сессии по ячейкам её сеток
+void WriteSpatialState(const model::GameSession& session, model::SpatialState& state);
+
+/*
+ * Дописывает в out ответ /api/v1/game/state только с собаками и трофеями не дальше radius
+ * от собаки с индексом dog_index. Возвращает false, если собаки нет в state
+ */
+bool WriteNearbyState(const model::SpatialState& state, size_t dog_index, double radius, std::string& out);
+
+// То же состояние в виде дерева boost::json
+boost::json::object GameStateToJson(const model::GameSession& session);
+
+}  // namespace json_writer
@@ -1,8 +1,11 @@
 #include "sdk.h"
 
+#include "access_log.h"
 #include "application.h"
 #include "json_loader.h"
 #include "json_logger.h"
+#include "metrics.h"
+#include "metrics_handler.h"
 #include "model.h"
 #include "player.h"
 #include "request_handler.h"
@@ -28,8 +31,21 @@ struct Args {
     std::string path_to_file;
     std::string path_to_catalogue;
     bool spawn;
+    bool watch_static = false;
+    std::uintmax_t static_cache_threshold = http_handler::StaticCache::DEFAULT_MAX_FILE_SIZE;
+    std::size_t compression_threshold = http_handler::RequestHandler::DEFAULT_COMPRESSION_THRESHOLD;
     std::optional<std::filesystem::path> state_file;
     std::optional<std::chrono::milliseconds> save_state_period;
+    model::GatherAlgorithm gather_algorithm = model::GatherAlgorithm::GRID;
+    unsigned tick_threads = 1;
+    std::optional<std::uint64_t> random_seed;
+    json_logger::LoggerOptions log;
+    access_log::Options access_log_options;
+    std::string admin_address = "0.0.0.0";
+    unsigned short admin_port = 0;
+    http_handler::CatchUpPolicy tick_catch_up = http_handler::CatchUpPolicy::SINGLE_DELTA;
+    unsigned sim_step = 0;
+    unsigned sim_max_sub_steps = model::FixedTimestep::DEFAULT_MAX_STEPS;
 }; 
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -45,7 +61,32 @@ struct Args {
         ("www-root, w", po::value(&args.path_to_catalogue)->value_name("dir"), "set static files root")
         ("state-file", po::value<std::string>()->value_name("path"), "set state file path")
         ("save-state-period", po::value<int>()->value_name("milliseconds"), "set state save period in game time")
-        ("randomize-spawn-points", "spawn dogs at random positions ");
+        ("randomize-spawn-points", "spawn dogs at random positions ")
+        ("watch-static", "reload cached static files when they change")
+        ("static-cache-threshold", po::value(&args.static_cache_threshold)->value_name("bytes"),
+            "keep static files up to this size in memory, stream larger ones from disk")
+        ("compression-threshold", po::value(&args.compression_threshold)->value_name("bytes"),
+            "compress API responses of at least this size if the client accepts gzip or deflate")
+        ("gather-algorithm", po::value<std::string>()->value_name("grid|brute-force"), "set item gathering algorithm")
+        ("tick-threads", po::value(&args.tick_threads)->value_name("count"), "process game sessions on several threads")
+        ("tick-catch-up", po::value<std::string>()->value_name("single|skip"),
+            "when ticks fall behind, run one long tick or drop missed ticks; use sim-step to split long ticks")
+        ("sim-step", po::value(&args.sim_step)->value_name("milliseconds"),
+            "advance the game in steps of this length whatever the tick delta, 0 for one step per tick")
+        ("sim-max-substeps", po::value(&args.sim_max_sub_steps)->value_name("count"),
+            "limit fixed simulation steps per tick, the rest of a stall is dropped")
+        ("random-seed", po::value<std::uint64_t>()->value_name("seed"), "set random seed for loot generation")
+        ("log-file", po::value<std::string>()->value_name("path"), "write the log to a file instead of stderr")
+        ("log-overflow", po::value<std::string>()->value_name("drop|block"),
+            "drop log records or wait when a thread's log buffer is full")
+        ("access-log-sample", po::value<std::vector<std::string>>()->value_name("class=rate"),
+            "log this share of successful static, api or poll requests, e.g. poll=0.01")
+        ("access-log-slow", po::value<int>()->value_name("milliseconds"),
+            "always log requests served slower than this")
+        ("trust-forwarded-for", "take the client address from X-Forwarded-For set by a reverse proxy")
+        ("admin-port", po::value(&args.admin_port)->value_name("port"),
+            "serve Prometheus metrics at /metrics on this port, 0 disables it")
+        ("admin-address", po::value(&args.admin_address)->value_name("address"), "set admin port address");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -65,16 +106,107 @@ struct Args {
             args.period_ticket = -1;
         }
         args.spawn = vm.contains("randomize-spawn-points");
+        args.watch_static = vm.contains("watch-static");
         if (vm.contains("state-file")) {
             args.state_file = std::filesystem::path(vm["state-file"].as<std::string>());
         }
         if (vm.contains("save-state-period")) {
             args.save_state_period = std::chrono::milliseconds(vm["save-state-period"].as<int>());
         }
+        if (vm.contains("gather-algorithm")) {
+            const auto& algorithm = vm["gather-algorithm"].as<std::string>();
+            if (algorithm == "grid") {
+                args.gather_algorithm = model::GatherAlgorithm::GRID;
+            } else if (algorithm == "brute-force") {
+                args.gather_algorithm = model::GatherAlgorithm::BRUTE_FORCE;
+            } else {
+                throw std::runtime_error("Error: unknown gather algorithm " + algorithm);
+            }
+        }
+        if (vm.contains("tick-catch-up")) {
+            const auto& name = vm["tick-catch-up"].as<std::string>();
+            if (auto policy = http_handler::ParseCatchUpPolicy(name)) {
+                args.tick_catch_up = *policy;
+            } else {
+                throw std::runtime_error("Error: unknown tick catch-up policy " + name);
+            }
+        }
+        if (args.sim_step > 0 && args.period_ticket > 0
+            && static_cast<long long>(args.sim_step) * args.sim_max_sub_steps < args.period_ticket) {
+            throw std::runtime_error("Error: sim-max-substeps steps of sim-step do not cover the tick period");
+        }
+        if (vm.contains("random-seed")) {
+            args.random_seed = vm["random-seed"].as<std::uint64_t>();
+        }
+        if (vm.contains("log-file")) {
+            args.log.file = vm["log-file"].as<std::string>();
+        }
+        if (vm.contains("log-overflow")) {
+            const auto& policy = vm["log-overflow"].as<std::string>();
+            if (policy == "drop") {
+                args.log.overflow = json_logger::OverflowPolicy::DROP;
+            } else if (policy == "block") {
+                args.log.overflow = json_logger::OverflowPolicy::BLOCK;
+            } else {
+                throw std::runtime_error("Error: unknown log overflow policy " + policy);
+            }
+        }
+        if (vm.contains("access-log-sample")) {
+            for (const auto& spec : vm["access-log-sample"].as<std::vector<std::string>>()) {
+                access_log::SetSampleRate(args.access_log_options, spec);
+            }
+        }
+        if (vm.contains("access-log-slow")) {
+            args.access_log_options.slow_threshold = std::chrono::milliseconds(vm["access-log-slow"].as<int>());
+        }
+        args.access_log_options.trust_forwarded_for = vm.contains("trust-forwarded-for");
 
     return args;
 }
 
+// Подсистемы со своими счётчиками опрашиваются, когда выводятся метрики
+void RegisterStatsMetrics(Application& app) {
+    using Type = metrics::Registry::Type;
+    auto& registry = metrics::Registry::GetInstance();
+
+    registry.SetCallback("compression_operations_total", "Bodies compressed with gzip or deflate", Type::COUNTER, [] {
+        return static_cast<double>(compression::GetStats().compressions);
+    });
+    registry.SetCallback("compression_input_bytes_total", "Bytes passed to compression", Type::COUNTER, [] {
+        return static_cast<double>(compression::GetStats().bytes_in);
+    });
+    registry.SetCallback("compression_output_bytes_total", "Bytes produced by compression", Type::COUNTER, [] {
+        return static_cast<double>(compression::GetStats().bytes_out);
+    });
+    registry.SetCallback("compression_cpu_seconds_total", "Thread CPU time spent compressing", Type::COUNTER, [] {
+        return static_cast<double>(compression::GetStats().cpu_time_ns) / 1e9;
+    });
+    registry.SetCallback("compression_cache_hits_total", "Compressed state snapshots reused", Type::COUNTER, [] {
+        return static_cast<double>(compression::GetStats().cache_hits);
+    });
+
+    registry.SetCallback("log_records_total", "Log records queued for writing", Type::COUNTER, [] {
+        return static_cast<double>(json_logger::GetLoggerStats().records);
+    });
+    registry.SetCallback("log_dropped_records_total", "Log records dropped on overflow", Type::COUNTER, [] {
+        return static_cast<double>(json_logger::GetLoggerStats().dropped);
+    });
+    registry.SetCallback("log_written_bytes_total", "Bytes written to the log", Type::COUNTER, [] {
+        return static_cast<double>(json_logger::GetLoggerStats().bytes);
+    });
+    registry.SetCallback("log_write_errors_total", "Failed writes to the log", Type::COUNTER, [] {
+        return static_cast<double>(json_logger::GetLoggerStats().write_errors);
+    });
+
+    registry.SetCallback("game_action_queue_depth", "Player actions waiting for the next tick", Type::GAUGE, [&app] {
+        return static_cast<double>(app.GetActionQueueStats().depth);
+    });
+    registry.SetCallback("game_dropped_actions_total", "Player actions dropped on queue overflow", Type::COUNTER,
+                         [&app] {
+                             return static_cast<double>(app.GetActionQueueStats().dropped);
+                         });
+}
+
 // Запускает функцию fn на n потоках, включая текущий
 template <typename Fn>
 void RunWorkers(unsigned n, const Fn& fn) {
@@ -88,16 +220,20 @@ void RunWorkers(unsigned n, const Fn& fn) {
 }
 
 int main(int argc, const char* argv[]) {
-    json_logger::InitLogger();
-
     try {
         if (auto args = ParseCommandLine(argc, argv)) {
+            // Ошибки разбора параметров выводятся в лог синхронно
+            json_logger::InitLogger(args->log);
             std::filesystem::path path_to_file = args->path_to_file;
             std::string www_root = args->path_to_catalogue;
 
             Application app(json_loader::LoadGame(path_to_file),
                             args->spawn,
                             args->period_ticket >= 0);
+            app.GetGame().SetGatherAlgorithm(args->gather_algorithm);
+            app.GetGame().SetRandomSeed(args->random_seed);
+            app.SetTickThreads(args->tick_threads);
+            app.SetFixedStep(std::chrono::milliseconds(args->sim_step), args->sim_max_sub_steps);
 
             std::optional<state_serialization::StateManager> state_manager;
             if (args->state_file) {
@@ -108,11 +244,12 @@ int main(int argc, const char* argv[]) {
                     json_logger::LogData("state restore failed"sv, boost::json::object{{"error", ex.what()}});
                     return EXIT_FAILURE;
                 }
-                app.SetTickObserver([&state_manager](std::chrono::milliseconds delta) {
+                app.PublishSnapshots();
+                app.AddTickObserver([&state_manager](std::chrono::milliseconds delta) {
                     if (state_manager) {
                         state_manager->OnTick(delta);
                     }
-                });
+                }, "save_state");
             }
 
             const unsigned num_threads = std::thread::hardware_concurrency();
@@ -124,21 +261,41 @@ int main(int argc, const char* argv[]) {
             });
 
             auto api_strand = net::make_strand(ioc);
-            auto handler = std::make_shared<http_handler::RequestHandler>(app, www_root, api_strand);
+            auto handler = std::make_shared<http_handler::RequestHandler>(app, www_root, api_strand,
+                                                                          args->static_cache_threshold,
+                                                                          args->compression_threshold);
+            if (args->watch_static) {
+                handler->GetStaticCache().Watch(ioc);
+            }
+            // Подписчики /api/v1/game/stream получают состояние после каждого тика
+            app.AddTickObserver([handler](std::chrono::milliseconds) {
+                handler->GetStateBroadcaster().Broadcast();
+            }, "broadcast");
 
             auto ticker = std::make_shared<http_handler::Ticker>(api_strand, std::chrono::milliseconds(args->period_ticket),
                 [&app](std::chrono::milliseconds delta) { 
                     if (app.GetAutoTick()) {
                         app.Tick(delta);
                     }                    
-                }
+                },
+                args->tick_catch_up
             );
             ticker->Start();
 
             const auto address = net::ip::make_address("0.0.0.0");
             constexpr unsigned short port = 8080;
-            http_server::ServeHttp(ioc, {address, port}, [handler](auto&& req, auto&& send) {
-                (*handler)(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
+            auto request_log = std::make_shared<const access_log::AccessLog>(args->access_log_options);
+            http_server::ServeHttp(ioc, {address, port}, http_handler::LoggingRequestHandler{handler, request_log});
+
+            // Служебный порт работает в своём потоке и не делит с игрой потоки ввода-вывода
+            RegisterStatsMetrics(app);
+            net::io_context admin_ioc(1);
+            if (args->admin_port != 0) {
+                http_server::ServeHttp(admin_ioc, {net::ip::make_address(args->admin_address), args->admin_port},
+                                       http_handler::MetricsRequestHandler{});
+            }
+            std::jthread admin_thread([&admin_ioc] {
+                admin_ioc.run();
             });
 
             json_logger::LogData("server started"sv, boost::json::object{{"port", port}, {"address", address.to_string()}});
@@ -146,6 +303,7 @@ int main(int argc, const char* argv[]) {
             RunWorkers(std::max(1u, num_threads), [&ioc] {
                 ioc.run();
             });
+            admin_ioc.stop();
             if (state_manager) {
                 state_manager->Save();
             }
@@ -0,0 +1,250 @@
+#include "metrics.h"
+
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace metrics {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr double NANOSECONDS_PER_SECOND = 1e9;
+
+// Границы корзин при выводе — степени двойки от 1 мкс до минуты: на них подсчёт точный
+constexpr unsigned FIRST_EXPORTED_BOUND_BIT = 10;
+constexpr unsigned LAST_EXPORTED_BOUND_BIT = 36;
+
+std::atomic<size_t> next_shard{0};
+
+std::string_view GetTypeName(Registry::Type type) {
+    switch (type) {
+        case Registry::Type::COUNTER:
+            return "counter"sv;
+        case Registry::Type::GAUGE:
+            return "gauge"sv;
+        case Registry::Type::HISTOGRAM:
+            break;
+    }
+    return "histogram"sv;
+}
+
+void AppendEscaped(std::string& out, std::string_view value, bool escape_quotes) {
+    for (const char c : value) {
+        if (c == '\\') {
+            out += R"(\\)";
+        } else if (c == '\n') {
+            out += R"(\n)";
+        } else if (c == '"' && escape_quotes) {
+            out += R"(\")";
+        } else {
+            out += c;
+        }
+    }
+}
+
+std::string RenderLabels(const Labels& labels) {
+    std::string result;
+    for (const auto& [key, value] : labels) {
+        if (!result.empty()) {
+            result += ',';
+        }
+        result += key;
+        result += "=\"";
+        AppendEscaped(result, value, true);
+        result += '"';
+    }
+    return result;
+}
+
+template <typename Number>
+void AppendNumber(std::string& out, Number value) {
+    if constexpr (std::is_floating_point_v<Number>) {
+        if (std::isnan(value)) {
+            out += "NaN";
+            return;
+        }
+        if (std::isinf(value)) {
+            out += value > 0 ? "+Inf" : "-Inf";
+            return;
+        }
+    }
+    char buffer[32];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+// name{labels,extra} value
+template <typename Number>
+void AppendSample(std::string& out, std::string_view name, std::string_view labels, std::string_view extra,
+                  Number value) {
+    out += name;
+    if (!labels.empty() || !extra.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extra.empty()) {
+            out += ',';
+        }
+        out += extra;
+        out += '}';
+    }
+    out += ' ';
+    AppendNumber(out, value);
+    out += '\n';
+}
+
+void AppendHistogram(std::string& out, const std::string& name, const std::string& labels,
+                     const Histogram::Snapshot& snapshot) {
+    const auto bucket_name = name + "_bucket";
+    for (unsigned bit = FIRST_EXPORTED_BOUND_BIT; bit <= LAST_EXPORTED_BOUND_BIT; ++bit) {
+        const auto bound = std::uint64_t{1} << bit;
+        // Prometheus считает значения не больше le, здесь — строго меньше: разница только
+        // в значениях, равных границе с точностью до наносекунды
+        std::string le = "le=\"";
+        AppendNumber(le, static_cast<double>(bound) / NANOSECONDS_PER_SECOND);
+        le += '"';
+        AppendSample(out, bucket_name, labels, le, snapshot.CountBelow(bound));
+    }
+    AppendSample(out, bucket_name, labels, R"(le="+Inf")"sv, snapshot.count);
+    AppendSample(out, name + "_sum", labels, {}, static_cast<double>(snapshot.sum) / NANOSECONDS_PER_SECOND);
+    AppendSample(out, name + "_count", labels, {}, snapshot.count);
+}
+
+}  // namespace
+
+size_t GetThreadShard() noexcept {
+    thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+std::uint64_t Histogram::Snapshot::CountBelow(std::uint64_t bound) const noexcept {
+    std::uint64_t result = 0;
+    for (size_t i = 0; i < BUCKET_COUNT && GetBucketUpperBound(i) <= bound; ++i) {
+        result += buckets[i];
+    }
+    return result;
+}
+
+std::chrono::nanoseconds Histogram::Snapshot::GetQuantile(double q) const noexcept {
+    if (count == 0) {
+        return {};
+    }
+    const auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(count)));
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= std::max<std::uint64_t>(rank, 1)) {
+            return std::chrono::nanoseconds(GetBucketUpperBound(i));
+        }
+    }
+    return std::chrono::nanoseconds(GetBucketUpperBound(BUCKET_COUNT - 1));
+}
+
+Histogram::Snapshot Histogram::GetSnapshot() const noexcept {
+    Snapshot snapshot;
+    for (const auto& shard : shards_) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    for (const auto bucket : snapshot.buckets) {
+        snapshot.count += bucket;
+    }
+    return snapshot;
+}
+
+Registry& Registry::GetInstance() {
+    static Registry instance;
+    return instance;
+}
+
+Registry::Metric& Registry::GetMetric(const std::string& name, std::string_view help, Type type,
+                                      const Labels& labels) {
+    auto [it, inserted] = families_.try_emplace(name);
+    auto& family = it->second;
+    if (inserted) {
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        throw std::invalid_argument("Metric " + name + " is already registered with another type");
+    }
+
+    auto rendered = RenderLabels(labels);
+    for (auto& metric : family.metrics) {
+        if (metric.labels == rendered) {
+            return metric;
+        }
+    }
+    auto& metric = family.metrics.emplace_back();
+    metric.labels = std::move(rendered);
+    return metric;
+}
+
+Counter& Registry::GetCounter(const std::string& name, std::string_view help, const Labels& labels) {
+    std::lock_guard lock{mutex_};
+    auto& metric = GetMetric(name, help, Type::COUNTER, labels);
+    if (!metric.counter) {
+        metric.counter = std::make_unique<Counter>();
+    }
+    return *metric.counter;
+}
+
+Gauge& Registry::GetGauge(const std::string& name, std::string_view help, const Labels& labels) {
+    std::lock_guard lock{mutex_};
+    auto& metric = GetMetric(name, help, Type::GAUGE, labels);
+    if (!metric.gauge) {
+        metric.gauge = std::make_unique<Gauge>();
+    }
+    return *metric.gauge;
+}
+
+Histogram& Registry::GetHistogram(const std::string& name, std::string_view help, const Labels& labels) {
+    std::lock_guard lock{mutex_};
+    auto& metric = GetMetric(name, help, Type::HISTOGRAM, labels);
+    if (!metric.histogram) {
+        metric.histogram = std::make_unique<Histogram>();
+    }
+    return *metric.histogram;
+}
+
+void Registry::SetCallback(const std::string& name, std::string_view help, Type type, Callback callback,
+                           const Labels& labels) {
+    if (type == Type::HISTOGRAM) {
+        throw std::invalid_argument("Histogram " + name + " can't be computed by a callback");
+    }
+    std::lock_guard lock{mutex_};
+    GetMetric(name, help, type, labels).callback = std::move(callback);
+}
+
+std::string Registry::RenderPrometheus() const {
+    std::lock_guard lock{mutex_};
+    std::string out;
+    for (const auto& [name, family] : families_) {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        AppendEscaped(out, family.help, false);
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += GetTypeName(family.type);
+        out += '\n';
+
+        for (const auto& metric : family.metrics) {
+            if (metric.callback) {
+                AppendSample(out, name, metric.labels, {}, metric.callback());
+            } else if (metric.counter) {
+                AppendSample(out, name, metric.labels, {}, metric.counter->Get());
+            } else if (metric.gauge) {
+                AppendSample(out, name, metric.labels, {}, metric.gauge->Get());
+            } else if (metric.histogram) {
+                AppendHistogram(out, name, metric.labels, metric.histogram->GetSnapshot());
+            }
+        }
+    }
+    return out;
+}
+
+}  // namespace metrics
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+// Число ячеек, между которыми распределяются потоки. Потоков сервера обычно не больше
+inline constexpr size_t SHARD_COUNT = 16;
+
+// Ячейка потока: назначается по кругу при первом обращении и дальше не меняется
+size_t GetThreadShard() noexcept;
+
+/*
+ * Значение, которое потоки меняют без блокировок, каждый в своей ячейке на отдельной
+ * строке кэша. Чтение складывает все ячейки, поэтому стоит дороже записи
+ */
+template <typename T>
+class ShardedValue {
+public:
+    void Add(T delta) noexcept {
+        shards_[GetThreadShard()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    T Get() const noexcept {
+        T sum = 0;
+        for (const auto& shard : shards_) {
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<T> value{0};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards_;
+};
+
+// Только растёт
+class Counter : public ShardedValue<std::uint64_t> {
+public:
+    void Increment(std::uint64_t delta = 1) noexcept {
+        Add(delta);
+    }
+};
+
+// Растёт и убывает, например число открытых соединений
+class Gauge : public ShardedValue<std::int64_t> {};
+
+/*
+ * Гистограмма длительностей в наносекундах в духе HdrHistogram: каждая степень двойки
+ * делится на SUB_BUCKET_COUNT равных корзин, поэтому относительная погрешность не больше 1/16
+ * во всём диапазоне, а запись — это вычисление индекса и атомарное сложение в ячейке потока
+ */
+class Histogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr std::uint64_t SUB_BUCKET_COUNT = std::uint64_t{1} << SUB_BUCKET_BITS;
+    // Значения от 2^MAX_VALUE_BITS нс (около 18 минут) попадают в последнюю корзину
+    static constexpr unsigned MAX_VALUE_BITS = 40;
+    static constexpr size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static constexpr size_t GetBucketIndex(std::uint64_t value) noexcept {
+        if (value < SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        unsigned top_bit = 63;
+        while (!(value >> top_bit)) {
+            --top_bit;
+        }
+        if (top_bit >= MAX_VALUE_BITS) {
+            return BUCKET_COUNT - 1;
+        }
+        const unsigned shift = top_bit - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT);
+    }
+
+    // Наименьшее значение, которое уже не попадает в корзину index
+    static constexpr std::uint64_t GetBucketUpperBound(size_t index) noexcept {
+        if (index < SUB_BUCKET_COUNT) {
+            return index + 1;
+        }
+        const auto shift = index / SUB_BUCKET_COUNT - 1;
+        const auto mantissa = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+        return (mantissa + 1) << shift;
+    }
+
+    void Record(std::chrono::nanoseconds duration) noexcept {
+        const auto value = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+        auto& shard = shards_[GetThreadShard()];
+        shard.buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        std::array<std::uint64_t, BUCKET_COUNT> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+
+        // Число значений меньше bound наносекунд. Точно, если bound — степень двойки
+        std::uint64_t CountBelow(std::uint64_t bound) const noexcept;
+        // Верхняя граница корзины, в которую попадает квантиль q
+        std::chrono::nanoseconds GetQuantile(double q) const noexcept;
+    };
+
+    Snapshot GetSnapshot() const noexcept;
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> buckets{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards_;
+};
+
+// Засекает время жизни объекта и записывает его в гистограмму
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram) noexcept
+        : histogram_(histogram)
+        , start_(std::chrono::steady_clock::now()) {
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        histogram_.Record(std::chrono::steady_clock::now() - start_);
+    }
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Оборачивает задачу так, чтобы при запуске она записала, сколько ждала в очереди исполнителя
+template <typename Handler>
+auto MeasureQueueDelay(Histogram& histogram, Handler&& handler) {
+    return [&histogram, queued = std::chrono::steady_clock::now(),
+            handler = std::forward<Handler>(handler)]() mutable {
+        histogram.Record(std::chrono::steady_clock::now() - queued);
+        handler();
+    };
+}
+
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+/*
+ * Реестр метрик. Метрики создаются при запуске и живут, пока жив реестр,
+ * поэтому код держит ссылки на них и пишет без обращения к реестру.
+ * Повторный запрос метрики с тем же именем и метками возвращает уже созданную
+ */
+class Registry {
+public:
+    enum class Type {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    using Callback = std::function<double()>;
+
+    static Registry& GetInstance();
+
+    Counter& GetCounter(const std::string& name, std::string_view help, const Labels& labels = {});
+    Gauge& GetGauge(const std::string& name, std::string_view help, const Labels& labels = {});
+    Histogram& GetHistogram(const std::string& name, std::string_view help, const Labels& labels = {});
+
+    // Значение, которое считывается при выводе, например из статистики другой подсистемы.
+    // Повторная регистрация заменяет функцию
+    void SetCallback(const std::string& name, std::string_view help, Type type, Callback callback,
+                     const Labels& labels = {});
+
+    // Все метрики в текстовом формате Prometheus. Длительности выводятся в секундах
+    std::string RenderPrometheus() const;
+
+private:
+    struct Metric {
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        Callback callback;
+    };
+
+    struct Family {
+        std::string help;
+        Type type;
+        std::vector<Metric> metrics;
+    };
+
+    Metric& GetMetric(const std::string& name, std::string_view help, Type type, const Labels& labels);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+}  // namespace metrics
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "http_server.h"
+#include "metrics.h"
+
+#include <boost/beast/http.hpp>
+
+namespace http_handler {
+
+/*
+ * Обработчик служебного порта: отдаёт метрики по GET /metrics в текстовом формате Prometheus.
+ * Служебный порт обслуживается своим io_context, поэтому опрос метрик не занимает потоки игры
+ */
+class MetricsRequestHandler {
+public:
+    static constexpr std::string_view CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+    explicit MetricsRequestHandler(const metrics::Registry& registry = metrics::Registry::GetInstance())
+        : registry_{&registry} {}
+
+    template <typename Send>
+    void operator()(const http_server::tcp::endpoint&, http_server::http::request<http_server::http::string_body>&& req,
+                    Send&& send) {
+        send(MakeResponse(req));
+    }
+
+    // Переход к WebSocket служебный порт не поддерживает
+    template <typename Send, typename Accept>
+    void operator()(const http_server::tcp::endpoint&,
+                    const http_server::http::request<http_server::http::string_body>& req, Send&& send, Accept&&) {
+        send(MakeResponse(req));
+    }
+
+private:
+    http_server::http::response<http_server::http::string_body> MakeResponse(
+        const http_server::http::request<http_server::http::string_body>& req) const {
+        namespace http = http_server::http;
+
+        http::response<http::string_body> res{http::status::ok, req.version()};
+        res.set(http::field::cache_control, "no-cache");
+        res.keep_alive(req.keep_alive());
+        if (req.target() != "/metrics") {
+            res.result(http::status::not_found);
+            res.set(http::field::content_type, "text/plain");
+            res.body() = "Not found";
+        } else if (req.method() != http::verb::get && req.method() != http::verb::head) {
+            res.result(http::status::method_not_allowed);
+            res.set(http::field::allow, "GET, HEAD");
+            res.set(http::field::content_type, "text/plain");
+            res.body() = "Only GET/HEAD methods are allowed";
+        } else {
+            res.set(http::field::content_type, CONTENT_TYPE);
+            res.body() = registry_->RenderPrometheus();
+        }
+        res.prepare_payload();
+        if (req.method() == http::verb::head) {
+            res.body().clear();
+        }
+        return res;
+    }
+
+    const metrics::Registry* registry_;
+};
+
+}  // namespace http_handler
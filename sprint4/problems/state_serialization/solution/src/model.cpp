@@ -1,5 +1,7 @@
 #include "model.h"
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 namespace model {
@@ -26,10 +28,29 @@ CollectionResult TryCollectPoint(Position a, Position b, Position c) {
     return CollectionResult(sq_distance, proj_ratio);
 }
 
-// В задании на разработку тестов реализовывать следующую функцию не нужно -
-// она будет линковаться извне.
+namespace {
 
-std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider) {
+// Размер ячейки сетки для поиска событий сбора
+constexpr double GATHER_CELL_SIZE = 4.0;
+// Запас на погрешность вычисления расстояния при отборе кандидатов
+constexpr double GATHER_CELL_MARGIN = 1e-6;
+
+std::int64_t GetCell(double coord, double cell_size) noexcept {
+    return static_cast<std::int64_t>(std::floor(coord / cell_size));
+}
+
+std::uint64_t MakeCellKey(std::int64_t cell_x, std::int64_t cell_y) noexcept {
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell_x)) << 32)
+         | static_cast<std::uint32_t>(cell_y);
+}
+
+void SortByTime(std::vector<GatheringEvent>& events) {
+    std::sort(events.begin(), events.end(), [](GatheringEvent& lhs, GatheringEvent& rhs) {
+        return lhs.time < rhs.time;
+    });
+}
+
+std::vector<GatheringEvent> FindGatherEventsByBruteForce(const ItemGathererProvider& provider) {
     std::vector<GatheringEvent> res;
 
     for(int i = 0; i < provider.GatherersCount(); ++i) {
@@ -44,12 +65,76 @@ std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provide
         }
     }
 
-    std::sort(res.begin(), res.end(), [](GatheringEvent& lhs, GatheringEvent& rhs) {
-        return lhs.time < rhs.time;
-    });
+    SortByTime(res);
+    return res;
+}
+
+// Предметы раскладываются по ячейкам сетки, и для каждого собирателя проверяются
+// только предметы из ячеек, которые задевает его путь. Кандидаты перебираются
+// в порядке индексов, поэтому события до сортировки идут так же, как при полном переборе
+std::vector<GatheringEvent> FindGatherEventsInGrid(const ItemGathererProvider& provider) {
+    std::vector<GatheringEvent> res;
+
+    std::vector<Item> items;
+    items.reserve(provider.ItemsCount());
+    double max_item_width = 0.0;
+    std::unordered_map<std::uint64_t, std::vector<size_t>> cells;
+    for (size_t j = 0; j < provider.ItemsCount(); ++j) {
+        const auto& item = items.emplace_back(provider.GetItem(j));
+        max_item_width = std::max(max_item_width, item.width);
+        cells[MakeCellKey(GetCell(item.position.x, GATHER_CELL_SIZE),
+                          GetCell(item.position.y, GATHER_CELL_SIZE))].push_back(j);
+    }
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < provider.GatherersCount(); ++i) {
+        const auto gatherer = provider.GetGatherer(i);
+        const double reach = gatherer.width + max_item_width + GATHER_CELL_MARGIN;
+        const auto min_x = GetCell(std::min(gatherer.start_pos.x, gatherer.end_pos.x) - reach, GATHER_CELL_SIZE);
+        const auto max_x = GetCell(std::max(gatherer.start_pos.x, gatherer.end_pos.x) + reach, GATHER_CELL_SIZE);
+        const auto min_y = GetCell(std::min(gatherer.start_pos.y, gatherer.end_pos.y) - reach, GATHER_CELL_SIZE);
+        const auto max_y = GetCell(std::max(gatherer.start_pos.y, gatherer.end_pos.y) + reach, GATHER_CELL_SIZE);
+
+        candidates.clear();
+        const auto cell_count = static_cast<double>(max_x - min_x + 1) * static_cast<double>(max_y - min_y + 1);
+        if (cell_count > static_cast<double>(cells.size())) {
+            // Путь длиннее всей заселённой сетки: дешевле проверить все предметы
+            for (const auto& [key, ids] : cells) {
+                candidates.insert(candidates.end(), ids.begin(), ids.end());
+            }
+        } else {
+            for (auto cell_x = min_x; cell_x <= max_x; ++cell_x) {
+                for (auto cell_y = min_y; cell_y <= max_y; ++cell_y) {
+                    if (auto it = cells.find(MakeCellKey(cell_x, cell_y)); it != cells.end()) {
+                        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+                    }
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (size_t j : candidates) {
+            const auto& item = items[j];
+            auto collect = TryCollectPoint(gatherer.start_pos, gatherer.end_pos, item.position);
+            if (collect.IsCollected(item.width + gatherer.width)) {
+                res.push_back(GatheringEvent(j, i, collect.sq_distance, collect.proj_ratio));
+            }
+        }
+    }
+
+    SortByTime(res);
     return res;
 }
 
+}  // namespace
+
+std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider, GatherAlgorithm algorithm) {
+    if (algorithm == GatherAlgorithm::GRID) {
+        return FindGatherEventsInGrid(provider);
+    }
+    return FindGatherEventsByBruteForce(provider);
+}
+
 Dog* GameSession::RestoreDog(const std::string& name,
                              std::uint64_t token,
                              Dog::Coordinate coord,
@@ -65,8 +150,9 @@ Dog* GameSession::RestoreDog(const std::string& name,
     if (bag.size() > static_cast<size_t>(bag_capacity)) {
         throw std::runtime_error("Bag content exceeds capacity");
     }
-    auto dog = dogs_.emplace_back(std::make_unique<Dog>(token, name, coord, speed)).get();
+    auto dog = dogs_.emplace_back(std::make_unique<Dog>(hot_, token, name, coord, speed)).get();
     dogs_id_[dog->GetToken()] = dog;
+    dog_grid_.Update(dog->GetIndex(), Position{coord.x, coord.y});
     dog->SetDir(dir);
     dog->SetBagCapacity(bag_capacity);
     dog->ClearBag();
@@ -86,18 +172,311 @@ Dog* GameSession::FindDogByToken(std::uint64_t token) const noexcept {
     return nullptr;
 }
 
-void GameSession::RestoreLostObjects(std::unordered_map<int, LostObject> loots, int next_loot_id) {
-    loots_ = std::move(loots);
+void GameSession::MoveDogs(std::chrono::milliseconds time) {
+    const auto time_s = std::chrono::duration<double>(time).count();
+    for (size_t i = 0; i < hot_.Size(); ++i) {
+        MoveDogByIndex(i, time_s);
+    }
+}
+
+void GameSession::MoveDog(const Dog& dog, std::chrono::milliseconds time) {
+    MoveDogByIndex(dog.GetIndex(), std::chrono::duration<double>(time).count());
+}
+
+void GameSession::MoveDogByIndex(size_t index, double time_s) {
+    auto& speed = hot_.speeds[index];
+    if (speed.x == 0.0 && speed.y == 0.0) {
+        return;
+    }
+
+    auto& coord = hot_.coords[index];
+    hot_.prev_positions[index] = Position{coord.x, coord.y};
+    const Dog::Coordinate next_pos{coord.x + (speed.x * time_s), coord.y + (speed.y * time_s)};
+
+    const auto& roads = map_->GetRoads();
+    const auto& near_roads = map_->GetRoadIndex().GetRoadsNear(next_pos.x, next_pos.y);
+    const bool on_road = std::any_of(near_roads.begin(), near_roads.end(), [&roads, &next_pos](size_t road_id) {
+        return roads[road_id].Contains(next_pos.x, next_pos.y);
+    });
+    if (on_road) {
+        coord = next_pos;
+    } else {
+        const auto edge = map_->GetRoadGraph().GetReachableEdge(Position{coord.x, coord.y}, hot_.dirs[index]);
+        speed = Dog::Speed{0.0, 0.0};
+        coord = Dog::Coordinate{edge.x, edge.y};
+    }
+    dog_grid_.Update(index, Position{coord.x, coord.y});
+}
+
+void GameSession::RestoreLostObjects(const std::vector<LostObject>& loots, int next_loot_id) {
+    loots_.Clear();
+    loot_handles_.clear();
+    loot_grid_.Clear();
+    loots_.Reserve(loots.size());
+    for (const auto& loot : loots) {
+        AddLoot(loot);
+    }
     next_loot_id_ = next_loot_id;
 }
 
+void GameSession::ChangeDogDir(size_t dog_index, std::optional<Direction> dir) {
+    Dog::Speed speed{0.0, 0.0};
+    if (dir) {
+        const double map_speed = map_->GetSpeed();
+        switch (*dir) {
+            case Direction::NORTH:
+                speed = Dog::Speed{0.0, -map_speed};
+                break;
+            case Direction::SOUTH:
+                speed = Dog::Speed{0.0, map_speed};
+                break;
+            case Direction::WEST:
+                speed = Dog::Speed{-map_speed, 0.0};
+                break;
+            case Direction::EAST:
+                speed = Dog::Speed{map_speed, 0.0};
+                break;
+        }
+        hot_.dirs[dog_index] = *dir;
+    }
+    hot_.speeds[dog_index] = speed;
+}
+
+void GameSession::ApplyActions() {
+    while (auto action = actions_.TryPop()) {
+        // Команда могла прийти для собаки, которой уже нет после загрузки состояния
+        if (action->dog_index < hot_.Size()) {
+            ChangeDogDir(action->dog_index, action->dir);
+        }
+    }
+}
+
 void GameSession::ClearState() {
+    while (actions_.TryPop()) {
+    }
     dogs_.clear();
     dogs_id_.clear();
-    loots_.clear();
+    hot_.Clear();
+    loots_.Clear();
+    loot_handles_.clear();
+    dog_grid_.Clear();
+    loot_grid_.Clear();
     next_loot_id_ = 0;
 }
 
+void GameSession::PublishSnapshot(StateSnapshot snapshot, std::shared_ptr<StateDelta> delta) {
+    auto journal = std::make_shared<StateJournal>();
+    if (auto previous = GetJournal()) {
+        journal->tick = previous->tick;
+        const auto& deltas = previous->deltas;
+        const size_t keep = std::min(deltas.size(), JOURNAL_CAPACITY - 1);
+        journal->deltas.reserve(keep + 1);
+        journal->deltas.assign(deltas.end() - keep, deltas.end());
+    }
+    delta->tick = ++journal->tick;
+    journal->state = snapshot;
+    journal->deltas.push_back(std::move(delta));
+
+    PublishSnapshot(std::move(snapshot));
+    std::atomic_store_explicit(&journal_, JournalSnapshot{std::move(journal)}, std::memory_order_release);
+}
+
+bool ChangeTracker::Update(std::uint64_t id, std::uint64_t hash) {
+    auto [it, inserted] = entries_.try_emplace(id, Entry{hash, generation_});
+    if (inserted) {
+        return true;
+    }
+    it->second.generation = generation_;
+    if (it->second.hash == hash) {
+        return false;
+    }
+    it->second.hash = hash;
+    return true;
+}
+
+std::vector<std::uint64_t> ChangeTracker::TakeRemoved() {
+    std::vector<std::uint64_t> removed;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.generation != generation_) {
+            removed.push_back(it->first);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ++generation_;
+    return removed;
+}
+
+std::int64_t SpatialGrid::GetCellIndex(double coord, double cell_size) noexcept {
+    return GetCell(coord, cell_size);
+}
+
+std::uint64_t SpatialGrid::MakeCellKey(std::int64_t cell_x, std::int64_t cell_y) noexcept {
+    return model::MakeCellKey(cell_x, cell_y);
+}
+
+void SpatialGrid::Update(std::uint64_t id, Position pos) {
+    const auto key = GetCellKey(pos);
+    if (auto [it, inserted] = id_to_cell_.emplace(id, key); !inserted) {
+        if (it->second == key) {
+            return;
+        }
+        EraseFromCell(id, it->second);
+        it->second = key;
+    }
+    cells_[key].push_back(id);
+}
+
+void SpatialGrid::Erase(std::uint64_t id) {
+    if (auto it = id_to_cell_.find(id); it != id_to_cell_.end()) {
+        EraseFromCell(id, it->second);
+        id_to_cell_.erase(it);
+    }
+}
+
+void SpatialGrid::Clear() noexcept {
+    cells_.clear();
+    id_to_cell_.clear();
+}
+
+void SpatialGrid::EraseFromCell(std::uint64_t id, std::uint64_t key) {
+    auto cell = cells_.find(key);
+    if (cell == cells_.end()) {
+        return;
+    }
+    auto& ids = cell->second;
+    if (auto it = std::find(ids.begin(), ids.end(), id); it != ids.end()) {
+        *it = ids.back();
+        ids.pop_back();
+    }
+    if (ids.empty()) {
+        cells_.erase(cell);
+    }
+}
+
+void RoadIndex::AddRoad(const Road& road, size_t road_id) {
+    const auto start = road.GetStart();
+    const auto end = road.GetEnd();
+    const auto min_x = GetCell(std::min(start.x, end.x) - Road::HALF_WIDTH, CELL_SIZE);
+    const auto max_x = GetCell(std::max(start.x, end.x) + Road::HALF_WIDTH, CELL_SIZE);
+    const auto min_y = GetCell(std::min(start.y, end.y) - Road::HALF_WIDTH, CELL_SIZE);
+    const auto max_y = GetCell(std::max(start.y, end.y) + Road::HALF_WIDTH, CELL_SIZE);
+
+    for (auto cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        for (auto cell_y = min_y; cell_y <= max_y; ++cell_y) {
+            cells_[MakeCellKey(cell_x, cell_y)].push_back(road_id);
+        }
+    }
+}
+
+const RoadIndex::RoadIds& RoadIndex::GetRoadsNear(double x, double y) const {
+    static const RoadIds empty;
+    if (auto it = cells_.find(MakeCellKey(GetCell(x, CELL_SIZE), GetCell(y, CELL_SIZE))); it != cells_.end()) {
+        return it->second;
+    }
+    return empty;
+}
+
+void RoadGraph::Build(const std::vector<Road>& roads) {
+    road_count_ = roads.size();
+    std::vector<std::pair<Segment, Segment>> by_x;
+    std::vector<std::pair<Segment, Segment>> by_y;
+    by_x.reserve(roads.size());
+    by_y.reserve(roads.size());
+
+    for (const auto& road : roads) {
+        const auto start = road.GetStart();
+        const auto end = road.GetEnd();
+        const Segment x{std::min(start.x, end.x) - Road::HALF_WIDTH, std::max(start.x, end.x) + Road::HALF_WIDTH};
+        const Segment y{std::min(start.y, end.y) - Road::HALF_WIDTH, std::max(start.y, end.y) + Road::HALF_WIDTH};
+        by_x.emplace_back(x, y);
+        by_y.emplace_back(y, x);
+    }
+
+    vertical_.Build(by_x);
+    horizontal_.Build(by_y);
+}
+
+Position RoadGraph::GetReachableEdge(Position pos, Direction dir) const {
+    switch (dir) {
+        case Direction::NORTH:
+            if (auto segment = vertical_.FindSegment(pos.x, pos.y)) {
+                pos.y = segment->from;
+            }
+            break;
+        case Direction::SOUTH:
+            if (auto segment = vertical_.FindSegment(pos.x, pos.y)) {
+                pos.y = segment->to;
+            }
+            break;
+        case Direction::WEST:
+            if (auto segment = horizontal_.FindSegment(pos.y, pos.x)) {
+                pos.x = segment->from;
+            }
+            break;
+        case Direction::EAST:
+            if (auto segment = horizontal_.FindSegment(pos.y, pos.x)) {
+                pos.x = segment->to;
+            }
+            break;
+    }
+    return pos;
+}
+
+void RoadGraph::Axis::Build(const std::vector<std::pair<Segment, Segment>>& roads) {
+    bounds_.clear();
+    for (const auto& [across, along] : roads) {
+        bounds_.push_back(across.from);
+        bounds_.push_back(across.to);
+    }
+    std::sort(bounds_.begin(), bounds_.end());
+    bounds_.erase(std::unique(bounds_.begin(), bounds_.end()), bounds_.end());
+
+    lanes_.assign(bounds_.size() * 2 + 1, {});
+    for (const auto& [across, along] : roads) {
+        for (auto lane = GetLane(across.from), last = GetLane(across.to); lane <= last; ++lane) {
+            lanes_[lane].push_back(along);
+        }
+    }
+
+    for (auto& lane : lanes_) {
+        std::sort(lane.begin(), lane.end(), [](const Segment& lhs, const Segment& rhs) {
+            return lhs.from < rhs.from;
+        });
+        std::vector<Segment> merged;
+        for (const auto& segment : lane) {
+            if (!merged.empty() && segment.from <= merged.back().to) {
+                merged.back().to = std::max(merged.back().to, segment.to);
+            } else {
+                merged.push_back(segment);
+            }
+        }
+        merged.shrink_to_fit();
+        lane = std::move(merged);
+    }
+}
+
+const RoadGraph::Segment* RoadGraph::Axis::FindSegment(double across, double along) const {
+    if (lanes_.empty()) {
+        return nullptr;
+    }
+    const auto& lane = lanes_[GetLane(across)];
+    auto it = std::upper_bound(lane.begin(), lane.end(), along, [](double value, const Segment& segment) {
+        return value < segment.from;
+    });
+    if (it == lane.begin() || std::prev(it)->to < along) {
+        return nullptr;
+    }
+    return &*std::prev(it);
+}
+
+size_t RoadGraph::Axis::GetLane(double across) const {
+    const auto it = std::lower_bound(bounds_.begin(), bounds_.end(), across);
+    const auto index = static_cast<size_t>(it - bounds_.begin());
+    return (it != bounds_.end() && *it == across) ? index * 2 + 1 : index * 2;
+}
+
 void Map::AddOffice(Office office) {
     if (warehouse_id_to_index_.contains(office.GetId())) {
         throw std::invalid_argument("Duplicate warehouse");
@@ -115,6 +494,9 @@ void Map::AddOffice(Office office) {
 }
 
 void Game::AddMap(Map map) {
+    if (!map.IsRoadGraphBuilt()) {
+        map.BuildRoadGraph();
+    }
     const size_t index = maps_.size();
     if (auto [it, inserted] = map_id_to_index_.emplace(map.GetId(), index); !inserted) {
         throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
@@ -4,11 +4,14 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <atomic>
 #include <random>
 #include <memory>
 #include <optional>
 
 #include "loot_generator.h"
+#include "mpsc_queue.h"
+#include "slot_map.h"
 #include "tagged.h"
 
 namespace model {
@@ -82,7 +85,15 @@ struct GatheringEvent {
     GatheringEvent(size_t g, size_t i, double d, double r) : item_id(g), gatherer_id(i), sq_distance(d), time(r) {}
 };
 
-std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider);
+// Способ поиска пар собиратель-предмет. GRID отбирает кандидатов по сетке
+// и находит те же события в том же порядке, что и полный перебор
+enum class GatherAlgorithm {
+    BRUTE_FORCE,
+    GRID
+};
+
+std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider,
+                                             GatherAlgorithm algorithm = GatherAlgorithm::BRUTE_FORCE);
 
 struct LootType {
     std::string name;
@@ -96,6 +107,13 @@ struct LostObject {
     int value = 0;
 };
 
+enum class Direction {
+    NORTH,
+    SOUTH,
+    WEST,
+    EAST
+};
+
 class Road {
     struct HorizontalTag {
         explicit HorizontalTag() = default;
@@ -109,6 +127,9 @@ public:
     constexpr static HorizontalTag HORIZONTAL{};
     constexpr static VerticalTag VERTICAL{};
 
+    // Половина ширины дороги
+    constexpr static double HALF_WIDTH = 0.4;
+
     Road(HorizontalTag, Point start, Coord end_x) noexcept
         : start_{start}
         , end_{end_x, start.y} {
@@ -135,9 +156,19 @@ public:
         return end_;
     }
 
+    // Попадает ли точка на дорогу с учётом её ширины
+    bool Contains(double x, double y) const noexcept {
+        return x >= std::min(start_.x, end_.x) - HALF_WIDTH && x <= std::max(start_.x, end_.x) + HALF_WIDTH
+            && y >= std::min(start_.y, end_.y) - HALF_WIDTH && y <= std::max(start_.y, end_.y) + HALF_WIDTH;
+    }
+
     Position GetRandomPoint() const {
         static thread_local std::mt19937 gen(std::random_device{}());
+        return GetRandomPoint(gen);
+    }
 
+    template <typename Generator>
+    Position GetRandomPoint(Generator& gen) const {
         if (IsHorizontal()) {
             std::uniform_real_distribution<double> dist(
                 std::min(start_.x, end_.x),
@@ -200,6 +231,74 @@ private:
     Offset offset_;
 };
 
+/*
+ * Равномерная сетка по дорогам карты. В каждой ячейке хранятся индексы дорог,
+ * чьи границы (с учётом ширины) задевают эту ячейку. Дороги добавляются
+ * в порядке их индексов, поэтому в каждой ячейке индексы идут по возрастанию.
+ */
+class RoadIndex {
+public:
+    using RoadIds = std::vector<size_t>;
+
+    static constexpr double CELL_SIZE = 8.0;
+
+    void AddRoad(const Road& road, size_t road_id);
+
+    // Индексы дорог, на которых может лежать точка (x, y)
+    const RoadIds& GetRoadsNear(double x, double y) const;
+
+private:
+    std::unordered_map<std::uint64_t, RoadIds> cells_;
+};
+
+/*
+ * Связность дорог для ограничения движения собак.
+ * Поперечная координата разбита на полосы: в пределах полосы одни и те же дороги
+ * накрывают точку. Для каждой полосы пересекающиеся и примыкающие отрезки дорог
+ * слиты в один, поэтому самая дальняя достижимая точка в направлении движения —
+ * это край слитого отрезка, содержащего текущую позицию.
+ */
+class RoadGraph {
+public:
+    void Build(const std::vector<Road>& roads);
+
+    // Самая дальняя точка, до которой можно дойти по дорогам из pos в направлении dir.
+    // Если pos не лежит на дороге, возвращается pos
+    Position GetReachableEdge(Position pos, Direction dir) const;
+
+    // Сколько дорог было у карты, когда граф строился
+    size_t GetRoadCount() const noexcept {
+        return road_count_;
+    }
+
+private:
+    struct Segment {
+        double from;
+        double to;
+    };
+
+    class Axis {
+    public:
+        // Отрезок дороги задаётся поперечными и продольными границами с учётом ширины
+        void Build(const std::vector<std::pair<Segment, Segment>>& roads);
+        const Segment* FindSegment(double across, double along) const;
+
+    private:
+        size_t GetLane(double across) const;
+
+        // Отсортированные границы полос; полоса 2i+1 — ровно bounds_[i],
+        // полоса 2i — интервал между bounds_[i-1] и bounds_[i]
+        std::vector<double> bounds_;
+        std::vector<std::vector<Segment>> lanes_;
+    };
+
+    // Движение вдоль оси Y, полосы по X
+    Axis vertical_;
+    // Движение вдоль оси X, полосы по Y
+    Axis horizontal_;
+    size_t road_count_ = 0;
+};
+
 class Map {
 public:
     using Id = util::Tagged<std::string, Map>;
@@ -233,8 +332,31 @@ public:
         return offices_;
     }
 
+    const RoadIndex& GetRoadIndex() const noexcept {
+        return road_index_;
+    }
+
+    // Граф без дорог, добавленных после BuildRoadGraph, останавливал бы собак посреди дороги
+    const RoadGraph& GetRoadGraph() const noexcept {
+        assert(IsRoadGraphBuilt() && "BuildRoadGraph() must be called after the last AddRoad()");
+        return road_graph_;
+    }
+
+    bool IsRoadGraphBuilt() const noexcept {
+        return road_graph_.GetRoadCount() == roads_.size();
+    }
+
+    /*
+     * Вызывается после добавления всех дорог. Game::AddMap строит граф сам,
+     * вручную это нужно только для карты, которая используется без Game
+     */
+    void BuildRoadGraph() {
+        road_graph_.Build(roads_);
+    }
+
     void AddRoad(const Road& road) {
         roads_.emplace_back(road);
+        road_index_.AddRoad(road, roads_.size() - 1);
     }
 
     void AddBuilding(const Building& building) {
@@ -285,12 +407,23 @@ public:
         return 0;
     }
 
+    // Если задан, /game/state по умолчанию отдаёт только объекты в этом радиусе от собаки игрока
+    void SetStateRadius(std::optional<double> radius) noexcept {
+        state_radius_ = radius;
+    }
+
+    std::optional<double> GetStateRadius() const noexcept {
+        return state_radius_;
+    }
+
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
 
     Id id_;
     std::string name_;
     Roads roads_;
+    RoadIndex road_index_;
+    RoadGraph road_graph_;
     Buildings buildings_;
     OfficeIdToIndex warehouse_id_to_index_;
     Offices offices_;
@@ -299,21 +432,19 @@ private:
     std::optional<loot_gen::LootGenerator> generator_;
     int loot_count_ = 0;
     int bag_capacity_ = 3;
-};
-
-enum class Direction {
-    NORTH,
-    SOUTH,
-    WEST,
-    EAST
+    std::optional<double> state_radius_;
 };
 
 
 std::string GetDirAsStr(Direction dir) noexcept;
 Direction GetDirFromStr(const std::string& dir) noexcept;
 
-class Dog {
-public:
+/*
+ * Горячие данные собак сессии — то, что каждый тик читают перемещение и сбор предметов.
+ * Хранятся по столбцам, чтобы тик проходил по памяти подряд. Собака с индексом i
+ * занимает i-й элемент каждого столбца
+ */
+struct DogsHotData {
     struct Coordinate {
         double x;
         double y;
@@ -324,22 +455,66 @@ public:
         double y;
     };
 
+    size_t Add(Coordinate coord, Speed speed) {
+        coords.push_back(coord);
+        speeds.push_back(speed);
+        prev_positions.push_back(Position{0.0, 0.0});
+        dirs.push_back(Direction::NORTH);
+        return coords.size() - 1;
+    }
+
+    size_t Size() const noexcept {
+        return coords.size();
+    }
+
+    void Clear() noexcept {
+        coords.clear();
+        speeds.clear();
+        prev_positions.clear();
+        dirs.clear();
+    }
+
+    std::vector<Coordinate> coords;
+    std::vector<Speed> speeds;
+    std::vector<Position> prev_positions;
+    std::vector<Direction> dirs;
+};
+
+/*
+ * Собака хранит холодные данные (имя, рюкзак, счёт), а координаты, скорость
+ * и направление берёт из столбцов своей сессии. Адрес собаки не меняется,
+ * поэтому указатель на неё можно хранить в Player
+ */
+class Dog {
+public:
+    using Coordinate = DogsHotData::Coordinate;
+    using Speed = DogsHotData::Speed;
+
     static constexpr Coordinate DEFAULT_POSITION = Coordinate{0.0, 0.0};
     static constexpr Speed DEFAULT_SPEED = Speed{0.0, 0.0};
 
-    Dog(std::uint64_t token, std::string nickname, Coordinate coord = DEFAULT_POSITION, Speed speed = DEFAULT_SPEED)
-        : token_(token), nickname_(std::move(nickname)), coord_(coord), speed_(speed) {}
+    Dog(DogsHotData& hot, std::uint64_t token, std::string nickname,
+        Coordinate coord = DEFAULT_POSITION, Speed speed = DEFAULT_SPEED)
+        : hot_(&hot), index_(hot.Add(coord, speed)), token_(token), nickname_(std::move(nickname)) {}
+
+    Dog(const Dog&) = delete;
+    Dog& operator=(const Dog&) = delete;
 
     std::uint64_t GetToken() const noexcept {
         return token_;
     }
 
+    // Индекс собаки в столбцах горячих данных сессии
+    size_t GetIndex() const noexcept {
+        return index_;
+    }
+
     const std::string& GetNickname() const noexcept {
         return nickname_;
     }
 
     Direction GetDir() const noexcept {
-        return dir_;
+        return hot_->dirs[index_];
     }
 
     char GetDirAsChar() const noexcept {
@@ -371,23 +546,23 @@ public:
     }
 
     Coordinate GetCoord() const noexcept {
-        return coord_;
+        return hot_->coords[index_];
     }
 
     Speed GetSpeed() const noexcept {
-        return speed_;
+        return hot_->speeds[index_];
     }
 
     void SetSpeed(Speed speed) {
-        speed_ = speed;
+        hot_->speeds[index_] = speed;
     }
 
     void SetDir(Direction dir) {
-        dir_ = dir;
+        hot_->dirs[index_] = dir;
     }
 
     void SetCoord(Coordinate coord) {
-        coord_ = coord;
+        hot_->coords[index_] = coord;
     }
 
     const std::vector<LostObject>& GetBag() const { 
@@ -413,11 +588,11 @@ public:
     }
         
     void SetPrevPosition(const Position& pos) { 
-        prev_position_ = pos; 
+        hot_->prev_positions[index_] = pos; 
     }
 
     Position GetPrevPosition() const { 
-        return prev_position_; 
+        return hot_->prev_positions[index_]; 
     }
 
     int GetScore() const { 
@@ -433,22 +608,170 @@ public:
     }
 
 private:
+    DogsHotData* hot_;
+    size_t index_;
     std::uint64_t token_;
     std::string nickname_;
-    Coordinate coord_ {0.0, 0.0};
-    Direction dir_ = Direction::NORTH;
-    Speed speed_ {0.0, 0.0};
     std::vector<LostObject> bag_;
     int bag_capacity_ = 3;
-    Position prev_position_ {0.0, 0.0};
     int score_ = 0;
 };
 
+/*
+ * Сетка объектов сессии для выборки по расстоянию. Обновляется по ходу тика:
+ * объект перекладывается в другую ячейку, только когда пересекает её границу
+ */
+class SpatialGrid {
+public:
+    using Ids = std::vector<std::uint64_t>;
+    using Cells = std::unordered_map<std::uint64_t, Ids>;
+
+    explicit SpatialGrid(double cell_size) noexcept
+        : cell_size_(cell_size) {}
+
+    static std::int64_t GetCellIndex(double coord, double cell_size) noexcept;
+    static std::uint64_t MakeCellKey(std::int64_t cell_x, std::int64_t cell_y) noexcept;
+
+    // Добавляет объект или переносит его в ячейку новой позиции
+    void Update(std::uint64_t id, Position pos);
+    void Erase(std::uint64_t id);
+    void Clear() noexcept;
+
+    double GetCellSize() const noexcept {
+        return cell_size_;
+    }
+
+    // Только непустые ячейки
+    const Cells& GetCells() const noexcept {
+        return cells_;
+    }
+
+private:
+    std::uint64_t GetCellKey(Position pos) const noexcept {
+        return MakeCellKey(GetCellIndex(pos.x, cell_size_), GetCellIndex(pos.y, cell_size_));
+    }
+
+    void EraseFromCell(std::uint64_t id, std::uint64_t key);
+
+    double cell_size_;
+    Cells cells_;
+    std::unordered_map<std::uint64_t, std::uint64_t> id_to_cell_;
+};
+
+/*
+ * Состояние сессии, разложенное по ячейкам сетки. JSON каждой собаки и каждого
+ * трофея лежит отдельным отрезком fragments, поэтому ответ только с объектами
+ * рядом с игроком собирается копированием, без повторной сериализации
+ */
+struct SpatialState {
+    struct Entity {
+        Position pos;
+        // Отрезок fragments
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Отрезок entities слоя с объектами одной ячейки
+    struct Cell {
+        std::uint64_t key = 0;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    struct Layer {
+        std::vector<Entity> entities;
+        // Упорядочены по key
+        std::vector<Cell> cells;
+    };
+
+    double cell_size = 0.0;
+    std::string fragments;
+    Layer dogs;
+    Layer loots;
+    // Номер собаки в dogs.entities по её индексу в сессии
+    std::vector<size_t> dog_entities;
+};
+
+/*
+ * Помнит хэши объектов прошлой публикации, чтобы находить появившиеся,
+ * изменившиеся и пропавшие. Сначала Update вызывается для каждого объекта
+ * публикации, затем TakeRemoved
+ */
+class ChangeTracker {
+public:
+    // Возвращает true, если объекта не было или его хэш изменился
+    bool Update(std::uint64_t id, std::uint64_t hash);
+    // id объектов прошлой публикации, которых нет в текущей
+    std::vector<std::uint64_t> TakeRemoved();
+
+private:
+    struct Entry {
+        std::uint64_t hash = 0;
+        std::uint64_t generation = 0;
+    };
+
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    std::uint64_t generation_ = 1;
+};
+
+// Изменения состояния сессии за одну публикацию
+struct StateDelta {
+    // Пара "id": {...} из ответа /game/state, отрезок fragments
+    struct Change {
+        std::uint64_t id = 0;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::uint64_t tick = 0;
+    std::string fragments;
+    std::vector<Change> dogs;
+    std::vector<Change> loots;
+    std::vector<std::uint64_t> removed_dogs;
+    std::vector<std::uint64_t> removed_loots;
+};
+
+// Последние записи журнала вместе с полным состоянием той же публикации
+struct StateJournal {
+    std::uint64_t tick = 0;
+    std::shared_ptr<const std::string> state;
+    // По возрастанию tick, последняя запись относится к tick
+    std::vector<std::shared_ptr<const StateDelta>> deltas;
+};
+
 class GameSession {
 public:
     using Loots = std::vector<loot_gen::LootGenerator>;
+    using LostObjects = util::SlotMap<LostObject>;
+
+    // Команда игрока. Без направления собака останавливается
+    struct DogAction {
+        size_t dog_index = 0;
+        std::optional<Direction> dir;
+    };
+
+    constexpr static size_t ACTION_QUEUE_CAPACITY = 4096;
+
+    // Готовое к отдаче состояние сессии
+    using StateSnapshot = std::shared_ptr<const std::string>;
+    using SpatialSnapshot = std::shared_ptr<const SpatialState>;
+    using JournalSnapshot = std::shared_ptr<const StateJournal>;
+
+    // Сколько последних публикаций помнит журнал изменений
+    constexpr static size_t JOURNAL_CAPACITY = 64;
+
+    // Размер ячейки сетки, по которой ищутся объекты рядом с игроком
+    constexpr static double INTEREST_CELL_SIZE = 10.0;
 
-    explicit GameSession(const Map* map) : map_(map), loot_generator_(map->GetLootGenerator()) {}
+    // Если задан random_seed, трофеи сессии появляются в одних и тех же местах
+    // при одинаковой последовательности тиков
+    explicit GameSession(const Map* map, GatherAlgorithm gather_algorithm = GatherAlgorithm::GRID,
+                         std::optional<std::uint64_t> random_seed = std::nullopt)
+        : map_(map)
+        , loot_generator_(map->GetLootGenerator())
+        , gather_algorithm_(gather_algorithm)
+        , random_engine_(MakeRandomEngine(map, random_seed))
+        , actions_(ACTION_QUEUE_CAPACITY) {}
 
     GameSession(const GameSession&) = delete;
     GameSession& operator=(const GameSession&) = delete;
@@ -456,6 +779,7 @@ public:
     Dog* CreateDog(const std::string& name, bool spawn = false) {
         auto dog = dogs_.emplace_back(
             std::make_unique<Dog>(
+                hot_,
                 dogs_.size(),
                 name,
                 GenerateNewPosition(spawn) 
@@ -463,6 +787,8 @@ public:
         ).get();
 
         dogs_id_[dog->GetToken()] = dog;
+        const auto coord = dog->GetCoord();
+        dog_grid_.Update(dog->GetIndex(), Position{coord.x, coord.y});
         return dog;
     }
 
@@ -520,16 +846,133 @@ public:
 
     Dog* FindDogByToken(std::uint64_t token) const noexcept;
 
-    void RestoreLostObjects(std::unordered_map<int, LostObject> loots, int next_loot_id);
+    // Перемещает все собаки сессии, проходя по столбцам горячих данных
+    void MoveDogs(std::chrono::milliseconds time);
+    void MoveDog(const Dog& dog, std::chrono::milliseconds time);
+
+    void RestoreLostObjects(const std::vector<LostObject>& loots, int next_loot_id);
+
+    // Меняет направление и скорость собаки сразу
+    void ChangeDogDir(size_t dog_index, std::optional<Direction> dir);
+
+    /*
+     * Ставит команду в очередь сессии. Можно вызывать из любого потока.
+     * Если очередь заполнена, команда отбрасывается и возвращается false
+     */
+    bool PushAction(DogAction action) {
+        if (actions_.TryPush(action)) {
+            return true;
+        }
+        dropped_actions_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Применяет накопившиеся команды в порядке поступления.
+    // Вызовы не должны пересекаться друг с другом и с тиком сессии
+    void ApplyActions();
+
+    // Снимок подменяется атомарно: читатели в других потоках получают либо старый, либо новый
+    void PublishSnapshot(StateSnapshot snapshot) noexcept {
+        std::atomic_store_explicit(&snapshot_, std::move(snapshot), std::memory_order_release);
+    }
+
+    StateSnapshot GetSnapshot() const noexcept {
+        return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+    }
+
+    /*
+     * Публикует полное состояние вместе с его изменениями относительно прошлой публикации.
+     * Номер публикации (тик состояния) присваивается записи здесь
+     */
+    void PublishSnapshot(StateSnapshot snapshot, std::shared_ptr<StateDelta> delta);
+
+    JournalSnapshot GetJournal() const noexcept {
+        return std::atomic_load_explicit(&journal_, std::memory_order_acquire);
+    }
+
+    // Трекеры изменений собак (по токену) и трофеев (по id). Меняет только публикующий поток
+    ChangeTracker& GetDogChanges() noexcept {
+        return dog_changes_;
+    }
+
+    ChangeTracker& GetLootChanges() noexcept {
+        return loot_changes_;
+    }
+
+    void PublishSpatialState(SpatialSnapshot state) noexcept {
+        std::atomic_store_explicit(&spatial_state_, std::move(state), std::memory_order_release);
+    }
+
+    SpatialSnapshot GetSpatialState() const noexcept {
+        return std::atomic_load_explicit(&spatial_state_, std::memory_order_acquire);
+    }
+
+    // Просит публиковать разложенное по сетке состояние, даже если карта этого не требует
+    void RequestSpatialState() noexcept {
+        spatial_state_requested_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsSpatialStateNeeded() const noexcept {
+        return map_->GetStateRadius().has_value() || spatial_state_requested_.load(std::memory_order_relaxed);
+    }
+
+    // Состояние в CBOR публикуется рядом с JSON, только если его хоть раз запросили
+    void PublishCborSnapshot(StateSnapshot snapshot) noexcept {
+        std::atomic_store_explicit(&cbor_snapshot_, std::move(snapshot), std::memory_order_release);
+    }
+
+    StateSnapshot GetCborSnapshot() const noexcept {
+        return std::atomic_load_explicit(&cbor_snapshot_, std::memory_order_acquire);
+    }
+
+    void RequestCborSnapshot() noexcept {
+        cbor_snapshot_requested_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCborSnapshotNeeded() const noexcept {
+        return cbor_snapshot_requested_.load(std::memory_order_relaxed);
+    }
+
+    // Сетки собак (по индексу) и трофеев (по id). Положение собаки обновляет её перемещение
+    const SpatialGrid& GetDogGrid() const noexcept {
+        return dog_grid_;
+    }
+
+    const SpatialGrid& GetLootGrid() const noexcept {
+        return loot_grid_;
+    }
+
+    const Dog& GetDogByIndex(size_t index) const {
+        return *dogs_.at(index);
+    }
+
+    const LostObject* FindLoot(std::uint64_t id) const noexcept {
+        if (auto it = loot_handles_.find(id); it != loot_handles_.end()) {
+            return loots_.Find(it->second);
+        }
+        return nullptr;
+    }
+
+    size_t GetActionQueueDepth() const noexcept {
+        return actions_.Size();
+    }
+
+    std::uint64_t GetDroppedActionCount() const noexcept {
+        return dropped_actions_.load(std::memory_order_relaxed);
+    }
 
     void ClearState();
 
     int GetNextLootId() const noexcept { return next_loot_id_; }
 
+    void SetGatherAlgorithm(GatherAlgorithm algorithm) noexcept {
+        gather_algorithm_ = algorithm;
+    }
+
     void AddRandomLoot(std::chrono::milliseconds dt) {
         if (!map_) return;
 
-        unsigned loot_count = loots_.size();
+        unsigned loot_count = loots_.Size();
         unsigned looter_count = dogs_.size();
         unsigned new_loot = loot_generator_.Generate(dt, loot_count, looter_count);
 
@@ -538,11 +981,11 @@ public:
         }
     }
 
-    const std::unordered_map<int, LostObject>& GetLoots() const {
+    const LostObjects& GetLoots() const {
         return loots_;
     }
 
-    const std::unordered_map<int, LostObject>& GetLostObjects() const {
+    const LostObjects& GetLostObjects() const {
         return loots_;
     }
 
@@ -550,20 +993,19 @@ void HandleCollisions(std::chrono::milliseconds delta) {
     std::vector<Gatherer> gatherers;
     std::vector<Item> items;
     std::vector<Item> offices;
+    gatherers.reserve(hot_.Size());
+    items.reserve(loots_.Size());
+    offices.reserve(map_->GetOffices().size());
 
-    for (const auto& dog_ptr : dogs_) {
+    for (size_t i = 0; i < hot_.Size(); ++i) {
         Gatherer g;
-        auto dog = dog_ptr.get();
-        auto start_pos = dog->GetPrevPosition();
-        auto end_pos = Position{dog->GetCoord().x, dog->GetCoord().y};
-            
-        g.start_pos = start_pos;
-        g.end_pos = end_pos;
+        g.start_pos = hot_.prev_positions[i];
+        g.end_pos = Position{hot_.coords[i].x, hot_.coords[i].y};
         g.width = 0.3; 
         gatherers.push_back(g);
     }
 
-    for (const auto& [id, loot] : loots_) {
+    for (const auto& loot : loots_) {
         Item item;
         item.position = loot.position;  // было: loot.pos
         item.width = 0.0; 
@@ -613,22 +1055,22 @@ void HandleCollisions(std::chrono::milliseconds delta) {
     };
 
     CombinedProvider provider(items, offices, gatherers);
-    auto events = FindGatherEvents(provider);
+    auto events = FindGatherEvents(provider, gather_algorithm_);
 
-    std::vector<int> items_to_remove;
+    std::vector<std::uint64_t> items_to_remove;
     std::vector<size_t> players_to_clear;
+    std::vector<bool> collected(items.size());
 
     for (const auto& event : events) {
         auto& dog = dogs_[event.gatherer_id];
         
         if (event.item_id < items.size()) {
-            auto loot_id = std::next(loots_.begin(), event.item_id)->first;
-            auto loot_iter = loots_.find(loot_id);
-            
-            if (loot_iter != loots_.end() && 
-                dog->GetBag().size() < dog->GetBagCapacity()) {
-                dog->AddToBag(loot_iter->second);
-                items_to_remove.push_back(loot_iter->first);
+            // Индекс события совпадает с позицией трофея в плотном массиве
+            if (!collected[event.item_id] && dog->GetBag().size() < dog->GetBagCapacity()) {
+                const auto& loot = loots_[event.item_id];
+                dog->AddToBag(loot);
+                collected[event.item_id] = true;
+                items_to_remove.push_back(loot.id);
             }
         } else {
             int total_score = 0;
@@ -642,8 +1084,8 @@ void HandleCollisions(std::chrono::milliseconds delta) {
         }
     }
 
-    for (int id : items_to_remove) {
-        loots_.erase(id);
+    for (auto id : items_to_remove) {
+        RemoveLoot(id);
     }
 
     for (size_t player_id : players_to_clear) {
@@ -659,30 +1101,69 @@ private:
         loot.type = GenerateRandomLootType();
         loot.position = GenerateRandomPositionOnRoad();
         loot.value = map_->GetLootValue(loot.type);
-        loots_.emplace(loot.id, loot);
+        AddLoot(loot);
+    }
+
+    void AddLoot(const LostObject& loot) {
+        loot_handles_[loot.id] = loots_.Insert(loot);
+        loot_grid_.Update(loot.id, loot.position);
+    }
+
+    void RemoveLoot(std::uint64_t id) {
+        if (auto it = loot_handles_.find(id); it != loot_handles_.end()) {
+            loots_.Erase(it->second);
+            loot_handles_.erase(it);
+            loot_grid_.Erase(id);
+        }
     }
 
     int GenerateRandomLootType() {
-        static thread_local std::mt19937 gen(std::random_device{}());
         std::uniform_int_distribution<int> dist(0, map_->GetLootTypeCount() - 1);
-        return dist(gen);
+        return dist(random_engine_);
     }
 
     Position GenerateRandomPositionOnRoad() {
         const auto& roads = map_->GetRoads();
-        static thread_local std::mt19937 gen(std::random_device{}());
         std::uniform_int_distribution<size_t> road_dist(0, roads.size() - 1);
 
-        const Road& r = roads[road_dist(gen)];
-        return r.GetRandomPoint();
+        const Road& r = roads[road_dist(random_engine_)];
+        return r.GetRandomPoint(random_engine_);
+    }
+
+    static std::mt19937 MakeRandomEngine(const Map* map, std::optional<std::uint64_t> seed) {
+        if (!seed) {
+            return std::mt19937{std::random_device{}()};
+        }
+        // Своя последовательность для каждой карты, не зависящая от порядка создания сессий
+        std::seed_seq seq{static_cast<std::uint32_t>(*seed), static_cast<std::uint32_t>(*seed >> 32),
+                          static_cast<std::uint32_t>(std::hash<std::string>{}(*map->GetId()))};
+        return std::mt19937{seq};
     }
 
+    void MoveDogByIndex(size_t index, double time_s);
+
+    DogsHotData hot_;
     std::vector<std::unique_ptr<Dog>> dogs_;
     std::unordered_map<std::uint64_t, Dog*> dogs_id_;
-    std::unordered_map<int, LostObject> loots_;
+    LostObjects loots_;
+    std::unordered_map<std::uint64_t, LostObjects::Handle> loot_handles_;
     const Map* map_;
     int next_loot_id_ = 0;
     loot_gen::LootGenerator loot_generator_;
+    GatherAlgorithm gather_algorithm_;
+    std::mt19937 random_engine_;
+    util::MpscQueue<DogAction> actions_;
+    std::atomic<std::uint64_t> dropped_actions_{0};
+    SpatialGrid dog_grid_{INTEREST_CELL_SIZE};
+    SpatialGrid loot_grid_{INTEREST_CELL_SIZE};
+    StateSnapshot snapshot_;
+    ChangeTracker dog_changes_;
+    ChangeTracker loot_changes_;
+    JournalSnapshot journal_;
+    SpatialSnapshot spatial_state_;
+    std::atomic<bool> spatial_state_requested_{false};
+    StateSnapshot cbor_snapshot_;
+    std::atomic<bool> cbor_snapshot_requested_{false};
 };
 
 class Game {
@@ -706,7 +1187,19 @@ public:
     }
 
     GameSession* CreateSession(const Map* map) {
-        return sessions_.emplace_back(std::make_unique<GameSession>(map)).get();
+        return sessions_.emplace_back(std::make_unique<GameSession>(map, gather_algorithm_, random_seed_)).get();
+    }
+
+    // Действует на сессии, созданные после вызова
+    void SetRandomSeed(std::optional<std::uint64_t> seed) noexcept {
+        random_seed_ = seed;
+    }
+
+    void SetGatherAlgorithm(GatherAlgorithm algorithm) {
+        gather_algorithm_ = algorithm;
+        for (auto& session : sessions_) {
+            session->SetGatherAlgorithm(algorithm);
+        }
     }
 
     GameSession* FindSession(const Map* map) const {
@@ -742,6 +1235,8 @@ private:
     MapIdToIndex map_id_to_index_;
     Sessions sessions_;
     double speed_;
+    GatherAlgorithm gather_algorithm_ = GatherAlgorithm::GRID;
+    std::optional<std::uint64_t> random_seed_;
 };
 
 
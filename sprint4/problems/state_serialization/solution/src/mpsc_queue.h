@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace util {
+
+/**
+ * Ограниченная очередь без блокировок: много писателей, один читатель.
+ * Кольцевой буфер, каждая ячейка хранит номер последовательности,
+ * по которому писатель понимает, свободна ли ячейка, а читатель — записана ли она.
+ * Ёмкость — степень двойки. Если очередь заполнена, TryPush возвращает false.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity)
+        : cells_(std::make_unique<Cell[]>(capacity))
+        , mask_(capacity - 1) {
+        assert(capacity >= 2 && (capacity & mask_) == 0);
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Можно вызывать из любого потока
+    bool TryPush(T value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Вызывает только один поток-читатель
+    std::optional<T> TryPop() {
+        const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+        const size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1) < 0) {
+            return std::nullopt;
+        }
+        std::optional<T> value{std::move(cell.value)};
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        return value;
+    }
+
+    // Приблизительное число элементов: писатели могут менять его одновременно
+    size_t Size() const noexcept {
+        const size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+        const size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t Capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+}  // namespace util
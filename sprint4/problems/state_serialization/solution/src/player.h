@@ -4,20 +4,21 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <mutex>
 #include <random>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
 #include <optional>
-#include <unordered_set>
 
 namespace player {
     using namespace model;
 
     class Player {
     public:
-        static constexpr double HALF_WIDTH = 0.4;
+        static constexpr double HALF_WIDTH = Road::HALF_WIDTH;
 
         Player(GameSession* game, Dog* dog) : game_(game), dog_(dog) {}
 
@@ -34,125 +35,20 @@ namespace player {
         }
 
         void ChangeDir(std::optional<model::Direction> dir) {
-            model::Dog::Speed dog_speed{0.0, 0.0};
-            if (!dir) {
-                dog_speed = model::Dog::Speed{0.0, 0.0};
-            } else {
-                double speed = game_->GetMap()->GetSpeed(); 
-                switch (*dir) {
-                    case model::Direction::NORTH:
-                        dog_speed = model::Dog::Speed{0.0, -speed};
-                        break;
-                    case model::Direction::SOUTH:
-                        dog_speed = model::Dog::Speed{0.0, speed};
-                        break;
-                    case model::Direction::WEST:
-                        dog_speed = model::Dog::Speed{-speed, 0.0};
-                        break;
-                    case model::Direction::EAST:
-                        dog_speed = model::Dog::Speed{speed, 0.0};
-                        break;
-                }
-                dog_->SetDir(*dir);
-            }
-            dog_->SetSpeed(dog_speed);
+            game_->ChangeDogDir(dog_->GetIndex(), dir);
         }
 
-
         void SetSpeed(Dog::Speed speed) {
             dog_->SetSpeed(speed);
         }
 
         void Move(std::chrono::milliseconds time) {
-            auto speed = dog_->GetSpeed();
-            if (speed.x == 0.0 && speed.y == 0.0) {
-                return;
-            }
-
-            dog_->SetPrevPosition(Position{static_cast<double>(dog_->GetCoord().x),static_cast<double>(dog_->GetCoord().y)});
-
-            auto time_s_d = std::chrono::duration<double>(time).count();
-            auto current_pos = dog_->GetCoord();
-            auto next_pos = model::Dog::Coordinate{current_pos.x + (speed.x * time_s_d), current_pos.y + (speed.y * time_s_d)};
-
-            const auto& roads = game_->GetMap()->GetRoads();
-            
-            auto road_it = std::find_if(roads.begin(), roads.end(), [&next_pos](const model::Road& road){
-                model::Dog::Coordinate min_road_pos{std::min(road.GetStart().x, road.GetEnd().x) - HALF_WIDTH, 
-                                        std::min(road.GetStart().y, road.GetEnd().y) - HALF_WIDTH};
-                model::Dog::Coordinate max_road_pos{std::max(road.GetStart().x, road.GetEnd().x) + HALF_WIDTH, 
-                                        std::max(road.GetStart().y, road.GetEnd().y) + HALF_WIDTH};
-                return (next_pos.x >= min_road_pos.x && next_pos.x <= max_road_pos.x
-                        && next_pos.y >= min_road_pos.y && next_pos.y <= max_road_pos.y);
-            });
-            if (road_it != roads.end()) {
-                dog_->SetCoord(next_pos);
-                return;
-            }
-
-            next_pos = current_pos;
-            bool next_pos_on_road = true;
-            std::unordered_set<size_t> viewed_road;
-            while (next_pos_on_road) {
-                int64_t roadIndex = FindRoadIndex(next_pos, viewed_road);
-                if (roadIndex == -1) {
-                    break;
-                }
-
-                const auto& road = roads.at(roadIndex);
-                switch (dog_->GetDir())
-                {
-                case model::Direction::NORTH: {
-                    next_pos.y = std::min(road.GetStart().y, road.GetEnd().y);
-                    next_pos.y -= 0.4;
-                    break;
-                }
-                case model::Direction::SOUTH: {
-                    next_pos.y = std::max(road.GetStart().y, road.GetEnd().y);
-                    next_pos.y += 0.4;
-                    break;
-                }
-                case model::Direction::WEST: {
-                    next_pos.x = std::min(road.GetStart().x, road.GetEnd().x);
-                    next_pos.x -= 0.4;
-                    break;
-                }
-                case model::Direction::EAST: {
-                    next_pos.x = std::max(road.GetStart().x, road.GetEnd().x);
-                    next_pos.x += 0.4;
-                    break;
-                }
-                }
-            }
-            dog_->SetSpeed(model::Dog::Speed{0.0, 0.0});
-            dog_->SetCoord(next_pos);
+            game_->MoveDog(*dog_, time);
         }
 
     private:
         GameSession* game_;
         Dog* dog_;
-
-        int64_t FindRoadIndex(model::Dog::Coordinate pos, std::unordered_set<size_t>& viewed_road) {
-            const auto& roads = game_->GetMap()->GetRoads();
-            for (size_t i = 0; i < roads.size(); ++i) {
-                if (viewed_road.count(i)) {
-                    continue;
-                }
-
-                const auto& road = roads.at(i);
-                model::Dog::Coordinate min_road_pos{std::min(road.GetStart().x, road.GetEnd().x) - 0.4, 
-                                        std::min(road.GetStart().y, road.GetEnd().y) - 0.4};
-                model::Dog::Coordinate max_road_pos{std::max(road.GetStart().x, road.GetEnd().x) + 0.4, 
-                                        std::max(road.GetStart().y, road.GetEnd().y) + 0.4};
-                if (pos.x >= min_road_pos.x && pos.x <= max_road_pos.x
-                    && pos.y >= min_road_pos.y && pos.y <= max_road_pos.y) {
-                    viewed_road.insert(i);
-                    return i;
-                }
-            }
-            
-            return -1;
-        }
     };
 
     class Players {
@@ -171,6 +67,7 @@ namespace player {
         Players& operator=(const Players&) = delete;
 
         std::pair<Player*, Token> Add(Dog* dog, GameSession* session) {
+            std::unique_lock lock{mutex_};
             Token token = GeneratePlayerToken();
             auto player_ptr = std::make_unique<Player>(session, dog);
             Player* player = player_ptr.get();
@@ -182,6 +79,7 @@ namespace player {
         }
 
         Player* AddWithToken(Dog* dog, GameSession* session, Token token) {
+            std::unique_lock lock{mutex_};
             if (player_token_.contains(token)) {
                 throw std::runtime_error("Duplicate player token");
             }
@@ -193,6 +91,7 @@ namespace player {
         }
 
         std::vector<SavedPlayer> GetSavedPlayers() const {
+            std::shared_lock lock{mutex_};
             std::vector<SavedPlayer> result;
             result.reserve(player_token_.size());
             for (const auto& [token, player] : player_token_) {
@@ -209,11 +108,13 @@ namespace player {
         }
 
         void Clear() {
+            std::unique_lock lock{mutex_};
             players_.clear();
             player_token_.clear();
         }
 
         Player* FindByDogIdAndMapId(uint64_t dog_id, Map::Id map_id) {
+            std::shared_lock lock{mutex_};
             auto it = std::find_if(players_.begin(), players_.end(), 
                 [dog_id, map_id](const auto& player) {
                     return player->GetDogId() == dog_id && 
@@ -223,19 +124,16 @@ namespace player {
             return (it != players_.end()) ? it->get() : nullptr;
         }
 
-        Player* FindByToken(const Token& token) {
-            if(player_token_.find(token) != player_token_.end()) {
-                return player_token_[token];
+        Player* FindByToken(const Token& token) const {
+            std::shared_lock lock{mutex_};
+            if (auto it = player_token_.find(token); it != player_token_.end()) {
+                return it->second;
             }
             return nullptr;
         }
 
-        void MovePlayers(std::chrono::milliseconds time) {
-            for (const auto& player : players_) {
-                player->Move(time);
-            }
-        }
     private:
+        mutable std::shared_mutex mutex_;
         std::vector<std::unique_ptr<Player>> players_;
         std::unordered_map<Token, Player*> player_token_;
 
@@ -1,19 +1,28 @@
 #pragma once
 
 #include "http_server.h"
+#include "access_log.h"
 #include "application.h"
+#include "cbor_writer.h"
+#include "compression.h"
 #include "json_serializer.h"
 #include "json_logger.h"
+#include "metrics.h"
+#include "router.h"
+#include "state_broadcaster.h"
+#include "static_cache.h"
 
 #include <boost/json.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/asio.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 #include <filesystem>
-#include <fstream>
-#include <sstream>
+#include <mutex>
+#include <unordered_map>
 #include <unordered_set>
-#include <regex>
 
 namespace http_handler {
 namespace beast = boost::beast;
@@ -22,61 +31,183 @@ namespace json = boost::json;
 namespace fs = std::filesystem;
 namespace net = boost::asio;
 
-struct ContentType {
-    constexpr static std::string_view TEXT_HTML = "text/html";
-    constexpr static std::string_view TEXT_CSS = "text/css";
-    constexpr static std::string_view TEXT_PLAIN = "text/plain";
-    constexpr static std::string_view TEXT_JAVASCRIPT = "text/javascript";
-    constexpr static std::string_view APPLICATION_JSON = "application/json";
-    constexpr static std::string_view APPLICATION_OCTET_STREAM = "application/octet-stream";
-
-    static std::string_view GetContentTypeByFileExtension(fs::path file_path) {
-        static const std::unordered_map<std::string, std::string_view> types = {
-            {".htm", TEXT_HTML}, {".html", TEXT_HTML},
-            {".css", TEXT_CSS}, {".txt", TEXT_PLAIN},
-            {".js", TEXT_JAVASCRIPT}, {".json", APPLICATION_JSON},
-            {".png", "image/png"}, {".jpg", "image/jpeg"}, {".jpeg", "image/jpeg"},
-            {".gif", "image/gif"}, {".bmp", "image/bmp"}
-        };
-
-        std::string ext = file_path.extension().string();
-        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
-        if (auto it = types.find(ext); it != types.end()) {
-            return it->second;
-        }
-        return APPLICATION_OCTET_STREAM;
-    }
-};
-
 class RequestHandler : public std::enable_shared_from_this<RequestHandler> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
 
-    explicit RequestHandler(Application& app, const std::string& data_path, Strand api_strand)
-        : app_{app}, data_path_{fs::weakly_canonical(data_path)}, api_strand_{api_strand} {}
+    static constexpr std::size_t DEFAULT_COMPRESSION_THRESHOLD = 1024;
+
+    /*
+     * Файлы статики до static_cache_threshold байт держатся в памяти, остальные отдаются с диска.
+     * Ответы API от compression_threshold байт сжимаются, если клиент принимает gzip или deflate
+     */
+    explicit RequestHandler(Application& app, const std::string& data_path, Strand api_strand,
+                            std::uintmax_t static_cache_threshold = StaticCache::DEFAULT_MAX_FILE_SIZE,
+                            std::size_t compression_threshold = DEFAULT_COMPRESSION_THRESHOLD)
+        : app_{app}
+        , data_path_{fs::weakly_canonical(data_path)}
+        , static_cache_{data_path_, static_cache_threshold}
+        , broadcaster_{api_strand.get_inner_executor()}
+        , compression_threshold_{compression_threshold}
+        , api_strand_{api_strand}
+        , route_metrics_{MakeRouteMetrics()}
+        , api_queue_delay_{GetQueueDelayHistogram("api")}
+        , session_queue_delay_{GetQueueDelayHistogram("session")} {}
 
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
 
+    StaticCache& GetStaticCache() noexcept {
+        return static_cache_;
+    }
+
+    StateBroadcaster& GetStateBroadcaster() noexcept {
+        return broadcaster_;
+    }
+
     template <typename Body, typename Allocator, typename Send>
     void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
         const std::string target = std::string(req.target());
 
         if (target.rfind("/api/", 0) != 0) {
-            return send(HandleStatic(req));
+            auto tracked_send = TrackRoute(STATIC_ROUTE, std::forward<Send>(send));
+            return HandleStatic(req, tracked_send);
         }
 
         HandleApiRequest(http::request<http::string_body>(std::move(req)),
-            [send = std::forward<Send>(send)](http::response<http::string_body>&& res) mutable {
+            [send = std::forward<Send>(send)](auto&& res) mutable {
                 send(std::move(res));
             }
         );
     }
 
+    // Запрос на переход к WebSocket. Принимается только на /api/v1/game/stream,
+    // остальные обрабатываются как обычные запросы
+    template <typename Send, typename Accept>
+    void operator()(const http::request<http::string_body>& req, Send&& send, Accept&& accept) {
+        const auto match = router::MatchApiRoute(req.method(), req.target());
+        if (match.status != router::RouteMatch::Status::FOUND || match.route->endpoint != router::Endpoint::STREAM) {
+            return (*this)(http::request<http::string_body>(req), std::forward<Send>(send));
+        }
+        const auto route = static_cast<size_t>(router::Endpoint::STREAM);
+        const auto start = std::chrono::steady_clock::now();
+        auto send_error = TrackRoute(route, std::forward<Send>(send));
+
+        // Браузер не даёт задать заголовки WebSocket, поэтому токен можно передать и в запросе
+        auto token = ExtractToken(req);
+        if (!token) {
+            auto param = router::GetQueryParam(req.target(), "token");
+            if (param && param->size() == router::TOKEN_SIZE
+                && std::all_of(param->begin(), param->end(), router::IsHexDigit)) {
+                token = std::string(*param);
+            }
+        }
+        if (!token) {
+            return send_error(MakeErrorResponse(http::status::unauthorized, "invalidToken", "Missing or invalid token"));
+        }
+        auto* session = app_.FindSession(*token);
+        if (!session) {
+            return send_error(MakeErrorResponse(http::status::unauthorized, "unknownToken", "Unknown token"));
+        }
+
+        RecordResponse(route, static_cast<unsigned>(http::status::switching_protocols), start);
+        accept([self = shared_from_this(), session](std::shared_ptr<http_server::WebSocketSession> ws) {
+            self->broadcaster_.Subscribe(*session, std::move(ws));
+        });
+    }
+
 private:
     Application& app_;
     fs::path data_path_;
+    StaticCache static_cache_;
+    StateBroadcaster broadcaster_;
+    std::size_t compression_threshold_;
+    // Сжатые снимки состояния, общие для всех игроков сессии
+    compression::SharedCache compressed_snapshots_;
+    // Вход в игру и тик, меняющие набор сессий
     Strand api_strand_;
+    // Запросы игроков выполняются на strand своей сессии
+    std::unordered_map<const model::GameSession*, Strand> session_strands_;
+    std::mutex session_strands_mutex_;
+
+    // Маршруты для метрик: эндпоинты API, статика и неизвестные пути API
+    static constexpr size_t STATIC_ROUTE = router::ENDPOINT_COUNT;
+    static constexpr size_t UNKNOWN_ROUTE = router::ENDPOINT_COUNT + 1;
+    static constexpr size_t ROUTE_COUNT = router::ENDPOINT_COUNT + 2;
+
+    struct RouteMetrics {
+        metrics::Histogram* latency = nullptr;
+        // Ответы по классам кодов 1xx–5xx
+        std::array<metrics::Counter*, 5> responses{};
+    };
+
+    std::array<RouteMetrics, ROUTE_COUNT> route_metrics_;
+    // Сколько задачи ждут своей очереди на strand
+    metrics::Histogram& api_queue_delay_;
+    metrics::Histogram& session_queue_delay_;
+
+    static std::array<RouteMetrics, ROUTE_COUNT> MakeRouteMetrics() {
+        auto& registry = metrics::Registry::GetInstance();
+        std::array<RouteMetrics, ROUTE_COUNT> result;
+        for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+            const std::string name = route == STATIC_ROUTE ? "static"
+                                   : route == UNKNOWN_ROUTE ? "unknown"
+                                   : std::string(router::GetEndpointName(static_cast<router::Endpoint>(route)));
+            result[route].latency = &registry.GetHistogram("http_request_duration_seconds",
+                                                           "Time from receiving a request to sending its response",
+                                                           {{"route", name}});
+            for (size_t code_class = 0; code_class < result[route].responses.size(); ++code_class) {
+                result[route].responses[code_class] = &registry.GetCounter(
+                    "http_responses_total", "Responses by route and status class",
+                    {{"route", name}, {"code", std::to_string(code_class + 1) + "xx"}});
+            }
+        }
+        return result;
+    }
+
+    static metrics::Histogram& GetQueueDelayHistogram(const std::string& strand) {
+        return metrics::Registry::GetInstance().GetHistogram(
+            "strand_queue_delay_seconds", "Time a request waits for its strand", {{"strand", strand}});
+    }
+
+    void RecordResponse(size_t route, unsigned status, std::chrono::steady_clock::time_point start) const {
+        const auto& route_metrics = route_metrics_[route];
+        route_metrics.latency->Record(std::chrono::steady_clock::now() - start);
+        const auto code_class = std::clamp(status / 100, 1u, 5u);
+        route_metrics.responses[code_class - 1]->Increment();
+    }
+
+    // Обёртка над send, которая учитывает ответ в метриках маршрута
+    template <typename Send>
+    auto TrackRoute(size_t route, Send&& send) const {
+        return [self = this, route, start = std::chrono::steady_clock::now(),
+                send = std::forward<Send>(send)](auto&& response) mutable {
+            self->RecordResponse(route, response.result_int(), start);
+            send(std::forward<decltype(response)>(response));
+        };
+    }
+
+    Strand GetSessionStrand(const model::GameSession* session) {
+        std::lock_guard lock{session_strands_mutex_};
+        auto it = session_strands_.find(session);
+        if (it == session_strands_.end()) {
+            it = session_strands_.emplace(session, net::make_strand(api_strand_.get_inner_executor())).first;
+        }
+        return it->second;
+    }
+
+    // Без сессии (нет или неизвестен токен) обработчик сразу формирует ответ с ошибкой
+    template <typename Handler>
+    void DispatchToSession(const http::request<http::string_body>& req, Handler&& handler) {
+        auto token = ExtractToken(req);
+        auto session = token ? app_.FindSession(*token) : nullptr;
+        if (!session) {
+            handler();
+            return;
+        }
+        net::dispatch(GetSessionStrand(session),
+                      metrics::MeasureQueueDelay(session_queue_delay_, std::forward<Handler>(handler)));
+    }
 
     void HandleApiJoin(http::request<http::string_body>&& req, std::function<void(http::response<http::string_body>)> send) {
         boost::system::error_code ec;
@@ -119,14 +250,22 @@ private:
         }
 
         try {
-            auto players_json = app_.GetPlayers(token.value());
+            const bool cbor = PrefersCbor(req);
+            auto body = cbor ? app_.GetPlayersCbor(token.value()) : boost::json::serialize(app_.GetPlayers(token.value()));
+            const auto encoding = req.method() == http::verb::head ? compression::Encoding::IDENTITY
+                                                                   : ChooseEncoding(req, body.size());
+            if (encoding != compression::Encoding::IDENTITY) {
+                body = compression::Compress(body, encoding);
+            }
 
             http::response<http::string_body> res(http::status::ok, req.version());
             res.set(http::field::server, "MyGameServer");
-            res.set(http::field::content_type, "application/json");
+            res.set(http::field::content_type, cbor ? cbor_writer::CONTENT_TYPE : "application/json");
             res.set(http::field::cache_control, "no-cache");
+            res.set(http::field::vary, "Accept, Accept-Encoding");
+            SetContentEncoding(res, encoding);
             if (req.method() != http::verb::head) {
-                res.body() = boost::json::serialize(players_json);
+                res.body() = std::move(body);
             }
             res.prepare_payload();
             send(std::move(res));
@@ -135,39 +274,101 @@ private:
         }
     }
 
-    void HandleApiGameState(http::request<http::string_body>&& req, std::function<void(http::response<http::string_body>)> send) {
+    /*
+     * Отдаёт опубликованный тиком снимок состояния без обращения к strand.
+     * С wait=1 ответ откладывается до конца ближайшего тика. При ручном тике wait=1 отклоняется:
+     * тик может не прийти никогда, а отложенный запрос держит соединение.
+     * В CBOR отдаётся только полное состояние: изменения и состояние в радиусе, а также
+     * состояние до первой публикации CBOR для сессии отдаются в JSON
+     */
+    template <typename Send>
+    void HandleApiGameState(const http::request<http::string_body>& req, Send& send, bool allow_wait = true) {
         auto token = ExtractToken(req);
         if (!token.has_value()) {
             send(MakeErrorResponse(http::status::unauthorized, "invalidToken", "Missing or invalid token"));
             return;
         }
 
-        try {
-            auto state_json = app_.GetGameState(token.value());
-            auto state_obj = state_json.as_object();
+        std::optional<std::uint64_t> since;
+        if (auto param = router::GetQueryParam(req.target(), "since")) {
+            std::uint64_t value = 0;
+            const auto [ptr, ec] = std::from_chars(param->data(), param->data() + param->size(), value);
+            if (param->empty() || ec != std::errc{} || ptr != param->data() + param->size()) {
+                send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Invalid since"));
+                return;
+            }
+            since = value;
+        }
 
-            boost::json::object res_body;
-            res_body["players"] = state_obj["players"];
+        std::optional<double> radius;
+        if (auto param = router::GetQueryParam(req.target(), "radius")) {
+            double value = 0.0;
+            const auto [ptr, ec] = std::from_chars(param->data(), param->data() + param->size(), value);
+            if (param->empty() || ec != std::errc{} || ptr != param->data() + param->size()
+                || !std::isfinite(value) || value <= 0.0) {
+                send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Invalid radius"));
+                return;
+            }
+            radius = value;
+        }
 
-            boost::json::object lost_objects_json;
-            auto lost_objects = app_.GetLostObjects(token.value());
+        if (since && radius) {
+            send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "since and radius cannot be combined"));
+            return;
+        }
 
-            for (const auto& [id, obj] : lost_objects) {
-                boost::json::array pos{ static_cast<double>(obj.position.x), static_cast<double>(obj.position.y) };
-                lost_objects_json[std::to_string(id)] = {
-                    {"type", obj.type},
-                    {"pos", pos}
-                };
+        const auto wait = router::GetQueryParam(req.target(), "wait");
+        if (wait && *wait != "0" && *wait != "1") {
+            send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Invalid wait"));
+            return;
+        }
+        if (allow_wait && wait == "1") {
+            if (!app_.GetAutoTick()) {
+                send(MakeErrorResponse(http::status::bad_request, "invalidArgument",
+                                       "wait=1 requires the server to tick automatically"));
+                return;
+            }
+            auto* session = app_.FindSession(*token);
+            if (!session) {
+                send(MakeErrorResponse(http::status::unauthorized, "unknownToken", "Unknown token"));
+                return;
             }
+            broadcaster_.Park(*session, [self = shared_from_this(), req, send]() mutable {
+                self->HandleApiGameState(req, send, false);
+            });
+            return;
+        }
 
-            res_body["lostObjects"] = lost_objects_json;
+        try {
+            Application::StateBody state;
+            if (!since && !radius && PrefersCbor(req)) {
+                state = app_.GetGameStateCbor(token.value());
+            }
+            const bool cbor = state.body != nullptr;
+            if (!cbor) {
+                state = since ? app_.GetGameStateDelta(token.value(), *since)
+                              : app_.GetGameStateSnapshot(token.value(), radius);
+            }
+            auto snapshot = std::move(state.body);
+
+            const auto encoding = req.method() == http::verb::head ? compression::Encoding::IDENTITY
+                                                                   : ChooseEncoding(req, snapshot->size());
+            if (encoding != compression::Encoding::IDENTITY) {
+                // Опубликованный снимок разделяют все игроки сессии, поэтому он сжимается один раз.
+                // Тело, собранное для этого запроса, сжимается сразу
+                snapshot = state.published
+                    ? compressed_snapshots_.Get(snapshot, encoding)
+                    : std::make_shared<const std::string>(compression::Compress(*snapshot, encoding));
+            }
 
-            http::response<http::string_body> res(http::status::ok, req.version());
+            http::response<http_server::SharedBufferBody> res(http::status::ok, req.version());
             res.set(http::field::server, "MyGameServer");
-            res.set(http::field::content_type, "application/json");
+            res.set(http::field::content_type, cbor ? cbor_writer::CONTENT_TYPE : "application/json");
             res.set(http::field::cache_control, "no-cache");
+            res.set(http::field::vary, "Accept, Accept-Encoding");
+            SetContentEncoding(res, encoding);
             if (req.method() != http::verb::head) {
-                res.body() = boost::json::serialize(res_body);
+                res.body() = std::move(snapshot);
             }
             res.prepare_payload();
             send(std::move(res));
@@ -204,14 +405,28 @@ private:
         }
 
         try {
-            app_.ActionPlayer(token.value(), move);
-            http::response<http::string_body> res(http::status::ok, req.version());
-            res.set(http::field::server, "MyGameServer");
-            res.set(http::field::content_type, "application/json");
-            res.set(http::field::cache_control, "no-cache");
-            res.body() = "{}";
-            res.prepare_payload();
-            send(std::move(res));
+            auto session = app_.ActionPlayer(token.value(), move);
+            auto respond = [version = req.version(), send = std::move(send)] {
+                http::response<http::string_body> res(http::status::ok, version);
+                res.set(http::field::server, "MyGameServer");
+                res.set(http::field::content_type, "application/json");
+                res.set(http::field::cache_control, "no-cache");
+                res.body() = "{}";
+                res.prepare_payload();
+                send(std::move(res));
+            };
+            if (app_.GetAutoTick()) {
+                respond();
+                return;
+            }
+            // При ручном тике команда применяется в ближайший ход strand сессии, а ответ отправляется
+            // после публикации: следующий /state этого клиента уже видит новое направление
+            net::post(GetSessionStrand(session),
+                      metrics::MeasureQueueDelay(session_queue_delay_,
+                                                 [self = shared_from_this(), session, respond = std::move(respond)] {
+                                                     self->app_.ApplyActions(*session);
+                                                     respond();
+                                                 }));
         } catch (const AppErrorException& e) {
             send(MakeErrorResponse(http::status::bad_request, "invalidArgument", e.what()));
         }
@@ -246,31 +461,55 @@ private:
         }
     }
 
-    void HandleApiMapInfo(http::request<http::string_body>&& req, std::function<void(http::response<http::string_body>)> send) {
-        std::string target = std::string(req.target());
-        static const std::regex map_regex(R"(^/api/v1/maps/([^/]+)$)");
-        std::smatch match;
-        if (!std::regex_match(target, match, map_regex)) {
-            send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Invalid map id"));
+    /*
+     * Отдаёт тело или его заранее сжатый вариант. Тело в формате, отличном от JSON,
+     * передаётся вместе с его content_type, а vary_accept добавляет Accept в Vary
+     */
+    template <typename Send>
+    void SendPreparedBody(const http::request<http::string_body>& req, Send& send, const Application::PreparedBody& prepared,
+                          std::string_view content_type = "application/json", bool vary_accept = false) {
+        const auto encoding = prepared.SelectEncoding(ChooseEncoding(req, prepared.body->size()));
+        const auto* body = &prepared.GetBody(encoding);
+        const auto* etag = &prepared.GetEtag(encoding);
+        const auto vary = vary_accept ? "Accept, Accept-Encoding" : "Accept-Encoding";
+
+        if (auto it = req.find(http::field::if_none_match); it != req.end() && router::MatchesEtag(it->value(), *etag)) {
+            http::response<http::empty_body> res(http::status::not_modified, req.version());
+            res.set(http::field::server, "MyGameServer");
+            res.set(http::field::etag, *etag);
+            res.set(http::field::cache_control, "no-cache");
+            res.set(http::field::vary, vary);
+            send(std::move(res));
             return;
         }
 
-        std::string map_id = match[1].str();
+        http::response<http_server::SharedBufferBody> res(http::status::ok, req.version());
+        res.set(http::field::server, "MyGameServer");
+        res.set(http::field::content_type, content_type);
+        res.set(http::field::cache_control, "no-cache");
+        res.set(http::field::etag, *etag);
+        res.set(http::field::vary, vary);
+        SetContentEncoding(res, encoding);
+        if (req.method() != http::verb::head) {
+            res.body() = *body;
+        }
+        res.prepare_payload();
+        send(std::move(res));
+    }
 
-        try {
-            std::string map_json_str = app_.GetMapInfo(map_id);
-            boost::json::value map_json = boost::json::parse(map_json_str);
-            auto map_obj = map_json.as_object();
+    template <typename Send>
+    void HandleApiMaps(const http::request<http::string_body>& req, Send& send) {
+        SendPreparedBody(req, send, app_.GetMapsShortInfo());
+    }
 
-            http::response<http::string_body> res(http::status::ok, req.version());
-            res.set(http::field::server, "MyGameServer");
-            res.set(http::field::content_type, "application/json");
-            res.set(http::field::cache_control, "no-cache");
-            if (req.method() != http::verb::head) {
-                res.body() = boost::json::serialize(map_obj);
+    template <typename Send>
+    void HandleApiMapInfo(const http::request<http::string_body>& req, Send& send, std::string_view map_id) {
+        try {
+            if (PrefersCbor(req)) {
+                SendPreparedBody(req, send, app_.GetMapInfoCbor(std::string(map_id)), cbor_writer::CONTENT_TYPE, true);
+            } else {
+                SendPreparedBody(req, send, app_.GetMapInfo(std::string(map_id)), "application/json", true);
             }
-            res.prepare_payload();
-            send(std::move(res));
         } catch (const AppErrorException& e) {
             send(MakeErrorResponse(http::status::not_found, "mapNotFound", e.what()));
         }
@@ -288,48 +527,209 @@ private:
         auto auth_it = req.find(http::field::authorization);
         if (auth_it == req.end()) return std::nullopt;
 
-        std::string auth_header = std::string(auth_it->value());
-        static const std::regex token_regex(R"(Bearer\s([0-9a-fA-F]{32}))");
-        std::smatch match_results;
-        if (!std::regex_match(auth_header, match_results, token_regex)) return std::nullopt;
+        auto token = router::ParseBearerToken(auth_it->value());
+        if (!token) return std::nullopt;
 
-        return match_results[1].str();
+        return std::string(*token);
     }
 
-    template <typename Body, typename Allocator>
-    http::response<http::string_body> HandleStatic(
-        const http::request<Body, http::basic_fields<Allocator>>& req
-    ) const {
-        auto rel_path = std::string(req.target());
+    static bool PrefersCbor(const http::request<http::string_body>& req) {
+        return router::NegotiateFormat(req[http::field::accept]) == router::ResponseFormat::CBOR;
+    }
+
+    // Тела короче порога не сжимаются: выигрыш в размере не окупает время на сжатие
+    compression::Encoding ChooseEncoding(const http::request<http::string_body>& req, std::size_t body_size) const {
+        if (body_size < compression_threshold_) {
+            return compression::Encoding::IDENTITY;
+        }
+        return router::NegotiateEncoding(req[http::field::accept_encoding]);
+    }
+
+    template <typename Fields>
+    static void SetContentEncoding(Fields& res, compression::Encoding encoding) {
+        if (encoding != compression::Encoding::IDENTITY) {
+            res.set(http::field::content_encoding, compression::GetEncodingName(encoding));
+        }
+    }
+
+    template <typename Body, typename Allocator, typename Send>
+    void HandleStatic(const http::request<Body, http::basic_fields<Allocator>>& req, Send& send) const {
+        auto asset = static_cache_.Find(req.target());
+        if (!asset) {
+            return ServeStaticFile(req, send);
+        }
+        if (req.count(http::field::range)) {
+            // Диапазоны отдаются без сжатия из того же содержимого, что описывают валидаторы кэша
+            return StreamStaticFile(req, send, asset->path, asset.get());
+        }
+
+        // Для статики хранится только gzip, но клиент выбирает по тем же правилам, что и в API
+        const bool gzip = asset->gzip_body
+            && router::NegotiateEncoding(req[http::field::accept_encoding]) == compression::Encoding::GZIP;
+        const auto& etag = gzip ? asset->gzip_etag : asset->etag;
+        const auto& body = gzip ? asset->gzip_body : asset->body;
+
+        auto set_validators = [&](auto& res) {
+            res.set(http::field::accept_ranges, "bytes");
+            res.set(http::field::etag, etag);
+            res.set(http::field::last_modified, asset->last_modified);
+            if (asset->gzip_body) {
+                res.set(http::field::vary, "Accept-Encoding");
+            }
+        };
+
+        const bool not_modified = req.count(http::field::if_none_match)
+            ? router::MatchesEtag(req[http::field::if_none_match], etag)
+            : req[http::field::if_modified_since] == asset->last_modified;
+        if (not_modified) {
+            http::response<http::empty_body> res{http::status::not_modified, req.version()};
+            set_validators(res);
+            return send(std::move(res));
+        }
+
+        http::response<http_server::SharedBufferBody> res{http::status::ok, req.version()};
+        res.set(http::field::content_type, asset->content_type);
+        set_validators(res);
+        if (gzip) {
+            res.set(http::field::content_encoding, "gzip");
+        }
+        if (req.method() == http::verb::head) {
+            res.content_length(body->size());
+        } else {
+            res.body() = body;
+            res.prepare_payload();
+        }
+        send(std::move(res));
+    }
+
+    static http::response<http::string_body> MakeStaticError(http::status status, std::string_view text, unsigned version) {
+        http::response<http::string_body> res{status, version};
+        res.set(http::field::content_type, ContentType::TEXT_PLAIN);
+        res.body() = text;
+        res.prepare_payload();
+        return res;
+    }
+
+    // Файла нет в кэше: он слишком большой, появился позже или путь некорректен
+    template <typename Body, typename Allocator, typename Send>
+    void ServeStaticFile(const http::request<Body, http::basic_fields<Allocator>>& req, Send& send) const {
+        // Путь разбирается так же, как в StaticCache::Find, чтобы файл не пропадал, перестав помещаться в кэш
+        auto decoded = DecodeUrlPath(router::StripQuery(req.target()));
+        if (!decoded || decoded->find('\0') != std::string::npos) {
+            return send(MakeStaticError(http::status::bad_request, "Bad Request", req.version()));
+        }
+        auto rel_path = std::move(*decoded);
         if (rel_path.empty() || rel_path[0] != '/') rel_path.insert(rel_path.begin(), '/');
 
         fs::path requested = fs::weakly_canonical(data_path_ / rel_path.substr(1));
         if (requested.string().find(data_path_.string()) != 0) {
-            http::response<http::string_body> res{http::status::bad_request, req.version()};
-            res.set(http::field::content_type, ContentType::TEXT_PLAIN);
-            res.body() = "Bad Request";
-            res.prepare_payload();
-            return res;
+            return send(MakeStaticError(http::status::bad_request, "Bad Request", req.version()));
         }
 
         if (fs::is_directory(requested)) requested /= "index.html";
         if (!fs::exists(requested) || !fs::is_regular_file(requested)) {
-            http::response<http::string_body> res{http::status::not_found, req.version()};
-            res.set(http::field::content_type, ContentType::TEXT_PLAIN);
-            res.body() = "Not Found";
-            res.prepare_payload();
-            return res;
+            return send(MakeStaticError(http::status::not_found, "Not Found", req.version()));
+        }
+
+        StreamStaticFile(req, send, requested, nullptr);
+    }
+
+    /*
+     * Отдаёт файл, поддерживая Range и условные запросы. Файл из кэша отдаётся из памяти:
+     * без --watch-static файл на диске мог измениться, и его байты не совпали бы с ETag кэша.
+     * Остальные файлы отдаются с диска через FileRangeBody, для HEAD файл не открывается
+     */
+    template <typename Body, typename Allocator, typename Send>
+    void StreamStaticFile(const http::request<Body, http::basic_fields<Allocator>>& req, Send& send,
+                          const fs::path& file, const StaticAsset* cached) const {
+        std::uint64_t size = 0;
+        std::string etag;
+        std::string last_modified;
+        if (cached) {
+            size = cached->body->size();
+            etag = cached->etag;
+            last_modified = cached->last_modified;
+        } else {
+            std::error_code ec;
+            size = fs::file_size(file, ec);
+            const auto modified = ec ? fs::file_time_type{} : fs::last_write_time(file, ec);
+            if (ec) {
+                return send(MakeStaticError(http::status::not_found, "Not Found", req.version()));
+            }
+            etag = MakeFileEtag(size, modified);
+            last_modified = FormatHttpDate(modified);
         }
 
-        std::ifstream file(requested, std::ios::binary);
-        std::ostringstream buffer;
-        buffer << file.rdbuf();
+        auto set_headers = [&](auto& res) {
+            res.set(http::field::accept_ranges, "bytes");
+            res.set(http::field::etag, etag);
+            res.set(http::field::last_modified, last_modified);
+        };
 
-        http::response<http::string_body> res{http::status::ok, req.version()};
-        res.set(http::field::content_type, ContentType::GetContentTypeByFileExtension(requested));
-        res.body() = buffer.str();
+        const bool not_modified = req.count(http::field::if_none_match)
+            ? router::MatchesEtag(req[http::field::if_none_match], etag)
+            : req[http::field::if_modified_since] == last_modified;
+        if (not_modified) {
+            http::response<http::empty_body> res{http::status::not_modified, req.version()};
+            set_headers(res);
+            return send(std::move(res));
+        }
+
+        router::ByteRange range{0, size};
+        auto range_status = router::RangeStatus::FULL;
+        if (req.count(http::field::range)) {
+            // If-Range: диапазон отдаётся, только если у клиента актуальная версия файла
+            const auto if_range = req[http::field::if_range];
+            if (if_range.empty() || if_range == etag || if_range == last_modified) {
+                range_status = router::ParseRange(req[http::field::range], size, range);
+            }
+        }
+
+        if (range_status == router::RangeStatus::UNSATISFIABLE) {
+            http::response<http::empty_body> res{http::status::range_not_satisfiable, req.version()};
+            set_headers(res);
+            res.set(http::field::content_range, "bytes */" + std::to_string(size));
+            res.content_length(0);
+            return send(std::move(res));
+        }
+
+        const auto status = range_status == router::RangeStatus::PARTIAL ? http::status::partial_content : http::status::ok;
+        auto set_content_headers = [&](auto& res) {
+            res.set(http::field::content_type,
+                    cached ? cached->content_type : ContentType::GetContentTypeByFileExtension(file));
+            set_headers(res);
+            if (range_status == router::RangeStatus::PARTIAL) {
+                res.set(http::field::content_range, "bytes " + std::to_string(range.offset) + "-"
+                    + std::to_string(range.offset + range.size - 1) + "/" + std::to_string(size));
+            }
+        };
+
+        if (req.method() == http::verb::head) {
+            http::response<http::empty_body> res{status, req.version()};
+            set_content_headers(res);
+            res.content_length(range.size);
+            return send(std::move(res));
+        }
+
+        if (cached) {
+            http::response<http_server::SharedBufferRangeBody> res{status, req.version()};
+            res.body() = {cached->body, static_cast<std::size_t>(range.offset), static_cast<std::size_t>(range.size)};
+            set_content_headers(res);
+            res.prepare_payload();
+            return send(std::move(res));
+        }
+
+        http::response<http_server::FileRangeBody> res{status, req.version()};
+        beast::error_code open_ec;
+        res.body().file.open(file.c_str(), beast::file_mode::scan, open_ec);
+        if (open_ec) {
+            return send(MakeStaticError(http::status::not_found, "Not Found", req.version()));
+        }
+        res.body().offset = range.offset;
+        res.body().size = range.size;
+        set_content_headers(res);
         res.prepare_payload();
-        return res;
+        send(std::move(res));
     }
 
     static http::response<http::string_body> MakeErrorResponse(
@@ -361,113 +761,129 @@ private:
         return res;
     }
 
-    void HandleApiRequest(http::request<http::string_body>&& req, std::function<void(http::response<http::string_body>)> send) {
-        const std::string target = std::string(req.target());
-        const auto method = req.method();
-
-        if (target == "/api/v1/game/join" && method == http::verb::post) {
-            net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                self->HandleApiJoin(std::move(req), std::move(send));
-            });
+    template <typename Send>
+    void HandleApiRequest(http::request<http::string_body>&& req, Send&& untracked_send) {
+        using Status = router::RouteMatch::Status;
+        const auto match = router::MatchApiRoute(req.method(), req.target());
+        auto send = TrackRoute(match.route ? static_cast<size_t>(match.route->endpoint) : UNKNOWN_ROUTE,
+                               std::forward<Send>(untracked_send));
+        if (match.status == Status::NOT_FOUND) {
+            send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Unknown API endpoint"));
             return;
         }
-
-        if (target == "/api/v1/game/player/action" && method == http::verb::post) {
-            net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                self->HandleApiAction(std::move(req), std::move(send));
-            });
+        if (match.status == Status::METHOD_NOT_ALLOWED) {
+            send(MakeMethodNotAllowed(match.route->not_allowed_message, match.route->allow));
             return;
         }
 
-        if (target == "/api/v1/game/players" && (method == http::verb::get || method == http::verb::head)) {
-            net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                self->HandleApiPlayers(std::move(req), std::move(send));
-            });
-            return;
-        }
-
-        if(target == "/api/v1/game/state") {
-            if (method != http::verb::get && method != http::verb::head) {
-                send(MakeMethodNotAllowed("Only GET/HEAD methods are allowed for this endpoint", "GET, HEAD"));
-                return;
-            }
-            net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                self->HandleApiGameState(std::move(req), std::move(send));
-            });
-            return;
-        }
-
-        if (target == "/api/v1/game/tick") {
-            if (method == http::verb::post) {
-                net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                    self->HandleApiTick(std::move(req), std::move(send));
+        switch (match.route->endpoint) {
+            case router::Endpoint::JOIN:
+                net::dispatch(api_strand_, metrics::MeasureQueueDelay(api_queue_delay_,
+                    [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
+                        self->HandleApiJoin(std::move(req), std::move(send));
+                    }));
+                break;
+
+            case router::Endpoint::ACTION:
+                // Проверка и постановка команды в очередь выполняются прямо в потоке ввода-вывода
+                HandleApiAction(std::move(req), std::move(send));
+                break;
+
+            case router::Endpoint::PLAYERS:
+                DispatchToSession(req, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
+                    self->HandleApiPlayers(std::move(req), std::move(send));
                 });
-                return;
-            } else {
-                send(MakeMethodNotAllowed("Only POST method is allowed for this endpoint"));
-                return;
-            }
-        }
-
-        if (std::regex_match(target, std::regex(R"(^/api/v1/maps/[^/]+$)"))) {
-            if (method != http::verb::get && method != http::verb::head) {
-                send(MakeMethodNotAllowed("Only GET/HEAD methods are allowed for this endpoint", "GET, HEAD"));
-                return;
+                break;
+
+            case router::Endpoint::STATE:
+                HandleApiGameState(req, send);
+                break;
+
+            case router::Endpoint::TICK:
+                net::dispatch(api_strand_, metrics::MeasureQueueDelay(api_queue_delay_,
+                    [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
+                        self->HandleApiTick(std::move(req), std::move(send));
+                    }));
+                break;
+
+            // Ответы о картах сформированы заранее и отдаются прямо в потоке ввода-вывода
+            case router::Endpoint::MAPS:
+                HandleApiMaps(req, send);
+                break;
+
+            case router::Endpoint::MAP:
+                // Параметр ссылается на req, поэтому запрос не перемещаем
+                HandleApiMapInfo(req, send, match.params[0]);
+                break;
+
+            case router::Endpoint::STREAM: {
+                // Сюда доходят только запросы без заголовков перехода к WebSocket
+                auto res = MakeErrorResponse(http::status::upgrade_required, "upgradeRequired",
+                                             "WebSocket upgrade required");
+                res.set(http::field::upgrade, "websocket");
+                res.set(http::field::connection, "Upgrade");
+                send(std::move(res));
+                break;
             }
-            net::dispatch(api_strand_, [self = shared_from_this(), req = std::move(req), send = std::move(send)]() mutable {
-                self->HandleApiMapInfo(std::move(req), std::move(send));
-            });
-            return;
         }
-
-
-        send(MakeErrorResponse(http::status::bad_request, "invalidArgument", "Unknown API endpoint"));
     }
 };
 
+/*
+ * Пишет в журнал запросов одну запись на запрос, когда обработчик отдаёт ответ.
+ * Копируется в каждое соединение, поэтому владеет обработчиком и журналом через shared_ptr
+ */
 template <typename Handler>
 class LoggingRequestHandler {
 public:
-    explicit LoggingRequestHandler(Handler& decorated)
-        : decorated_{decorated} {}
+    LoggingRequestHandler(std::shared_ptr<Handler> decorated, std::shared_ptr<const access_log::AccessLog> log)
+        : decorated_{std::move(decorated)}
+        , log_{std::move(log)} {}
 
     template <typename Body, typename Allocator, typename Send>
-    void operator()(boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
+    void operator()(const net::ip::tcp::endpoint& remote, http::request<Body, http::basic_fields<Allocator>>&& req,
                     Send&& send) {
-        LogRequest(req);
-    decorated_(std::move(req),
-        [this, &send, start = std::chrono::steady_clock::now()](auto&& response) mutable {
-            auto end = std::chrono::steady_clock::now();
-            auto response_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-            LogResponse(response, response_time);  
-            send(std::forward<decltype(response)>(response));
-        });
+        auto info = MakeRequestInfo(remote, req);
+        (*decorated_)(std::move(req), WrapSend(info, std::forward<Send>(send)));
     }
 
-private:
-    Handler& decorated_;
-
-  template <typename Body, typename Allocator>
-    void LogRequest(const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& req) {
-        boost::json::object log_data;
-        log_data["ip"] = "0.0.0.0";
-        log_data["URI"] = std::string(req.target());
-        log_data["method"] = std::string(req.method_string());
-
-        json_logger::LogData("request received", log_data);
+    template <typename Send, typename Accept>
+    void operator()(const net::ip::tcp::endpoint& remote, const http::request<http::string_body>& req, Send&& send,
+                    Accept&& accept) {
+        auto info = MakeRequestInfo(remote, req);
+        (*decorated_)(req, WrapSend(info, std::forward<Send>(send)),
+            [log = log_, info, accept = std::forward<Accept>(accept)](auto&& on_open) mutable {
+                log->Log(info, static_cast<unsigned>(http::status::switching_protocols), {}, 0);
+                accept(std::forward<decltype(on_open)>(on_open));
+            });
     }
 
-    template <typename Body>
-    void LogResponse(const boost::beast::http::response<Body>& res, std::uint64_t response_time_ms) {
-        boost::json::object log_data;
-        log_data["response_time"] = response_time_ms;
-        log_data["code"] = res.result_int();
-        log_data["content_type"] = res.base().count(boost::beast::http::field::content_type) ?
-                                   std::string(res.base().at(boost::beast::http::field::content_type)) :
-                                   nullptr;
+private:
+    template <typename Request>
+    access_log::RequestInfo MakeRequestInfo(const net::ip::tcp::endpoint& remote, const Request& req) const {
+        std::string_view forwarded_for;
+        if (auto it = req.find("X-Forwarded-For"); it != req.end()) {
+            forwarded_for = it->value();
+        }
+        return {access_log::GetClientAddress(remote.address(), forwarded_for, log_->TrustsForwardedFor()),
+                req.method(), req.target()};
+    }
 
-        json_logger::LogData("response sent", log_data);
+    // send захватывается по значению: ответ может прийти из другого потока, когда вызов уже завершён
+    template <typename Send>
+    auto WrapSend(const access_log::RequestInfo& info, Send&& send) const {
+        return [log = log_, info, send = std::forward<Send>(send)](auto&& response) mutable {
+            std::string_view content_type;
+            if (auto it = response.find(http::field::content_type); it != response.end()) {
+                content_type = it->value();
+            }
+            log->Log(info, response.result_int(), content_type, response.payload_size().value_or(0));
+            send(std::forward<decltype(response)>(response));
+        };
     }
+
+    std::shared_ptr<Handler> decorated_;
+    std::shared_ptr<const access_log::AccessLog> log_;
 };
 
 }  // namespace http_handler
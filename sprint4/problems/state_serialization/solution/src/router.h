@@ -0,0 +1,434 @@
+#pragma once
+
+#include <boost/beast/http/verb.hpp>
+
+#include "compression.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string_view>
+
+namespace router {
+
+namespace http = boost::beast::http;
+
+enum class Endpoint {
+    JOIN,
+    ACTION,
+    PLAYERS,
+    STATE,
+    TICK,
+    MAPS,
+    MAP,
+    STREAM
+};
+
+inline constexpr size_t ENDPOINT_COUNT = 8;
+
+// Имя эндпоинта для метрик и логов
+constexpr std::string_view GetEndpointName(Endpoint endpoint) {
+    constexpr std::array<std::string_view, ENDPOINT_COUNT> names{
+        "join", "action", "players", "state", "tick", "maps", "map", "stream"};
+    return names[static_cast<size_t>(endpoint)];
+}
+
+// Что делать с запросом, если путь совпал, а метод — нет
+enum class OnMethodMismatch {
+    UNKNOWN_ENDPOINT,
+    METHOD_NOT_ALLOWED
+};
+
+constexpr std::uint64_t Methods(std::initializer_list<http::verb> verbs) {
+    std::uint64_t mask = 0;
+    for (auto verb : verbs) {
+        mask |= std::uint64_t{1} << static_cast<unsigned>(verb);
+    }
+    return mask;
+}
+
+struct Route {
+    // Сегмент "{}" совпадает с любым непустым сегментом пути и становится параметром
+    std::string_view pattern;
+    Endpoint endpoint;
+    std::uint64_t methods;
+    OnMethodMismatch on_mismatch;
+    // Значение заголовка Allow и текст ошибки для ответа 405
+    std::string_view allow = {};
+    std::string_view not_allowed_message = {};
+};
+
+inline constexpr std::string_view GET_HEAD_ONLY = "Only GET/HEAD methods are allowed for this endpoint";
+
+inline constexpr std::array API_ROUTES{
+    Route{"/api/v1/game/join", Endpoint::JOIN, Methods({http::verb::post}), OnMethodMismatch::UNKNOWN_ENDPOINT},
+    Route{"/api/v1/game/player/action", Endpoint::ACTION, Methods({http::verb::post}),
+          OnMethodMismatch::UNKNOWN_ENDPOINT},
+    Route{"/api/v1/game/players", Endpoint::PLAYERS, Methods({http::verb::get, http::verb::head}),
+          OnMethodMismatch::UNKNOWN_ENDPOINT},
+    Route{"/api/v1/game/state", Endpoint::STATE, Methods({http::verb::get, http::verb::head}),
+          OnMethodMismatch::METHOD_NOT_ALLOWED, "GET, HEAD", GET_HEAD_ONLY},
+    Route{"/api/v1/game/tick", Endpoint::TICK, Methods({http::verb::post}),
+          OnMethodMismatch::METHOD_NOT_ALLOWED, "POST", "Only POST method is allowed for this endpoint"},
+    Route{"/api/v1/game/stream", Endpoint::STREAM, Methods({http::verb::get}),
+          OnMethodMismatch::METHOD_NOT_ALLOWED, "GET", "Only GET method is allowed for this endpoint"},
+    Route{"/api/v1/maps", Endpoint::MAPS, Methods({http::verb::get, http::verb::head}),
+          OnMethodMismatch::METHOD_NOT_ALLOWED, "GET, HEAD", GET_HEAD_ONLY},
+    Route{"/api/v1/maps/{}", Endpoint::MAP, Methods({http::verb::get, http::verb::head}),
+          OnMethodMismatch::METHOD_NOT_ALLOWED, "GET, HEAD", GET_HEAD_ONLY},
+};
+
+inline constexpr size_t MAX_PARAMS = 2;
+
+struct RouteMatch {
+    enum class Status {
+        FOUND,
+        NOT_FOUND,
+        METHOD_NOT_ALLOWED
+    };
+
+    Status status = Status::NOT_FOUND;
+    const Route* route = nullptr;
+    // Ссылаются на строку запроса, поэтому живут не дольше неё
+    std::array<std::string_view, MAX_PARAMS> params{};
+};
+
+constexpr std::string_view StripQuery(std::string_view target) {
+    return target.substr(0, target.find('?'));
+}
+
+// Сопоставляет путь с шаблоном за один проход, не выделяя память
+constexpr bool MatchPattern(std::string_view pattern, std::string_view path,
+                            std::array<std::string_view, MAX_PARAMS>& params) {
+    size_t param_count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < pattern.size()) {
+        if (pattern.substr(i, 2) == "{}") {
+            auto end = path.find('/', j);
+            if (end == std::string_view::npos) {
+                end = path.size();
+            }
+            if (end == j || param_count == MAX_PARAMS) {
+                return false;
+            }
+            params[param_count++] = path.substr(j, end - j);
+            i += 2;
+            j = end;
+            continue;
+        }
+        if (j == path.size() || pattern[i] != path[j]) {
+            return false;
+        }
+        ++i;
+        ++j;
+    }
+    return j == path.size();
+}
+
+// Ищет маршрут по пути без строки запроса. Путь совпадает не более чем с одним шаблоном
+template <size_t N>
+constexpr RouteMatch MatchRoute(const std::array<Route, N>& routes, http::verb method, std::string_view target) {
+    const auto path = StripQuery(target);
+    RouteMatch match;
+    for (const auto& route : routes) {
+        if (!MatchPattern(route.pattern, path, match.params)) {
+            continue;
+        }
+        match.route = &route;
+        if (route.methods & Methods({method})) {
+            match.status = RouteMatch::Status::FOUND;
+        } else if (route.on_mismatch == OnMethodMismatch::METHOD_NOT_ALLOWED) {
+            match.status = RouteMatch::Status::METHOD_NOT_ALLOWED;
+        } else {
+            match.route = nullptr;
+        }
+        return match;
+    }
+    return match;
+}
+
+constexpr RouteMatch MatchApiRoute(http::verb method, std::string_view target) {
+    return MatchRoute(API_ROUTES, method, target);
+}
+
+// Значение параметра name из строки запроса без URL-декодирования
+constexpr std::optional<std::string_view> GetQueryParam(std::string_view target, std::string_view name) {
+    const auto question = target.find('?');
+    if (question == std::string_view::npos) {
+        return std::nullopt;
+    }
+    auto query = target.substr(question + 1);
+    while (!query.empty()) {
+        const auto amp = query.find('&');
+        const auto param = query.substr(0, amp);
+        query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+
+        const auto eq = param.find('=');
+        if (param.substr(0, eq) == name) {
+            return eq == std::string_view::npos ? std::string_view{} : param.substr(eq + 1);
+        }
+    }
+    return std::nullopt;
+}
+
+constexpr bool IsHexDigit(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+constexpr bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline constexpr size_t TOKEN_SIZE = 32;
+
+// Заголовок Authorization вида "Bearer <32 шестнадцатеричные цифры>"
+constexpr std::optional<std::string_view> ParseBearerToken(std::string_view header) {
+    constexpr std::string_view scheme = "Bearer";
+    if (header.size() != scheme.size() + 1 + TOKEN_SIZE || !header.starts_with(scheme)
+        || !IsSpace(header[scheme.size()])) {
+        return std::nullopt;
+    }
+    const auto token = header.substr(scheme.size() + 1);
+    for (char c : token) {
+        if (!IsHexDigit(c)) {
+            return std::nullopt;
+        }
+    }
+    return token;
+}
+
+enum class ResponseFormat {
+    JSON,
+    CBOR
+};
+
+constexpr char ToLower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (ToLower(lhs[i]) != ToLower(rhs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr std::string_view TrimSpaces(std::string_view text) {
+    while (!text.empty() && IsSpace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && IsSpace(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Вес q из параметров диапазона Accept в тысячных. Некорректный вес считается нулевым
+constexpr int ParseQuality(std::string_view params) {
+    while (!params.empty()) {
+        const auto semicolon = params.find(';');
+        const auto param = TrimSpaces(params.substr(0, semicolon));
+        params = semicolon == std::string_view::npos ? std::string_view{} : params.substr(semicolon + 1);
+        if (param.size() < 2 || ToLower(param[0]) != 'q' || param[1] != '=') {
+            continue;
+        }
+
+        const auto value = param.substr(2);
+        if (value.empty() || (value[0] != '0' && value[0] != '1') || value.size() > 5
+            || (value.size() > 1 && value[1] != '.')) {
+            return 0;
+        }
+        int quality = (value[0] - '0') * 1000;
+        int scale = 100;
+        for (size_t i = 2; i < value.size(); ++i, scale /= 10) {
+            if (value[i] < '0' || value[i] > '9') {
+                return 0;
+            }
+            quality += (value[i] - '0') * scale;
+        }
+        return quality > 1000 ? 0 : quality;
+    }
+    return 1000;
+}
+
+/*
+ * Выбирает формат ответа API по заголовку Accept. CBOR отдаётся, только если клиент
+ * назвал application/cbor явно и не предпочёл ему application/json.
+ * При равных весах JSON уступает, только если подходит под Accept лишь по шаблону
+ */
+constexpr ResponseFormat NegotiateFormat(std::string_view accept) {
+    int cbor_quality = 0;
+    int json_quality = 0;
+    // 0 — JSON не подходит, 1 — */*, 2 — application/*, 3 — application/json
+    int json_precision = 0;
+
+    while (!accept.empty()) {
+        const auto comma = accept.find(',');
+        const auto range = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view{} : accept.substr(comma + 1);
+
+        const auto semicolon = range.find(';');
+        const auto type = TrimSpaces(range.substr(0, semicolon));
+        const auto quality = semicolon == std::string_view::npos ? 1000 : ParseQuality(range.substr(semicolon + 1));
+
+        if (EqualsIgnoreCase(type, "application/cbor")) {
+            cbor_quality = std::max(cbor_quality, quality);
+            continue;
+        }
+        int precision = 0;
+        if (EqualsIgnoreCase(type, "application/json")) {
+            precision = 3;
+        } else if (EqualsIgnoreCase(type, "application/*")) {
+            precision = 2;
+        } else if (type == "*/*") {
+            precision = 1;
+        }
+        // Вес JSON задаёт самый точный подходящий диапазон
+        if (precision > json_precision) {
+            json_precision = precision;
+            json_quality = quality;
+        } else if (precision != 0 && precision == json_precision) {
+            json_quality = std::max(json_quality, quality);
+        }
+    }
+
+    if (cbor_quality > json_quality || (cbor_quality > 0 && cbor_quality == json_quality && json_precision < 3)) {
+        return ResponseFormat::CBOR;
+    }
+    return ResponseFormat::JSON;
+}
+
+/*
+ * Выбирает сжатие ответа по заголовку Accept-Encoding: gzip или deflate с наибольшим
+ * весом, если он не меньше веса identity. При равных весах gzip предпочтительнее
+ */
+constexpr compression::Encoding NegotiateEncoding(std::string_view accept_encoding) {
+    int gzip_quality = -1;
+    int deflate_quality = -1;
+    int identity_quality = -1;
+    int any_quality = -1;
+
+    while (!accept_encoding.empty()) {
+        const auto comma = accept_encoding.find(',');
+        const auto coding = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+
+        const auto semicolon = coding.find(';');
+        const auto name = TrimSpaces(coding.substr(0, semicolon));
+        const auto quality = semicolon == std::string_view::npos ? 1000 : ParseQuality(coding.substr(semicolon + 1));
+
+        if (EqualsIgnoreCase(name, "gzip") || EqualsIgnoreCase(name, "x-gzip")) {
+            gzip_quality = std::max(gzip_quality, quality);
+        } else if (EqualsIgnoreCase(name, "deflate")) {
+            deflate_quality = std::max(deflate_quality, quality);
+        } else if (EqualsIgnoreCase(name, "identity")) {
+            identity_quality = std::max(identity_quality, quality);
+        } else if (name == "*") {
+            any_quality = std::max(any_quality, quality);
+        }
+    }
+
+    // Не названные явно кодирования получают вес *. Без * identity допустим, но с наименьшим весом
+    if (gzip_quality < 0) {
+        gzip_quality = std::max(any_quality, 0);
+    }
+    if (deflate_quality < 0) {
+        deflate_quality = std::max(any_quality, 0);
+    }
+    if (identity_quality < 0) {
+        identity_quality = any_quality < 0 ? 1 : any_quality;
+    }
+
+    if (gzip_quality > 0 && gzip_quality >= deflate_quality && gzip_quality >= identity_quality) {
+        return compression::Encoding::GZIP;
+    }
+    if (deflate_quality > 0 && deflate_quality >= identity_quality) {
+        return compression::Encoding::DEFLATE;
+    }
+    return compression::Encoding::IDENTITY;
+}
+
+// Совпадает ли один из тегов If-None-Match с etag (слабое сравнение, RFC 9110)
+constexpr bool MatchesEtag(std::string_view if_none_match, std::string_view etag) {
+    while (!if_none_match.empty()) {
+        const auto comma = if_none_match.find(',');
+        auto tag = TrimSpaces(if_none_match.substr(0, comma));
+        if_none_match = comma == std::string_view::npos ? std::string_view{} : if_none_match.substr(comma + 1);
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ByteRange {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+};
+
+enum class RangeStatus {
+    FULL,
+    PARTIAL,
+    UNSATISFIABLE
+};
+
+// Разбирает заголовок Range с одним диапазоном. Несколько диапазонов и
+// некорректный заголовок игнорируются: файл отдаётся целиком
+inline RangeStatus ParseRange(std::string_view header, std::uint64_t size, ByteRange& range) {
+    constexpr std::string_view prefix = "bytes=";
+    if (!header.starts_with(prefix) || header.find(',') != std::string_view::npos) {
+        return RangeStatus::FULL;
+    }
+    header.remove_prefix(prefix.size());
+    const auto dash = header.find('-');
+    if (dash == std::string_view::npos) {
+        return RangeStatus::FULL;
+    }
+
+    auto parse = [](std::string_view text, std::uint64_t& value) {
+        const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && ec == std::errc{} && ptr == text.data() + text.size();
+    };
+
+    const auto first_text = header.substr(0, dash);
+    const auto last_text = header.substr(dash + 1);
+    std::uint64_t first = 0;
+    std::uint64_t last = 0;
+    if (first_text.empty()) {
+        // bytes=-n: последние n байт
+        if (!parse(last_text, last)) {
+            return RangeStatus::FULL;
+        }
+        if (last == 0 || size == 0) {
+            return RangeStatus::UNSATISFIABLE;
+        }
+        range.size = std::min(last, size);
+        range.offset = size - range.size;
+        return RangeStatus::PARTIAL;
+    }
+
+    if (!parse(first_text, first) || (!last_text.empty() && (!parse(last_text, last) || last < first))) {
+        return RangeStatus::FULL;
+    }
+    if (first >= size) {
+        return RangeStatus::UNSATISFIABLE;
+    }
+    last = last_text.empty() ? size - 1 : std::min(last, size - 1);
+    range.offset = first;
+    range.size = last - first + 1;
+    return RangeStatus::PARTIAL;
+}
+
+}  // namespace router
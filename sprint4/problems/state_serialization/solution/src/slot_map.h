@@ -0,0 +1,146 @@
+#pragma once
+#include <cassert>
+#include <compare>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+/**
+ * Плотное хранилище со стабильными дескрипторами.
+ * Элементы лежат в векторе подряд, поэтому их можно быстро перебирать.
+ * Дескриптор ссылается на слот, в котором записаны текущая позиция элемента
+ * и поколение слота. При удалении на место элемента переносится последний,
+ * а поколение слота увеличивается, поэтому старые дескрипторы перестают действовать.
+ */
+template <typename T>
+class SlotMap {
+public:
+    struct Handle {
+        std::uint32_t slot = 0;
+        std::uint32_t generation = 0;
+
+        auto operator<=>(const Handle&) const = default;
+    };
+
+    using Values = std::vector<T>;
+    using iterator = typename Values::iterator;
+    using const_iterator = typename Values::const_iterator;
+
+    Handle Insert(T value) {
+        std::uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = static_cast<std::uint32_t>(slots_.size());
+            slots_.push_back(Slot{});
+        }
+
+        slots_[slot].position = static_cast<std::uint32_t>(values_.size());
+        values_.push_back(std::move(value));
+        position_to_slot_.push_back(slot);
+        return Handle{slot, slots_[slot].generation};
+    }
+
+    bool Erase(Handle handle) {
+        if (!Contains(handle)) {
+            return false;
+        }
+
+        const auto position = slots_[handle.slot].position;
+        const auto last = static_cast<std::uint32_t>(values_.size() - 1);
+        if (position != last) {
+            values_[position] = std::move(values_[last]);
+            position_to_slot_[position] = position_to_slot_[last];
+            slots_[position_to_slot_[position]].position = position;
+        }
+        values_.pop_back();
+        position_to_slot_.pop_back();
+
+        ++slots_[handle.slot].generation;
+        free_slots_.push_back(handle.slot);
+        return true;
+    }
+
+    bool Contains(Handle handle) const noexcept {
+        return handle.slot < slots_.size() && slots_[handle.slot].generation == handle.generation;
+    }
+
+    T* Find(Handle handle) noexcept {
+        return Contains(handle) ? &values_[slots_[handle.slot].position] : nullptr;
+    }
+
+    const T* Find(Handle handle) const noexcept {
+        return Contains(handle) ? &values_[slots_[handle.slot].position] : nullptr;
+    }
+
+    // Доступ по позиции в плотном массиве
+    T& operator[](size_t position) noexcept {
+        assert(position < values_.size());
+        return values_[position];
+    }
+
+    const T& operator[](size_t position) const noexcept {
+        assert(position < values_.size());
+        return values_[position];
+    }
+
+    Handle GetHandle(size_t position) const noexcept {
+        assert(position < values_.size());
+        const auto slot = position_to_slot_[position];
+        return Handle{slot, slots_[slot].generation};
+    }
+
+    size_t Size() const noexcept {
+        return values_.size();
+    }
+
+    bool Empty() const noexcept {
+        return values_.empty();
+    }
+
+    void Reserve(size_t size) {
+        values_.reserve(size);
+        position_to_slot_.reserve(size);
+        slots_.reserve(size);
+    }
+
+    void Clear() {
+        for (auto slot : position_to_slot_) {
+            ++slots_[slot].generation;
+            free_slots_.push_back(slot);
+        }
+        values_.clear();
+        position_to_slot_.clear();
+    }
+
+    iterator begin() noexcept {
+        return values_.begin();
+    }
+
+    iterator end() noexcept {
+        return values_.end();
+    }
+
+    const_iterator begin() const noexcept {
+        return values_.begin();
+    }
+
+    const_iterator end() const noexcept {
+        return values_.end();
+    }
+
+private:
+    struct Slot {
+        std::uint32_t position = 0;
+        std::uint32_t generation = 0;
+    };
+
+    Values values_;
+    std::vector<std::uint32_t> position_to_slot_;
+    std::vector<Slot> slots_;
+    std::vector<std::uint32_t> free_slots_;
+};
+
+}  // namespace util
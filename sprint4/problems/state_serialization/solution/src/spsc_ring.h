@@ -0,0 +1,76 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+namespace util {
+
+/*
+ * Кольцевой буфер байт без блокировок: один писатель, один читатель.
+ * Позиции только растут, в буфер они попадают по маске, поэтому ёмкость — степень двойки.
+ * TryWrite копирует запись целиком или не копирует вовсе. Читатель получает непрочитанные
+ * байты одним или двумя кусками (второй — если байты переходят через конец буфера),
+ * например чтобы отдать их в writev без копирования, и освобождает их вызовом Consume
+ */
+class SpscByteRing {
+public:
+    explicit SpscByteRing(size_t capacity)
+        : buffer_(std::make_unique<char[]>(capacity))
+        , mask_(capacity - 1) {
+        assert(capacity >= 2 && (capacity & mask_) == 0);
+    }
+
+    SpscByteRing(const SpscByteRing&) = delete;
+    SpscByteRing& operator=(const SpscByteRing&) = delete;
+
+    // Вызывает только поток-писатель
+    bool TryWrite(std::string_view data) noexcept {
+        const size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+        const size_t read_pos = read_pos_.load(std::memory_order_acquire);
+        if (data.size() > Capacity() - (write_pos - read_pos)) {
+            return false;
+        }
+        const size_t offset = write_pos & mask_;
+        const size_t first = std::min(data.size(), Capacity() - offset);
+        std::memcpy(buffer_.get() + offset, data.data(), first);
+        std::memcpy(buffer_.get(), data.data() + first, data.size() - first);
+        write_pos_.store(write_pos + data.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Вызывает только поток-читатель. Байты остаются на месте до Consume
+    std::array<std::string_view, 2> Peek() const noexcept {
+        const size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+        const size_t size = write_pos_.load(std::memory_order_acquire) - read_pos;
+        const size_t offset = read_pos & mask_;
+        const size_t first = std::min(size, Capacity() - offset);
+        return {std::string_view(buffer_.get() + offset, first), std::string_view(buffer_.get(), size - first)};
+    }
+
+    void Consume(size_t size) noexcept {
+        read_pos_.store(read_pos_.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    // Приблизительное число непрочитанных байт: писатель и читатель могут менять его одновременно
+    size_t Size() const noexcept {
+        const size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+        return write_pos_.load(std::memory_order_relaxed) - read_pos;
+    }
+
+    size_t Capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+private:
+    std::unique_ptr<char[]> buffer_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> write_pos_{0};
+    alignas(64) std::atomic<size_t> read_pos_{0};
+};
+
+}  // namespace util
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "http_server.h"
+#include "model.h"
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace http_handler {
+
+/*
+ * Доставляет состояние сессий после тика: рассылает его подписчикам
+ * /api/v1/game/stream и отвечает на отложенные запросы /api/v1/game/state?wait=1.
+ * Состояние сериализуется один раз при публикации, все подписчики сессии
+ * получают один и тот же буфер
+ */
+class StateBroadcaster {
+public:
+    using Subscriber = std::shared_ptr<http_server::WebSocketSession>;
+    using Waiter = std::function<void()>;
+
+    // Отложенные запросы выполняются в executor, а не в потоке тика
+    explicit StateBroadcaster(boost::asio::any_io_executor executor)
+        : executor_(std::move(executor)) {
+    }
+
+    // Подписчик сразу получает текущее состояние сессии
+    void Subscribe(const model::GameSession& session, Subscriber subscriber) {
+        // Отправка под мьютексом: сообщения подписчика не обгоняют друг друга
+        std::lock_guard lock{mutex_};
+        if (auto snapshot = session.GetSnapshot()) {
+            subscriber->Send(std::move(snapshot));
+        }
+        subscribers_[&session].push_back(std::move(subscriber));
+    }
+
+    // waiter будет вызван после ближайшего тика
+    void Park(const model::GameSession& session, Waiter waiter) {
+        std::lock_guard lock{mutex_};
+        waiters_[&session].push_back(std::move(waiter));
+    }
+
+    /*
+     * Вызывается после тика. Отложенные запросы всех сессий отправляются
+     * в executor одной пачкой. Закрытые соединения забываются
+     */
+    void Broadcast() {
+        std::lock_guard lock{mutex_};
+        if (!waiters_.empty()) {
+            boost::asio::post(executor_, [waiters = std::exchange(waiters_, {})]() mutable {
+                for (auto& [session, session_waiters] : waiters) {
+                    for (auto& waiter : session_waiters) {
+                        waiter();
+                    }
+                }
+            });
+        }
+
+        for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+            auto& [session, subscribers] = *it;
+            const auto snapshot = session->GetSnapshot();
+            std::erase_if(subscribers, [&snapshot](const std::weak_ptr<http_server::WebSocketSession>& weak) {
+                auto subscriber = weak.lock();
+                if (!subscriber || !subscriber->IsOpen()) {
+                    return true;
+                }
+                subscriber->Send(snapshot);
+                return false;
+            });
+            it = subscribers.empty() ? subscribers_.erase(it) : std::next(it);
+        }
+    }
+
+    size_t GetWaiterCount() const {
+        std::lock_guard lock{mutex_};
+        size_t count = 0;
+        for (const auto& [session, session_waiters] : waiters_) {
+            count += session_waiters.size();
+        }
+        return count;
+    }
+
+    size_t GetSubscriberCount() const {
+        std::lock_guard lock{mutex_};
+        size_t count = 0;
+        for (const auto& [session, subscribers] : subscribers_) {
+            count += subscribers.size();
+        }
+        return count;
+    }
+
+private:
+    boost::asio::any_io_executor executor_;
+    mutable std::mutex mutex_;
+    std::unordered_map<const model::GameSession*, std::vector<Waiter>> waiters_;
+    // Соединение живёт, пока у него есть незавершённые операции, подписка его не продлевает
+    std::unordered_map<const model::GameSession*, std::vector<std::weak_ptr<http_server::WebSocketSession>>> subscribers_;
+};
+
+}  // namespace http_handler
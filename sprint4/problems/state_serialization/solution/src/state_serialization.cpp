@@ -111,7 +111,7 @@ AppState CaptureState(const Application& app) {
         }
 
         for (const auto& item : session->GetLostObjects()) {
-            session_state.loots.push_back(item.second);
+            session_state.loots.push_back(item);
         }
 
         state.sessions.push_back(std::move(session_state));
@@ -139,11 +139,7 @@ void ApplyState(Application& app, const AppState& state) {
         }
         session->ClearState();
 
-        std::unordered_map<int, model::LostObject> loots;
-        for (const auto& loot : session_state.loots) {
-            loots.emplace(static_cast<int>(loot.id), loot);
-        }
-        session->RestoreLostObjects(std::move(loots), session_state.next_loot_id);
+        session->RestoreLostObjects(session_state.loots, session_state.next_loot_id);
 
         for (const auto& dog_state : session_state.dogs) {
             session->RestoreDog(
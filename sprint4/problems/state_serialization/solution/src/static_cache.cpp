@@ -0,0 +1,306 @@
+#include "static_cache.h"
+
+#include "compression.h"
+#include "etag.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <array>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <sys/inotify.h>
+#endif
+
+namespace http_handler {
+
+std::string FormatHttpDate(fs::file_time_type time) {
+    const auto sys_time = std::chrono::file_clock::to_sys(time);
+    const std::time_t t = std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(sys_time));
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buffer[64];
+    const auto size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buffer, size);
+}
+
+std::string MakeFileEtag(std::uintmax_t size, fs::file_time_type modified) {
+    std::ostringstream etag;
+    etag << '"' << std::hex << modified.time_since_epoch().count() << '-' << size << '"';
+    return etag.str();
+}
+
+std::optional<std::string> DecodeUrlPath(std::string_view path) {
+    std::string result;
+    result.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (path[i] != '%') {
+            result.push_back(path[i]);
+            continue;
+        }
+        if (i + 2 >= path.size() || !std::isxdigit(static_cast<unsigned char>(path[i + 1]))
+            || !std::isxdigit(static_cast<unsigned char>(path[i + 2]))) {
+            return std::nullopt;
+        }
+        result.push_back(static_cast<char>(std::stoi(std::string(path.substr(i + 1, 2)), nullptr, 16)));
+        i += 2;
+    }
+    return result;
+}
+
+#ifdef __linux__
+
+// Читает события inotify в потоках io_context и обновляет кэш
+class StaticCache::Watcher : public std::enable_shared_from_this<Watcher> {
+public:
+    Watcher(net::io_context& ioc, StaticCache& cache)
+        : descriptor_(ioc)
+        , cache_(cache) {
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to initialize inotify");
+        }
+        descriptor_.assign(fd);
+    }
+
+    void AddDirectory(const fs::path& dir) {
+        constexpr auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+        const int wd = inotify_add_watch(descriptor_.native_handle(), dir.c_str(), mask);
+        if (wd >= 0) {
+            dirs_[wd] = dir;
+        }
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(dir, ec)) {
+            if (entry.is_directory(ec)) {
+                AddDirectory(entry.path());
+            }
+        }
+    }
+
+    void Start() {
+        Read();
+    }
+
+    void Stop() {
+        boost::system::error_code ec;
+        descriptor_.close(ec);
+    }
+
+private:
+    void Read() {
+        descriptor_.async_read_some(net::buffer(buffer_),
+            [self = shared_from_this()](boost::system::error_code ec, size_t size) {
+                if (ec) {
+                    return;
+                }
+                self->HandleEvents(size);
+                self->Read();
+            });
+    }
+
+    void HandleEvents(size_t size) {
+        for (size_t offset = 0; offset < size;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer_.data() + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_IGNORED) {
+                // Ядро сняло наблюдение: каталог удалён
+                dirs_.erase(event->wd);
+                continue;
+            }
+            auto dir = dirs_.find(event->wd);
+            if (dir == dirs_.end() || event->len == 0) {
+                continue;
+            }
+            const fs::path path = dir->second / event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddDirectory(path);
+                    cache_.LoadDirectory(path);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    RemoveDirectory(path);
+                    cache_.RemoveDirectory(path);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                cache_.LoadFile(path);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                cache_.RemoveFile(path);
+            }
+        }
+    }
+
+    // Перенесённый в другое место каталог ядро продолжает отслеживать, поэтому наблюдение снимается явно
+    void RemoveDirectory(const fs::path& dir) {
+        for (auto it = dirs_.begin(); it != dirs_.end();) {
+            if (IsInside(it->second, dir)) {
+                inotify_rm_watch(descriptor_.native_handle(), it->first);
+                it = dirs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static bool IsInside(const fs::path& path, const fs::path& dir) {
+        const auto relative = path.lexically_relative(dir);
+        return !relative.empty() && *relative.begin() != "..";
+    }
+
+    net::posix::stream_descriptor descriptor_;
+    StaticCache& cache_;
+    std::unordered_map<int, fs::path> dirs_;
+    alignas(inotify_event) std::array<char, 64 * 1024> buffer_;
+};
+
+#else
+
+class StaticCache::Watcher {
+public:
+    void Stop() {
+    }
+};
+
+#endif
+
+StaticCache::StaticCache(fs::path root, std::uintmax_t max_file_size)
+    : root_(fs::weakly_canonical(root))
+    , max_file_size_(max_file_size) {
+    LoadDirectory(root_);
+}
+
+StaticCache::~StaticCache() {
+    if (watcher_) {
+        watcher_->Stop();
+    }
+}
+
+std::shared_ptr<const StaticAsset> StaticCache::Find(std::string_view target) const {
+    target = target.substr(0, target.find('?'));
+    const auto path = DecodeUrlPath(target);
+    if (!path) {
+        return nullptr;
+    }
+
+    std::shared_lock lock{mutex_};
+    if (auto it = assets_.find(*path); it != assets_.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+size_t StaticCache::Size() const {
+    std::shared_lock lock{mutex_};
+    return assets_.size();
+}
+
+void StaticCache::Watch([[maybe_unused]] net::io_context& ioc) {
+#ifdef __linux__
+    if (watcher_) {
+        return;
+    }
+    auto watcher = std::make_shared<Watcher>(ioc, *this);
+    watcher->AddDirectory(root_);
+    watcher->Start();
+    watcher_ = std::move(watcher);
+#endif
+}
+
+void StaticCache::LoadDirectory(const fs::path& dir) {
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            LoadFile(it->path());
+        }
+    }
+}
+
+void StaticCache::LoadFile(const fs::path& file) {
+    std::error_code ec;
+    const auto size = fs::file_size(file, ec);
+    if (ec || size > max_file_size_) {
+        return RemoveFile(file);
+    }
+    const auto modified = fs::last_write_time(file, ec);
+    if (ec) {
+        return RemoveFile(file);
+    }
+
+    std::ifstream in(file, std::ios::binary);
+    std::string body{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    if (!in && !in.eof()) {
+        return RemoveFile(file);
+    }
+
+    auto asset = std::make_shared<StaticAsset>();
+    asset->path = file;
+    asset->content_type = ContentType::GetContentTypeByFileExtension(file);
+    asset->etag = util::MakeEtag(body);
+    asset->last_modified = FormatHttpDate(modified);
+    if (ContentType::IsCompressible(asset->content_type) && !body.empty()) {
+        auto gzip = compression::Gzip(body);
+        if (compression::IsWorthStoring(gzip.size(), body.size())) {
+            asset->gzip_etag = util::MakeEtag(body, "-gz");
+            asset->gzip_body = std::make_shared<const std::string>(std::move(gzip));
+        }
+    }
+    asset->body = std::make_shared<const std::string>(std::move(body));
+
+    std::shared_ptr<const StaticAsset> shared_asset = std::move(asset);
+    std::unique_lock lock{mutex_};
+    for (auto& key : MakeKeys(file)) {
+        assets_[std::move(key)] = shared_asset;
+    }
+}
+
+void StaticCache::RemoveFile(const fs::path& file) {
+    std::unique_lock lock{mutex_};
+    for (const auto& key : MakeKeys(file)) {
+        assets_.erase(key);
+    }
+}
+
+void StaticCache::RemoveDirectory(const fs::path& dir) {
+    const auto relative = dir.lexically_relative(root_).generic_string();
+    if (relative.empty() || relative.starts_with("..")) {
+        return;
+    }
+    if (relative == ".") {
+        std::unique_lock lock{mutex_};
+        assets_.clear();
+        return;
+    }
+    // Ключи файлов каталога начинаются с "/dir/", а его index.html доступен ещё и как "/dir"
+    const auto prefix = "/" + relative + "/";
+    std::unique_lock lock{mutex_};
+    assets_.erase(prefix.substr(0, prefix.size() - 1));
+    std::erase_if(assets_, [&prefix](const auto& item) {
+        return item.first.starts_with(prefix);
+    });
+}
+
+std::vector<std::string> StaticCache::MakeKeys(const fs::path& file) const {
+    const auto relative = file.lexically_relative(root_);
+    std::vector<std::string> keys{"/" + relative.generic_string()};
+    // Каталог отдаётся своим index.html, с завершающим слэшем и без него
+    if (relative.filename() == "index.html") {
+        const auto dir = relative.parent_path().generic_string();
+        if (dir.empty()) {
+            keys.emplace_back("/");
+        } else {
+            keys.push_back("/" + dir);
+            keys.push_back("/" + dir + "/");
+        }
+    }
+    return keys;
+}
+
+}  // namespace http_handler
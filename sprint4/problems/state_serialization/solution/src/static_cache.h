@@ -0,0 +1,115 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace http_handler {
+
+namespace fs = std::filesystem;
+namespace net = boost::asio;
+
+struct ContentType {
+    constexpr static std::string_view TEXT_HTML = "text/html";
+    constexpr static std::string_view TEXT_CSS = "text/css";
+    constexpr static std::string_view TEXT_PLAIN = "text/plain";
+    constexpr static std::string_view TEXT_JAVASCRIPT = "text/javascript";
+    constexpr static std::string_view APPLICATION_JSON = "application/json";
+    constexpr static std::string_view APPLICATION_OCTET_STREAM = "application/octet-stream";
+
+    static std::string_view GetContentTypeByFileExtension(fs::path file_path) {
+        static const std::unordered_map<std::string, std::string_view> types = {
+            {".htm", TEXT_HTML}, {".html", TEXT_HTML},
+            {".css", TEXT_CSS}, {".txt", TEXT_PLAIN},
+            {".js", TEXT_JAVASCRIPT}, {".json", APPLICATION_JSON},
+            {".png", "image/png"}, {".jpg", "image/jpeg"}, {".jpeg", "image/jpeg"},
+            {".gif", "image/gif"}, {".bmp", "image/bmp"}
+        };
+
+        std::string ext = file_path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+        if (auto it = types.find(ext); it != types.end()) {
+            return it->second;
+        }
+        return APPLICATION_OCTET_STREAM;
+    }
+
+    // Имеет ли смысл сжимать данные такого типа
+    static bool IsCompressible(std::string_view content_type) noexcept {
+        return content_type.starts_with("text/") || content_type == APPLICATION_JSON;
+    }
+};
+
+// Дата в формате HTTP: "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(fs::file_time_type time);
+
+// Путь из URL с раскодированными %XX. nullopt, если последовательность %XX некорректна
+std::optional<std::string> DecodeUrlPath(std::string_view path);
+
+// ETag файла, который не загружается в память, по его размеру и времени изменения
+std::string MakeFileEtag(std::uintmax_t size, fs::file_time_type modified);
+
+// Файл статики, загруженный в память. После создания не меняется
+struct StaticAsset {
+    fs::path path;
+    std::shared_ptr<const std::string> body;
+    // Сжатый gzip вариант, если он заметно меньше исходного
+    std::shared_ptr<const std::string> gzip_body;
+    std::string_view content_type;
+    std::string etag;
+    std::string gzip_etag;
+    std::string last_modified;
+};
+
+/*
+ * Кэш файлов статики, заполняемый при запуске.
+ * Ключ — путь в URL: "/assets/app.js", а для index.html ещё и путь каталога.
+ * Файлы крупнее max_file_size не кэшируются, их отдают с диска потоком
+ */
+class StaticCache {
+public:
+    constexpr static std::uintmax_t DEFAULT_MAX_FILE_SIZE = 4 * 1024 * 1024;
+
+    explicit StaticCache(fs::path root, std::uintmax_t max_file_size = DEFAULT_MAX_FILE_SIZE);
+
+    StaticCache(const StaticCache&) = delete;
+    StaticCache& operator=(const StaticCache&) = delete;
+
+    ~StaticCache();
+
+    // target — путь из запроса, без разбора строки запроса и URL-кодирования
+    std::shared_ptr<const StaticAsset> Find(std::string_view target) const;
+
+    size_t Size() const;
+
+    // Начинает следить за каталогом через inotify и обновлять кэш при изменениях файлов.
+    // Вне Linux ничего не делает
+    void Watch(net::io_context& ioc);
+
+private:
+    class Watcher;
+
+    void LoadDirectory(const fs::path& dir);
+    void LoadFile(const fs::path& file);
+    void RemoveFile(const fs::path& file);
+    // Убирает все файлы каталога и его подкаталогов
+    void RemoveDirectory(const fs::path& dir);
+    std::vector<std::string> MakeKeys(const fs::path& file) const;
+
+    fs::path root_;
+    std::uintmax_t max_file_size_;
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> assets_;
+    std::shared_ptr<Watcher> watcher_;
+};
+
+}  // namespace http_handler
@@ -1,23 +1,103 @@
 #pragma once
 
+#include "json_logger.h"
+#include "metrics.h"
+
 #include <boost/asio/strand.hpp>
 #include <boost/beast.hpp>
+#include <boost/json.hpp>
+
+#include <exception>
+#include <optional>
+#include <string_view>
 
 namespace http_handler {
 
 namespace net = boost::asio;
 namespace sys = boost::system;
 
+/*
+ * Как догонять реальное время, если тик запустился позже срока.
+ * Дробить долгий тик на короткие шаги — дело Application (--sim-step): там шаги
+ * выполняются под одной блокировкой с одной публикацией состояния на тик
+ */
+enum class CatchUpPolicy {
+    // Один тик на всё прошедшее время, как было всегда
+    SINGLE_DELTA,
+    // Один тик длиной в период, пропущенные тики теряются
+    SKIP
+};
+
+inline std::string_view GetCatchUpPolicyName(CatchUpPolicy policy) noexcept {
+    switch (policy) {
+        case CatchUpPolicy::SKIP:
+            return "skip";
+        case CatchUpPolicy::SINGLE_DELTA:
+            break;
+    }
+    return "single";
+}
+
+inline std::optional<CatchUpPolicy> ParseCatchUpPolicy(std::string_view name) noexcept {
+    for (auto policy : {CatchUpPolicy::SINGLE_DELTA, CatchUpPolicy::SKIP}) {
+        if (GetCatchUpPolicyName(policy) == name) {
+            return policy;
+        }
+    }
+    return std::nullopt;
+}
+
+// Что выполнить в очередном тике
+struct TickPlan {
+    // Вызывается ли обработчик и с каким временем
+    bool run = false;
+    std::chrono::milliseconds step{0};
+    // Пропущенные тики длиной в период
+    unsigned skipped = 0;
+    // На сколько продвигается учтённое время: выполненный и пропущенные тики
+    std::chrono::milliseconds consumed{0};
+};
+
+/*
+ * elapsed — время, ещё не переданное обработчику. В режиме SKIP
+ * остаток меньше периода переходит в следующий тик
+ */
+constexpr TickPlan PlanTick(std::chrono::milliseconds elapsed, std::chrono::milliseconds period, CatchUpPolicy policy) {
+    TickPlan plan;
+    if (policy == CatchUpPolicy::SINGLE_DELTA || period.count() <= 0) {
+        plan.run = true;
+        plan.step = elapsed;
+        plan.consumed = elapsed;
+        return plan;
+    }
+    const auto periods = static_cast<unsigned>(elapsed / period);
+    if (periods == 0) {
+        return plan;
+    }
+    plan.run = true;
+    plan.step = period;
+    plan.skipped = periods - 1;
+    plan.consumed = period * periods;
+    return plan;
+}
+
 class Ticker : public std::enable_shared_from_this<Ticker> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
     using Handler = std::function<void(std::chrono::milliseconds delta)>;
 
-    // Функция handler будет вызываться внутри strand с интервалом period
-    Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
+    /*
+     * Функция handler будет вызываться внутри strand с интервалом period.
+     * Тик, который длится дольше периода, считается перерасходом: он пишется в лог и в метрики,
+     * а отставание от реального времени наверстывается по политике policy
+     */
+    Ticker(Strand strand, std::chrono::milliseconds period, Handler handler,
+           CatchUpPolicy policy = CatchUpPolicy::SINGLE_DELTA)
         : strand_{strand}
         , period_{period}
-        , handler_{std::move(handler)} {
+        , handler_{std::move(handler)}
+        , policy_{policy}
+        , metrics_{MakeMetrics()} {
     }
 
     void Start() {
@@ -31,9 +111,29 @@ public:
     }
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Metrics {
+        metrics::Histogram& duration;
+        metrics::Histogram& lag;
+        metrics::Counter& overruns;
+        metrics::Counter& skipped;
+        metrics::Counter& failures;
+    };
+
+    static Metrics MakeMetrics() {
+        auto& registry = metrics::Registry::GetInstance();
+        return {registry.GetHistogram("ticker_tick_duration_seconds", "Wall time of a ticker tick"),
+                registry.GetHistogram("ticker_lag_seconds", "How late the ticker timer fired"),
+                registry.GetCounter("ticker_overruns_total", "Ticks that took longer than the tick period"),
+                registry.GetCounter("ticker_skipped_ticks_total", "Tick periods dropped by the catch-up policy"),
+                registry.GetCounter("ticker_failures_total", "Ticks that ended with an exception")};
+    }
+
+    // Следующий тик — через период после учтённого времени, поэтому задержки не копятся
     void ScheduleTick() {
         assert(strand_.running_in_this_thread());
-        timer_.expires_after(period_);
+        timer_.expires_at(last_tick_ + period_);
         timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
             self->OnTick(ec);
         });
@@ -43,25 +143,58 @@ private:
         using namespace std::chrono;
         assert(strand_.running_in_this_thread());
 
-        if (!ec) {
-            auto this_tick = Clock::now();
-            auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
-            last_tick_ = this_tick;
-            try {
-                handler_(delta);
-            } catch (...) {
-            }
-            ScheduleTick();
+        if (ec) {
+            return;
+        }
+        const auto start = Clock::now();
+        const auto lag = start - (last_tick_ + period_);
+        metrics_.lag.Record(lag);
+
+        const auto plan = PlanTick(duration_cast<milliseconds>(start - last_tick_), period_, policy_);
+        last_tick_ += plan.consumed;
+        metrics_.skipped.Increment(plan.skipped);
+        if (plan.run) {
+            Run(plan.step);
         }
+
+        const auto duration = Clock::now() - start;
+        metrics_.duration.Record(duration);
+        if (duration > period_) {
+            metrics_.overruns.Increment();
+            json_logger::LogData("tick overrun", boost::json::object{
+                {"duration_us", duration_cast<microseconds>(duration).count()},
+                {"period_ms", period_.count()},
+                {"lag_us", duration_cast<microseconds>(lag).count()},
+                {"skipped", plan.skipped},
+                {"policy", GetCatchUpPolicyName(policy_)}});
+        }
+        ScheduleTick();
     }
 
-    using Clock = std::chrono::steady_clock;
+    // Ошибка тика не останавливает таймер, но пишется в лог
+    void Run(std::chrono::milliseconds delta) {
+        try {
+            handler_(delta);
+        } catch (const std::exception& ex) {
+            ReportFailure(ex.what());
+        } catch (...) {
+            ReportFailure("unknown exception");
+        }
+    }
+
+    void ReportFailure(std::string_view what) {
+        metrics_.failures.Increment();
+        json_logger::LogData("tick failed", boost::json::object{{"exception", what}});
+    }
 
     Strand strand_;
     std::chrono::milliseconds period_;
     net::steady_timer timer_{strand_};
     Handler handler_;
-    std::chrono::steady_clock::time_point last_tick_;
+    CatchUpPolicy policy_;
+    Metrics metrics_;
+    // До этого момента реальное время уже передано обработчику или пропущено
+    Clock::time_point last_tick_;
 };
 
-} //namespace http_handler
\ No newline at end of file
+} //namespace http_handler
@@ -0,0 +1,124 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <stdexcept>
+
+#include "../src/access_log.h"
+#include "../src/json_logger.h"
+
+using namespace std::literals;
+using access_log::EndpointClass;
+namespace http = boost::beast::http;
+namespace net = boost::asio;
+
+namespace {
+
+access_log::ResponseInfo MakeResponse(unsigned status, std::chrono::microseconds latency = {}) {
+    return {status, "application/json"sv, 0, latency};
+}
+
+}  // namespace
+
+TEST_CASE("Requests are classified by endpoint", "[AccessLog]") {
+    CHECK(access_log::ClassifyRequest(http::verb::get, "/index.html") == EndpointClass::STATIC);
+    CHECK(access_log::ClassifyRequest(http::verb::get, "/") == EndpointClass::STATIC);
+    CHECK(access_log::ClassifyRequest(http::verb::get, "/api/v1/game/state?since=3") == EndpointClass::POLL);
+    CHECK(access_log::ClassifyRequest(http::verb::head, "/api/v1/game/players") == EndpointClass::POLL);
+    CHECK(access_log::ClassifyRequest(http::verb::post, "/api/v1/game/join") == EndpointClass::API);
+    CHECK(access_log::ClassifyRequest(http::verb::get, "/api/v1/maps/map1") == EndpointClass::API);
+    CHECK(access_log::ClassifyRequest(http::verb::get, "/api/v2/unknown") == EndpointClass::API);
+}
+
+TEST_CASE("Sample rates are parsed from class=rate", "[AccessLog]") {
+    access_log::Options options;
+    access_log::SetSampleRate(options, "poll=0.01");
+    access_log::SetSampleRate(options, "static=0");
+    CHECK(options.sample_rates[static_cast<size_t>(EndpointClass::POLL)] == 0.01);
+    CHECK(options.sample_rates[static_cast<size_t>(EndpointClass::STATIC)] == 0.0);
+    CHECK(options.sample_rates[static_cast<size_t>(EndpointClass::API)] == 1.0);
+
+    CHECK_THROWS_AS(access_log::SetSampleRate(options, "poll"), std::invalid_argument);
+    CHECK_THROWS_AS(access_log::SetSampleRate(options, "maps=0.5"), std::invalid_argument);
+    CHECK_THROWS_AS(access_log::SetSampleRate(options, "api=1.5"), std::invalid_argument);
+    CHECK_THROWS_AS(access_log::SetSampleRate(options, "api=half"), std::invalid_argument);
+}
+
+TEST_CASE("Client address comes from X-Forwarded-For only when trusted", "[AccessLog]") {
+    const auto remote = net::ip::make_address("10.0.0.1");
+    CHECK(access_log::GetClientAddress(remote, "203.0.113.7, 10.0.0.1", false) == remote);
+    CHECK(access_log::GetClientAddress(remote, " 203.0.113.7 , 10.0.0.1", true)
+          == net::ip::make_address("203.0.113.7"));
+    CHECK(access_log::GetClientAddress(remote, "2001:db8::1", true) == net::ip::make_address("2001:db8::1"));
+    CHECK(access_log::GetClientAddress(remote, "", true) == remote);
+    CHECK(access_log::GetClientAddress(remote, "unknown", true) == remote);
+}
+
+TEST_CASE("Errors and slow requests bypass sampling", "[AccessLog]") {
+    access_log::Options options;
+    options.sample_rates = {0.0, 1.0, 0.0};
+    options.slow_threshold = std::chrono::milliseconds{50};
+    const access_log::AccessLog log{options};
+
+    CHECK_FALSE(log.ShouldLog(EndpointClass::POLL, MakeResponse(200)));
+    CHECK_FALSE(log.ShouldLog(EndpointClass::STATIC, MakeResponse(304)));
+    CHECK(log.ShouldLog(EndpointClass::API, MakeResponse(200)));
+    CHECK(log.ShouldLog(EndpointClass::POLL, MakeResponse(401)));
+    CHECK(log.ShouldLog(EndpointClass::STATIC, MakeResponse(500)));
+    CHECK(log.ShouldLog(EndpointClass::POLL, MakeResponse(200, std::chrono::milliseconds{50})));
+}
+
+TEST_CASE("Successful requests are sampled at the class rate", "[AccessLog]") {
+    access_log::Options options;
+    options.sample_rates = {1.0, 1.0, 0.1};
+    const access_log::AccessLog log{options};
+
+    constexpr int REQUESTS = 100'000;
+    int logged = 0;
+    for (int i = 0; i < REQUESTS; ++i) {
+        logged += log.ShouldLog(EndpointClass::POLL, MakeResponse(200));
+    }
+    CHECK(logged > REQUESTS / 10 - 1000);
+    CHECK(logged < REQUESTS / 10 + 1000);
+}
+
+TEST_CASE("Access log record holds one request and its response", "[AccessLog]") {
+    const access_log::RequestInfo request{net::ip::make_address("192.0.2.10"), http::verb::get,
+                                          "/api/v1/game/state?q=\"x\"\\"};
+    std::string data;
+    access_log::AccessLog::AppendData(data, request,
+                                      {200, "application/json"sv, 512, std::chrono::microseconds{1234}});
+    CHECK(data
+          == R"({"ip":"192.0.2.10","method":"GET","URI":"/api/v1/game/state?q=\"x\"\\","class":"poll",)"
+             R"("code":200,"content_type":"application/json","bytes":512,"response_time_us":1234})");
+
+    data.clear();
+    const access_log::RequestInfo upgrade{net::ip::make_address("::1"), http::verb::get, "/api/v1/game/stream"};
+    access_log::AccessLog::AppendData(data, upgrade, {101, {}, 0, std::chrono::microseconds{7}});
+    CHECK(data
+          == R"({"ip":"::1","method":"GET","URI":"/api/v1/game/stream","class":"api",)"
+             R"("code":101,"content_type":null,"bytes":0,"response_time_us":7})");
+}
+
+TEST_CASE("Long targets are truncated", "[AccessLog]") {
+    const std::string target = "/" + std::string(1000, 'a');
+    const access_log::RequestInfo request{net::ip::make_address("127.0.0.1"), http::verb::get, target};
+    CHECK(request.GetTarget() == std::string_view(target).substr(0, access_log::RequestInfo::MAX_TARGET_SIZE));
+}
+
+TEST_CASE("JSON strings escape quotes, backslashes and control characters", "[AccessLog]") {
+    std::string out;
+    json_logger::AppendJsonString(out, "a\"b\\c\nd\x01");
+    CHECK(out == R"("a\"b\\c\nd\u0001")");
+}
+
+TEST_CASE("Access log formatting benchmark", "[AccessLog][!benchmark]") {
+    const access_log::RequestInfo request{net::ip::make_address("192.0.2.10"), http::verb::get,
+                                          "/api/v1/game/state"};
+    const access_log::ResponseInfo response{200, "application/json"sv, 512, std::chrono::microseconds{1234}};
+    std::string data;
+    BENCHMARK("format record") {
+        data.clear();
+        access_log::AccessLog::AppendData(data, request, response);
+        return data.size();
+    };
+}
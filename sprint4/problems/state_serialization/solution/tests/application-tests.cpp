@@ -0,0 +1,99 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/application.h"
+#include "../src/router.h"
+#include "game-fixtures.h"
+
+using compression::Encoding;
+
+namespace {
+
+Application::PreparedBody MakePreparedBody(bool gzip, bool deflate) {
+    Application::PreparedBody prepared;
+    prepared.body = std::make_shared<const std::string>("body");
+    prepared.etag = R"("plain")";
+    if (gzip) {
+        prepared.gzip_body = std::make_shared<const std::string>("gzip");
+        prepared.gzip_etag = R"("plain-gz")";
+    }
+    if (deflate) {
+        prepared.deflate_body = std::make_shared<const std::string>("deflate");
+        prepared.deflate_etag = R"("plain-df")";
+    }
+    return prepared;
+}
+
+// Проигрывает одну и ту же игру на нескольких картах и возвращает состояния сессий после каждого тика
+std::vector<std::string> PlayGame(unsigned tick_threads) {
+    model::Game game;
+    for (const auto* id : {"a", "b", "c", "d"}) {
+        game.AddMap(fixtures::MakeGridMap(id));
+    }
+    game.SetRandomSeed(42);
+    Application app{std::move(game)};
+    app.SetTickThreads(tick_threads);
+
+    std::vector<std::string> tokens;
+    for (int i = 0; i < 20; ++i) {
+        const auto joined = app.JoinGame("dog" + std::to_string(i), std::string(1, "abcd"[i % 4]));
+        tokens.emplace_back(joined.as_object().at("authToken").as_string());
+    }
+
+    std::mt19937 gen{7};
+    const char* dirs[] = {"U", "D", "L", "R", ""};
+    std::vector<std::string> states;
+    for (int tick = 0; tick < 50; ++tick) {
+        for (const auto& token : tokens) {
+            app.ActionPlayer(token, dirs[gen() % 5]);
+        }
+        app.Tick(std::chrono::milliseconds{gen() % 300 + 1});
+        for (const auto* session : app.GetGame().GetSessions()) {
+            states.push_back(*session->GetSnapshot());
+        }
+    }
+    return states;
+}
+
+}  // namespace
+
+TEST_CASE("Prepared body falls back to identity without the requested variant", "[Application]") {
+    const auto both = MakePreparedBody(true, true);
+    CHECK(both.SelectEncoding(Encoding::GZIP) == Encoding::GZIP);
+    CHECK(both.SelectEncoding(Encoding::DEFLATE) == Encoding::DEFLATE);
+    CHECK(both.SelectEncoding(Encoding::IDENTITY) == Encoding::IDENTITY);
+
+    const auto gzip_only = MakePreparedBody(true, false);
+    CHECK(gzip_only.SelectEncoding(Encoding::DEFLATE) == Encoding::IDENTITY);
+    const auto deflate_only = MakePreparedBody(false, true);
+    CHECK(deflate_only.SelectEncoding(Encoding::GZIP) == Encoding::IDENTITY);
+}
+
+TEST_CASE("Not modified compares the tag of the variant being sent", "[Application]") {
+    const auto prepared = MakePreparedBody(true, true);
+    CHECK(*prepared.GetBody(Encoding::GZIP) == "gzip");
+    CHECK(*prepared.GetBody(Encoding::DEFLATE) == "deflate");
+    CHECK(*prepared.GetBody(Encoding::IDENTITY) == "body");
+
+    // Клиент с закэшированным gzip-вариантом получает 304 только за gzip
+    const auto if_none_match = R"(W/"plain-gz")";
+    CHECK(router::MatchesEtag(if_none_match, prepared.GetEtag(Encoding::GZIP)));
+    CHECK_FALSE(router::MatchesEtag(if_none_match, prepared.GetEtag(Encoding::DEFLATE)));
+    CHECK_FALSE(router::MatchesEtag(if_none_match, prepared.GetEtag(Encoding::IDENTITY)));
+
+    // Выбор сжатия по Accept-Encoding и наличию варианта определяет, с каким тегом сравнивать
+    const auto encoding = prepared.SelectEncoding(router::NegotiateEncoding("gzip;q=0.5, deflate"));
+    CHECK(prepared.GetEtag(encoding) == R"("plain-df")");
+    CHECK(router::MatchesEtag(R"("a", "plain-df")", prepared.GetEtag(encoding)));
+}
+
+TEST_CASE("Parallel tick publishes the same states as the serial one", "[Application]") {
+    const auto serial = PlayGame(1);
+    const auto parallel = PlayGame(4);
+    REQUIRE(serial.size() == 50 * 4);
+    CHECK(serial == parallel);
+}
@@ -0,0 +1,174 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/async_logger.h"
+#include "../src/spsc_ring.h"
+
+using json_logger::AsyncLogger;
+using json_logger::OverflowPolicy;
+
+namespace {
+
+// Канал, содержимое которого читает отдельный поток
+class PipeReader {
+public:
+    PipeReader() {
+        REQUIRE(::pipe(fds_) == 0);
+    }
+
+    ~PipeReader() {
+        ::close(fds_[1]);
+        if (reader_.joinable()) {
+            reader_.join();
+        }
+        ::close(fds_[0]);
+    }
+
+    int GetWriteFd() const {
+        return fds_[1];
+    }
+
+    void Start() {
+        reader_ = std::thread([this] {
+            char buffer[4096];
+            for (ssize_t size; (size = ::read(fds_[0], buffer, sizeof(buffer))) > 0;) {
+                data_.append(buffer, size);
+            }
+        });
+    }
+
+    // Закрывает запись и возвращает всё прочитанное
+    std::string Finish() {
+        ::close(fds_[1]);
+        fds_[1] = ::open("/dev/null", O_WRONLY);
+        reader_.join();
+        return data_;
+    }
+
+private:
+    int fds_[2];
+    std::thread reader_;
+    std::string data_;
+};
+
+std::vector<std::string> SplitLines(const std::string& data) {
+    std::vector<std::string> lines;
+    std::istringstream in{data};
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+std::string MakeRecord(int thread, int index) {
+    return "{\"thread\":" + std::to_string(thread) + ",\"index\":" + std::to_string(index) + ",\"padding\":\""
+        + std::string(static_cast<size_t>(index % 40), 'x') + "\"}\n";
+}
+
+}  // namespace
+
+TEST_CASE("SpscByteRing hands out unread bytes across the wrap", "[AsyncLogger]") {
+    util::SpscByteRing ring{8};
+    CHECK(ring.TryWrite("abcde"));
+    CHECK_FALSE(ring.TryWrite("wxyz"));
+    CHECK(ring.Peek()[0] == "abcde");
+    CHECK(ring.Peek()[1].empty());
+
+    ring.Consume(4);
+    CHECK(ring.TryWrite("fghijk"));
+    CHECK(ring.Size() == 7);
+    auto parts = ring.Peek();
+    CHECK(parts[0] == "efgh");
+    CHECK(parts[1] == "ijk");
+    CHECK_FALSE(ring.TryWrite("zz"));
+
+    ring.Consume(7);
+    CHECK(ring.Size() == 0);
+    CHECK(ring.TryWrite("12345678"));
+}
+
+TEST_CASE("Blocking logger writes every record once and in thread order", "[AsyncLogger]") {
+    constexpr int THREADS = 4;
+    constexpr int RECORDS = 5000;
+    PipeReader pipe;
+    pipe.Start();
+
+    json_logger::AsyncLoggerStats stats;
+    {
+        AsyncLogger logger{pipe.GetWriteFd(), OverflowPolicy::BLOCK, 1024};
+        std::vector<std::thread> producers;
+        for (int t = 0; t < THREADS; ++t) {
+            producers.emplace_back([&logger, t] {
+                for (int i = 0; i < RECORDS; ++i) {
+                    logger.Write(MakeRecord(t, i));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        logger.Stop();
+        stats = logger.GetStats();
+    }
+
+    CHECK(stats.records == THREADS * RECORDS);
+    CHECK(stats.dropped == 0);
+    CHECK(stats.batches < stats.records);
+
+    const auto lines = SplitLines(pipe.Finish());
+    REQUIRE(lines.size() == THREADS * RECORDS);
+    std::vector<int> next(THREADS, 0);
+    for (const auto& line : lines) {
+        const int thread = line[10] - '0';
+        REQUIRE(line + "\n" == MakeRecord(thread, next[thread]));
+        ++next[thread];
+    }
+}
+
+TEST_CASE("Dropping logger counts records that did not fit", "[AsyncLogger]") {
+    constexpr int RECORDS = 20000;
+    PipeReader pipe;
+    AsyncLogger logger{pipe.GetWriteFd(), OverflowPolicy::DROP, 256};
+
+    // Пока канал никто не читает, поток записи встаёт, и кольцо переполняется
+    for (int i = 0; i < RECORDS; ++i) {
+        logger.Write(MakeRecord(0, i));
+    }
+    logger.Write(std::string(300, 'x'));
+
+    pipe.Start();
+    logger.Stop();
+    const auto stats = logger.GetStats();
+    CHECK(stats.dropped > 0);
+    CHECK(stats.records + stats.dropped == RECORDS + 1);
+    CHECK(SplitLines(pipe.Finish()).size() == stats.records);
+}
+
+TEST_CASE("Records written after Stop are written synchronously", "[AsyncLogger]") {
+    PipeReader pipe;
+    pipe.Start();
+    AsyncLogger logger{pipe.GetWriteFd()};
+    logger.Write(MakeRecord(0, 0));
+    logger.Stop();
+    logger.Write(MakeRecord(0, 1));
+    CHECK(pipe.Finish() == MakeRecord(0, 0) + MakeRecord(0, 1));
+}
+
+TEST_CASE("Async logger benchmark", "[AsyncLogger][!benchmark]") {
+    const int null_fd = ::open("/dev/null", O_WRONLY);
+    AsyncLogger logger{null_fd, OverflowPolicy::BLOCK};
+    const auto record = MakeRecord(0, 39);
+    BENCHMARK("write record") {
+        logger.Write(record);
+    };
+    logger.Stop();
+    ::close(null_fd);
+}
@@ -0,0 +1,264 @@
+#include <boost/json.hpp>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "../src/cbor_writer.h"
+#include "../src/extra_data.h"
+#include "../src/json_serializer.h"
+#include "../src/json_writer.h"
+#include "game-fixtures.h"
+
+using fixtures::FillSession;
+using fixtures::MakeGridMap;
+
+namespace {
+
+std::string ToHex(std::string_view bytes) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (unsigned char c : bytes) {
+        hex.push_back(digits[c >> 4]);
+        hex.push_back(digits[c & 0xf]);
+    }
+    return hex;
+}
+
+template <typename Write>
+std::string Encode(Write&& write) {
+    std::string out;
+    cbor_writer::CborWriter writer{out};
+    write(writer);
+    return ToHex(out);
+}
+
+std::uint64_t ReadArgument(std::string_view& in, std::uint8_t info) {
+    if (info < 24) {
+        return info;
+    }
+    const size_t bytes = size_t{1} << (info - 24);
+    std::uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = value << 8 | static_cast<unsigned char>(in[i]);
+    }
+    in.remove_prefix(bytes);
+    return value;
+}
+
+bool IsBreak(std::string_view in) {
+    return static_cast<unsigned char>(in.front()) == 0xff;
+}
+
+/*
+ * Разбирает подмножество CBOR, которое пишет CborWriter, в дерево boost::json.
+ * Целые ключи словарей становятся строками, как в JSON-ответах
+ */
+boost::json::value Decode(std::string_view& in) {
+    const auto head = static_cast<unsigned char>(in.front());
+    in.remove_prefix(1);
+    const std::uint8_t major = head >> 5;
+    const std::uint8_t info = head & 0x1f;
+    const bool indefinite = info == 31;
+
+    switch (major) {
+        case 0:
+            return ReadArgument(in, info);
+        case 1:
+            return -1 - static_cast<std::int64_t>(ReadArgument(in, info));
+        case 3: {
+            const auto size = ReadArgument(in, info);
+            boost::json::string text{in.substr(0, size)};
+            in.remove_prefix(size);
+            return text;
+        }
+        case 4: {
+            boost::json::array array;
+            const auto size = indefinite ? 0 : ReadArgument(in, info);
+            for (std::uint64_t i = 0; indefinite ? !IsBreak(in) : i < size; ++i) {
+                array.push_back(Decode(in));
+            }
+            if (indefinite) {
+                in.remove_prefix(1);
+            }
+            return array;
+        }
+        case 5: {
+            boost::json::object object;
+            const auto size = indefinite ? 0 : ReadArgument(in, info);
+            for (std::uint64_t i = 0; indefinite ? !IsBreak(in) : i < size; ++i) {
+                auto key = Decode(in);
+                auto value = Decode(in);
+                if (key.is_uint64()) {
+                    object[std::to_string(key.get_uint64())] = std::move(value);
+                } else {
+                    object[key.as_string()] = std::move(value);
+                }
+            }
+            if (indefinite) {
+                in.remove_prefix(1);
+            }
+            return object;
+        }
+        default:
+            break;
+    }
+
+    switch (head) {
+        case 0xf4:
+            return false;
+        case 0xf5:
+            return true;
+        case 0xfb:
+            return std::bit_cast<double>(ReadArgument(in, 27));
+        default:
+            return nullptr;
+    }
+}
+
+boost::json::value Decode(const std::string& bytes) {
+    std::string_view in = bytes;
+    auto value = Decode(in);
+    CHECK(in.empty());
+    return value;
+}
+
+}  // namespace
+
+TEST_CASE("CborWriter encodes items as in RFC 8949 appendix A", "[CborWriter]") {
+    CHECK(Encode([](auto& w) { w.Uint(0); }) == "00");
+    CHECK(Encode([](auto& w) { w.Uint(23); }) == "17");
+    CHECK(Encode([](auto& w) { w.Uint(24); }) == "1818");
+    CHECK(Encode([](auto& w) { w.Uint(1000); }) == "1903e8");
+    CHECK(Encode([](auto& w) { w.Uint(1000000); }) == "1a000f4240");
+    CHECK(Encode([](auto& w) { w.Uint(1000000000000); }) == "1b000000e8d4a51000");
+    CHECK(Encode([](auto& w) { w.Uint(18446744073709551615u); }) == "1bffffffffffffffff");
+    CHECK(Encode([](auto& w) { w.Int(-1); }) == "20");
+    CHECK(Encode([](auto& w) { w.Int(-1000); }) == "3903e7");
+    CHECK(Encode([](auto& w) { w.Int(std::numeric_limits<std::int64_t>::min()); }) == "3b7fffffffffffffff");
+    CHECK(Encode([](auto& w) { w.Double(1.1); }) == "fb3ff199999999999a");
+    CHECK(Encode([](auto& w) { w.Double(-4.1); }) == "fbc010666666666666");
+    CHECK(Encode([](auto& w) { w.Bool(false); }) == "f4");
+    CHECK(Encode([](auto& w) { w.Bool(true); }) == "f5");
+    CHECK(Encode([](auto& w) { w.Null(); }) == "f6");
+    CHECK(Encode([](auto& w) { w.String(""); }) == "60");
+    CHECK(Encode([](auto& w) { w.String("IETF"); }) == "6449455446");
+    CHECK(Encode([](auto& w) { w.String("ü"); }) == "62c3bc");
+
+    CHECK(Encode([](auto& w) {
+        w.BeginArray(3);
+        w.Uint(1);
+        w.BeginArray(2);
+        w.Uint(2);
+        w.Uint(3);
+        w.BeginArray(2);
+        w.Uint(4);
+        w.Uint(5);
+    }) == "8301820203820405");
+    CHECK(Encode([](auto& w) {
+        w.BeginMap(2);
+        w.String("a");
+        w.Uint(1);
+        w.String("b");
+        w.BeginArray(2);
+        w.Uint(2);
+        w.Uint(3);
+    }) == "a26161016162820203");
+    CHECK(Encode([](auto& w) {
+        w.BeginMap();
+        w.String("Fun");
+        w.Bool(true);
+        w.String("Amt");
+        w.Int(-2);
+        w.End();
+    }) == "bf6346756ef563416d7421ff");
+}
+
+TEST_CASE("CborWriter converts boost::json values", "[CborWriter]") {
+    const auto json = boost::json::parse(R"({"name":"key","file":"assets/key.obj","rotation":90,)"
+                                         R"("scale":0.03,"value":-10,"tags":[true,false,null]})");
+    std::string out;
+    cbor_writer::CborWriter writer{out};
+    writer.Value(json);
+    CHECK(Decode(out) == json);
+}
+
+TEST_CASE("Game state in CBOR has the JSON schema", "[CborWriter]") {
+    auto map = MakeGridMap();
+
+    SECTION("empty session") {
+        model::GameSession session{&map};
+        std::string out;
+        cbor_writer::WriteGameState(session, out);
+        CHECK(ToHex(out) == "a267706c6179657273a06b6c6f73744f626a65637473a0");
+    }
+
+    SECTION("session with dogs and loot") {
+        model::GameSession session{&map, model::GatherAlgorithm::GRID, 5};
+        FillSession(session, 50);
+        session.GetDogs().front()->SetCoord({1e-9, -0.0});
+
+        std::string out;
+        cbor_writer::WriteGameState(session, out);
+        CHECK(Decode(out) == json_writer::GameStateToJson(session));
+
+        std::string json;
+        json_writer::WriteGameState(session, json);
+        CHECK(out.size() < json.size());
+    }
+
+    SECTION("players") {
+        model::GameSession session{&map};
+        FillSession(session, 3);
+
+        std::string out;
+        cbor_writer::WritePlayers(session, out);
+        boost::json::object expected;
+        for (const auto* dog : session.GetDogs()) {
+            expected[std::to_string(dog->GetToken())] = boost::json::object{{"name", dog->GetNickname()}};
+        }
+        CHECK(Decode(out) == expected);
+    }
+}
+
+TEST_CASE("Map in CBOR has the JSON schema", "[CborWriter]") {
+    auto map = MakeGridMap();
+    extra_data::ExtraDataRepository::GetInstance().SetLootTypes(
+        map.GetId(), boost::json::parse(R"([{"name":"key","scale":0.03,"value":10},{"name":"wallet"}])").as_array());
+
+    std::string out;
+    cbor_writer::WriteMap(map, out);
+    CHECK(Decode(out) == boost::json::parse(json_serializer::SerializeMap(map)));
+}
+
+// Все способы записи состояния на одних и тех же сессиях
+TEST_CASE("Game state encoding benchmark", "[CborWriter][JsonWriter][!benchmark]") {
+    auto map = MakeGridMap();
+
+    for (int dog_count : {1000, 10000}) {
+        model::GameSession session{&map, model::GatherAlgorithm::GRID, 11};
+        FillSession(session, dog_count);
+        const auto suffix = " (" + std::to_string(dog_count) + " dogs)";
+
+        BENCHMARK("JSON DOM" + suffix) {
+            return boost::json::serialize(json_writer::GameStateToJson(session));
+        };
+
+        std::string buffer;
+        BENCHMARK("JSON writer" + suffix) {
+            buffer.clear();
+            json_writer::WriteGameState(session, buffer);
+            return buffer.size();
+        };
+
+        BENCHMARK("CBOR writer" + suffix) {
+            buffer.clear();
+            cbor_writer::WriteGameState(session, buffer);
+            return buffer.size();
+        };
+    }
+}
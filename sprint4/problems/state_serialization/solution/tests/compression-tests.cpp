@@ -0,0 +1,112 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <thread>
+
+#include <zlib.h>
+
+#include "../src/compression.h"
+
+using compression::Encoding;
+
+namespace {
+
+// windowBits 15 + 32 распознаёт и gzip, и zlib
+std::string Inflate(std::string_view data) {
+    z_stream stream{};
+    REQUIRE(inflateInit2(&stream, 15 + 32) == Z_OK);
+    std::string result;
+    char buffer[4096];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        result.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    CHECK(status == Z_STREAM_END);
+    return result;
+}
+
+std::string MakeState(int dog_count) {
+    std::string state = R"({"players":{)";
+    for (int i = 0; i < dog_count; ++i) {
+        state += (i ? "," : "") + std::string("\"") + std::to_string(i) + R"(":{"pos":[)" + std::to_string(i * 0.37)
+            + "," + std::to_string(i * 1.13) + R"(],"speed":[0.0,0.0],"dir":"U","bag":[],"score":)"
+            + std::to_string(i * 5) + "}";
+    }
+    return state + R"(},"lostObjects":{}})";
+}
+
+}  // namespace
+
+TEST_CASE("Compressed data inflates back", "[Compression]") {
+    const auto state = MakeState(500);
+
+    for (auto encoding : {Encoding::GZIP, Encoding::DEFLATE}) {
+        // Контекст потока переиспользуется и с другой степенью сжатия
+        for (int level : {compression::BEST_SPEED, compression::BEST_COMPRESSION, compression::BEST_SPEED}) {
+            const auto compressed = compression::Compress(state, encoding, level);
+            CHECK(compressed.size() < state.size() / 2);
+            CHECK(Inflate(compressed) == state);
+        }
+        CHECK(Inflate(compression::Compress("", encoding)).empty());
+    }
+
+    const auto gzip = compression::Compress(state, Encoding::GZIP);
+    CHECK(static_cast<unsigned char>(gzip[0]) == 0x1f);
+    CHECK(static_cast<unsigned char>(gzip[1]) == 0x8b);
+    CHECK(compression::Compress(state, Encoding::IDENTITY) == state);
+
+    std::thread other{[&state] {
+        CHECK(Inflate(compression::Compress(state, Encoding::DEFLATE)) == state);
+    }};
+    other.join();
+}
+
+TEST_CASE("Shared bodies are compressed once", "[Compression]") {
+    compression::SharedCache cache{4};
+    auto body = std::make_shared<const std::string>(MakeState(100));
+
+    const auto before = compression::GetStats();
+    auto gzip = cache.Get(body, Encoding::GZIP);
+    CHECK(cache.Get(body, Encoding::GZIP) == gzip);
+    CHECK(cache.Get(body, Encoding::GZIP) == gzip);
+    auto deflate = cache.Get(body, Encoding::DEFLATE);
+    CHECK(Inflate(*gzip) == *body);
+    CHECK(Inflate(*deflate) == *body);
+
+    const auto after = compression::GetStats();
+    CHECK(after.compressions - before.compressions == 2);
+    CHECK(after.cache_hits - before.cache_hits == 2);
+    CHECK(after.bytes_in - before.bytes_in == 2 * body->size());
+    CHECK(after.bytes_out - before.bytes_out == gzip->size() + deflate->size());
+    CHECK(after.GetRatio() < 1.0);
+
+    // Новое тело по тому же ключу вытесняет старое
+    auto next = std::make_shared<const std::string>(MakeState(101));
+    for (int i = 0; i < 4; ++i) {
+        CHECK(Inflate(*cache.Get(next, Encoding::GZIP)) == *next);
+    }
+}
+
+TEST_CASE("Compressed variants are kept only when noticeably smaller", "[Compression]") {
+    static_assert(compression::IsWorthStoring(89, 100));
+    CHECK_FALSE(compression::IsWorthStoring(90, 100));
+    CHECK_FALSE(compression::IsWorthStoring(120, 100));
+    CHECK_FALSE(compression::IsWorthStoring(0, 0));
+}
+
+TEST_CASE("Compression benchmark", "[Compression][!benchmark]") {
+    const auto state = MakeState(10000);
+    BENCHMARK("gzip, best speed (10000 dogs)") {
+        return compression::Compress(state, Encoding::GZIP).size();
+    };
+    BENCHMARK("deflate, best speed (10000 dogs)") {
+        return compression::Compress(state, Encoding::DEFLATE).size();
+    };
+}
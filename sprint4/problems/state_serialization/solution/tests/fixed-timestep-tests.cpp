@@ -0,0 +1,69 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/fixed_timestep.h"
+
+using namespace std::literals;
+using model::FixedTimestep;
+
+TEST_CASE("Disabled timestep passes the whole delta as one step", "[FixedTimestep]") {
+    FixedTimestep timestep;
+    CHECK_FALSE(timestep.IsEnabled());
+    const auto steps = timestep.Advance(1234ms);
+    CHECK(steps.count == 1);
+    CHECK(steps.step == 1234ms);
+    CHECK(steps.dropped == 0);
+
+    // Нулевой тик тоже выполняется
+    CHECK(timestep.Advance(0ms).count == 1);
+}
+
+TEST_CASE("Remainder shorter than a step carries over to the next tick", "[FixedTimestep]") {
+    FixedTimestep timestep{10ms, 10};
+    auto steps = timestep.Advance(25ms);
+    CHECK(steps.count == 2);
+    CHECK(steps.step == 10ms);
+    CHECK(timestep.GetAccumulated() == 5ms);
+
+    steps = timestep.Advance(4ms);
+    CHECK(steps.count == 0);
+    CHECK(timestep.GetAccumulated() == 9ms);
+
+    steps = timestep.Advance(1ms);
+    CHECK(steps.count == 1);
+    CHECK(timestep.GetAccumulated() == 0ms);
+}
+
+TEST_CASE("Steps over the limit are dropped after a stall", "[FixedTimestep]") {
+    FixedTimestep timestep{10ms, 5};
+    auto steps = timestep.Advance(10'007ms);
+    CHECK(steps.count == 5);
+    CHECK(steps.dropped == 995);
+    CHECK(timestep.GetAccumulated() == 7ms);
+
+    // После остановки игра продолжается в обычном темпе
+    steps = timestep.Advance(50ms);
+    CHECK(steps.count == 5);
+    CHECK(steps.dropped == 0);
+    CHECK(timestep.GetAccumulated() == 7ms);
+}
+
+TEST_CASE("Simulated time does not depend on how the delta is split", "[FixedTimestep]") {
+    FixedTimestep whole{10ms, 100};
+    FixedTimestep split{10ms, 100};
+    const auto whole_steps = whole.Advance(300ms).count;
+    unsigned split_steps = 0;
+    for (int i = 0; i < 100; ++i) {
+        split_steps += split.Advance(3ms).count;
+    }
+    CHECK(whole_steps == 30);
+    CHECK(split_steps == 30);
+    CHECK(whole.GetAccumulated() == split.GetAccumulated());
+}
+
+TEST_CASE("Step limit is at least one", "[FixedTimestep]") {
+    FixedTimestep timestep{10ms, 0};
+    CHECK(timestep.GetMaxSteps() == 1);
+    const auto steps = timestep.Advance(30ms);
+    CHECK(steps.count == 1);
+    CHECK(steps.dropped == 2);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+
+#include "../src/model.h"
+
+// Карта и наполненная сессия, общие для тестов сериализации и приложения
+namespace fixtures {
+
+// Сетка дорог 100x100 с шагом 10, одним зданием и одним офисом
+inline model::Map MakeGridMap(std::string id = "grid") {
+    model::Map map{model::Map::Id{std::move(id)}, "Grid", 1.0};
+    for (int i = 0; i <= 100; i += 10) {
+        map.AddRoad(model::Road{model::Road::HORIZONTAL, model::Point{0, i}, 100});
+        map.AddRoad(model::Road{model::Road::VERTICAL, model::Point{i, 0}, 100});
+    }
+    map.AddBuilding(model::Building{model::Rectangle{{12, 12}, {6, 5}}});
+    map.AddOffice(model::Office{model::Office::Id{"o0"}, model::Point{40, 30}, model::Offset{-5, 0}});
+    map.BuildRoadGraph();
+    map.SetLootTypeCount(3);
+    map.SetLootGenerator(loot_gen::LootGenerator{std::chrono::seconds{1}, 1.0});
+    return map;
+}
+
+// Собаки с дробными координатами, скоростями, рюкзаками и очками
+inline void FillSession(model::GameSession& session, int dog_count) {
+    std::mt19937 gen{17};
+    std::uniform_real_distribution<double> coord(0.0, 100.0);
+    std::uniform_real_distribution<double> speed(-3.5, 3.5);
+    const model::Direction dirs[] = {model::Direction::NORTH, model::Direction::SOUTH,
+                                     model::Direction::WEST, model::Direction::EAST};
+
+    for (int i = 0; i < dog_count; ++i) {
+        auto* dog = session.CreateDog("dog" + std::to_string(i));
+        dog->SetCoord({coord(gen), coord(gen)});
+        dog->SetSpeed({speed(gen), i % 7 == 0 ? 0.0 : speed(gen)});
+        dog->SetDir(dirs[i % 4]);
+        for (int j = 0; j < i % 3; ++j) {
+            dog->AddToBag(model::LostObject{static_cast<std::uint64_t>(i * 3 + j), static_cast<std::size_t>(j)});
+        }
+        dog->AddScore(i * 5);
+    }
+    session.AddRandomLoot(std::chrono::seconds{10});
+}
+
+}  // namespace fixtures
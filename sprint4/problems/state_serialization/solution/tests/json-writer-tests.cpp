@@ -0,0 +1,213 @@
+#include <boost/json.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "../src/json_writer.h"
+#include "game-fixtures.h"
+
+using fixtures::FillSession;
+using fixtures::MakeGridMap;
+
+namespace {
+
+std::string SerializeDom(const model::GameSession& session) {
+    return boost::json::serialize(json_writer::GameStateToJson(session));
+}
+
+}  // namespace
+
+TEST_CASE("Streaming writer matches boost::json::serialize byte for byte", "[JsonWriter]") {
+    auto map = MakeGridMap();
+
+    SECTION("empty session") {
+        model::GameSession session{&map};
+        std::string out;
+        json_writer::WriteGameState(session, out);
+        CHECK(out == R"({"players":{},"lostObjects":{}})");
+        CHECK(out == SerializeDom(session));
+    }
+
+    SECTION("session with dogs and loot") {
+        model::GameSession session{&map, model::GatherAlgorithm::GRID, 5};
+        FillSession(session, 50);
+
+        auto* dog = session.GetDogs().front();
+        dog->SetCoord({1e-9, -0.0});
+        dog->SetSpeed({1e21, 0.1});
+
+        std::string out;
+        json_writer::WriteGameState(session, out);
+        CHECK(out == SerializeDom(session));
+    }
+
+    SECTION("writer appends to the buffer") {
+        model::GameSession session{&map};
+        FillSession(session, 3);
+        std::string out = "prefix";
+        json_writer::WriteGameState(session, out);
+        CHECK(out == "prefix" + SerializeDom(session));
+    }
+}
+
+TEST_CASE("Nearby state contains only objects within the radius", "[JsonWriter][Interest]") {
+    auto map = MakeGridMap();
+    model::GameSession session{&map, model::GatherAlgorithm::GRID, 3};
+    FillSession(session, 200);
+
+    // Сетка следит за собаками, пока они перемещаются по тику
+    std::mt19937 gen{5};
+    std::uniform_real_distribution<double> speed(-2.0, 2.0);
+    for (auto* dog : session.GetDogs()) {
+        dog->SetSpeed({speed(gen), speed(gen)});
+    }
+    session.MoveDogs(std::chrono::seconds{3});
+
+    model::SpatialState state;
+    json_writer::WriteSpatialState(session, state);
+    const auto full = boost::json::parse(SerializeDom(session)).as_object();
+
+    for (double radius : {0.5, 7.0, 25.0, 1000.0}) {
+        for (size_t index : {size_t{0}, size_t{42}, size_t{199}}) {
+            std::string out;
+            REQUIRE(json_writer::WriteNearbyState(state, index, radius, out));
+            const auto nearby = boost::json::parse(out).as_object();
+
+            const auto& center_dog = session.GetDogByIndex(index);
+            const auto center = center_dog.GetCoord();
+            auto is_near = [&](const boost::json::value& pos) {
+                const double dx = pos.as_array()[0].as_double() - center.x;
+                const double dy = pos.as_array()[1].as_double() - center.y;
+                return dx * dx + dy * dy <= radius * radius;
+            };
+
+            CHECK(nearby.at("players").as_object().contains(std::to_string(center_dog.GetToken())));
+            for (const auto* key : {"players", "lostObjects"}) {
+                boost::json::object expected;
+                for (const auto& [id, value] : full.at(key).as_object()) {
+                    if (is_near(value.as_object().at("pos"))) {
+                        expected[id] = value;
+                    }
+                }
+                const auto& actual = nearby.at(key).as_object();
+                CHECK(actual.size() == expected.size());
+                for (const auto& [id, value] : actual) {
+                    CHECK(expected.contains(id));
+                    CHECK(value == full.at(key).as_object().at(id));
+                }
+            }
+        }
+    }
+
+    std::string out;
+    CHECK_FALSE(json_writer::WriteNearbyState(state, 200, 10.0, out));
+}
+
+namespace {
+
+void Publish(model::GameSession& session) {
+    std::string body;
+    auto delta = std::make_shared<model::StateDelta>();
+    json_writer::WriteGameState(session, body, session.GetDogChanges(), session.GetLootChanges(), *delta);
+    session.PublishSnapshot(std::make_shared<const std::string>(std::move(body)), std::move(delta));
+}
+
+boost::json::object ReadDelta(const model::GameSession& session, std::uint64_t since) {
+    std::string out;
+    json_writer::WriteStateDelta(*session.GetJournal(), since, out);
+    return boost::json::parse(out).as_object();
+}
+
+// Применяет ответ с изменениями к известному клиенту состоянию
+void ApplyDelta(boost::json::object& state, const boost::json::object& delta) {
+    if (delta.at("full").as_bool()) {
+        state = boost::json::object{{"players", delta.at("players")}, {"lostObjects", delta.at("lostObjects")}};
+        return;
+    }
+    for (const auto* key : {"players", "lostObjects"}) {
+        auto& objects = state[key].as_object();
+        for (const auto& [id, value] : delta.at(key).as_object()) {
+            objects[id] = value;
+        }
+    }
+    for (const auto& id : delta.at("removedPlayers").as_array()) {
+        state["players"].as_object().erase(id.as_string());
+    }
+    for (const auto& id : delta.at("removedLostObjects").as_array()) {
+        state["lostObjects"].as_object().erase(id.as_string());
+    }
+}
+
+}  // namespace
+
+TEST_CASE("State deltas rebuild the full state", "[JsonWriter][Delta]") {
+    auto map = MakeGridMap();
+    model::GameSession session{&map, model::GatherAlgorithm::GRID, 9};
+    FillSession(session, 30);
+    Publish(session);
+    REQUIRE(session.GetJournal()->tick == 1);
+
+    boost::json::object client = boost::json::object{{"players", boost::json::object{}},
+                                                     {"lostObjects", boost::json::object{}}};
+    std::uint64_t client_tick = 0;
+    ApplyDelta(client, ReadDelta(session, client_tick));
+    client_tick = 1;
+
+    std::mt19937 gen{3};
+    for (int tick = 0; tick < 20; ++tick) {
+        // Двигается только часть собак, остальные стоят
+        for (auto* dog : session.GetDogs()) {
+            const auto dir = static_cast<model::Direction>(gen() % 4);
+            session.ChangeDogDir(dog->GetIndex(), gen() % 4 == 0 ? std::optional{dir} : std::nullopt);
+        }
+        session.MoveDogs(std::chrono::milliseconds{500});
+        session.AddRandomLoot(std::chrono::milliseconds{500});
+        if (tick % 3 == 2) {
+            // Пропажу трофея проще всего получить, восстановив состояние без него
+            std::vector<model::LostObject> loots(session.GetLoots().begin(), session.GetLoots().end());
+            loots.erase(loots.begin());
+            session.RestoreLostObjects(loots, session.GetNextLootId());
+        }
+        Publish(session);
+
+        // Клиент опрашивает сервер через тик
+        if (tick % 2 == 1) {
+            const auto delta = ReadDelta(session, client_tick);
+            CHECK_FALSE(delta.at("full").as_bool());
+            ApplyDelta(client, delta);
+            client_tick = delta.at("tick").to_number<std::uint64_t>();
+            CHECK(client == boost::json::parse(SerializeDom(session)).as_object());
+        }
+    }
+
+    const auto current = ReadDelta(session, session.GetJournal()->tick);
+    CHECK_FALSE(current.at("full").as_bool());
+    CHECK(current.at("players").as_object().empty());
+    CHECK(current.at("removedLostObjects").as_array().empty());
+}
+
+TEST_CASE("Clients too far behind get the full state", "[JsonWriter][Delta]") {
+    auto map = MakeGridMap();
+    model::GameSession session{&map, model::GatherAlgorithm::GRID, 9};
+    FillSession(session, 5);
+    for (size_t i = 0; i < model::GameSession::JOURNAL_CAPACITY + 10; ++i) {
+        Publish(session);
+    }
+    const auto& journal = *session.GetJournal();
+    CHECK(journal.deltas.size() == model::GameSession::JOURNAL_CAPACITY);
+
+    const auto expected = boost::json::parse(SerializeDom(session)).as_object();
+    for (std::uint64_t since : {std::uint64_t{0}, std::uint64_t{5}, journal.tick + 1}) {
+        const auto delta = ReadDelta(session, since);
+        CHECK(delta.at("full").as_bool());
+        CHECK(delta.at("tick").to_number<std::uint64_t>() == journal.tick);
+        CHECK(delta.at("players") == expected.at("players"));
+        CHECK(delta.at("lostObjects") == expected.at("lostObjects"));
+    }
+
+    const auto oldest = journal.deltas.front()->tick;
+    CHECK_FALSE(ReadDelta(session, oldest - 1).at("full").as_bool());
+}
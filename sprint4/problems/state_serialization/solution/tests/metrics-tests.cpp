@@ -0,0 +1,107 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/metrics.h"
+
+using namespace std::literals;
+using metrics::Histogram;
+
+TEST_CASE("Histogram buckets keep relative error within a sub-bucket", "[Metrics]") {
+    for (std::uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 1000ull, 123'456'789ull,
+                                (1ull << Histogram::MAX_VALUE_BITS) - 1}) {
+        const auto index = Histogram::GetBucketIndex(value);
+        REQUIRE(index < Histogram::BUCKET_COUNT);
+        CHECK(Histogram::GetBucketUpperBound(index) > value);
+        if (index > 0) {
+            CHECK(Histogram::GetBucketUpperBound(index - 1) <= value);
+        }
+        const auto width = Histogram::GetBucketUpperBound(index) - (index > 0 ? Histogram::GetBucketUpperBound(index - 1) : 0);
+        CHECK(width * Histogram::SUB_BUCKET_COUNT <= std::max<std::uint64_t>(value, Histogram::SUB_BUCKET_COUNT));
+    }
+    CHECK(Histogram::GetBucketIndex(1ull << 50) == Histogram::BUCKET_COUNT - 1);
+
+    // Границы корзин идут подряд без пропусков
+    for (size_t i = 1; i < Histogram::BUCKET_COUNT; ++i) {
+        REQUIRE(Histogram::GetBucketIndex(Histogram::GetBucketUpperBound(i - 1)) == i);
+    }
+}
+
+TEST_CASE("Histogram snapshot gives counts and quantiles", "[Metrics]") {
+    Histogram histogram;
+    for (int i = 1; i <= 1000; ++i) {
+        histogram.Record(std::chrono::microseconds{i});
+    }
+    const auto snapshot = histogram.GetSnapshot();
+    CHECK(snapshot.count == 1000);
+    CHECK(snapshot.sum == 500'500'000);
+    CHECK(snapshot.CountBelow(1 << 20) == 1000);
+    CHECK(snapshot.CountBelow(1 << 19) == 524);
+
+    const auto median = snapshot.GetQuantile(0.5);
+    CHECK(median >= 500us);
+    CHECK(median <= 500us + 500us / 16);
+    const auto p99 = snapshot.GetQuantile(0.99);
+    CHECK(p99 >= 990us);
+    CHECK(p99 <= 990us + 990us / 16);
+}
+
+TEST_CASE("Sharded counters sum updates from all threads", "[Metrics]") {
+    metrics::Counter counter;
+    metrics::Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10'000; ++i) {
+                counter.Increment();
+                histogram.Record(1ms);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(counter.Get() == 80'000);
+    CHECK(histogram.GetSnapshot().count == 80'000);
+}
+
+TEST_CASE("Registry renders Prometheus text format", "[Metrics]") {
+    metrics::Registry registry;
+    auto& requests = registry.GetCounter("requests_total", "Requests served", {{"route", "state"}});
+    requests.Increment(3);
+    CHECK(&registry.GetCounter("requests_total", "Requests served", {{"route", "state"}}) == &requests);
+    registry.GetCounter("requests_total", "Requests served", {{"route", "join"}}).Increment();
+    registry.GetGauge("open_sessions", "Open sessions").Add(2);
+    registry.SetCallback("queue_depth", "Queued \"actions\"", metrics::Registry::Type::GAUGE, [] {
+        return 1.5;
+    });
+    registry.GetHistogram("latency_seconds", "Latency").Record(3ms);
+    CHECK_THROWS(registry.GetGauge("requests_total", "Requests served"));
+
+    const auto text = registry.RenderPrometheus();
+    CHECK(text.find("# HELP requests_total Requests served\n# TYPE requests_total counter\n"
+                    "requests_total{route=\"state\"} 3\nrequests_total{route=\"join\"} 1\n")
+          != std::string::npos);
+    CHECK(text.find("# TYPE open_sessions gauge\nopen_sessions 2\n") != std::string::npos);
+    CHECK(text.find("# HELP queue_depth Queued \"actions\"\n# TYPE queue_depth gauge\nqueue_depth 1.5\n")
+          != std::string::npos);
+    CHECK(text.find("# TYPE latency_seconds histogram\n") != std::string::npos);
+    CHECK(text.find("latency_seconds_bucket{le=\"0.002097152\"} 0\n") != std::string::npos);
+    CHECK(text.find("latency_seconds_bucket{le=\"0.004194304\"} 1\n") != std::string::npos);
+    CHECK(text.find("latency_seconds_bucket{le=\"+Inf\"} 1\nlatency_seconds_sum 0.003\nlatency_seconds_count 1\n")
+          != std::string::npos);
+}
+
+TEST_CASE("Metrics benchmark", "[Metrics][!benchmark]") {
+    metrics::Counter counter;
+    metrics::Histogram histogram;
+    BENCHMARK("counter increment") {
+        counter.Increment();
+    };
+    BENCHMARK("histogram record") {
+        histogram.Record(std::chrono::nanoseconds{123'456});
+    };
+}
@@ -0,0 +1,436 @@
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/model.h"
+#include "../src/player.h"
+
+namespace {
+
+model::Map MakeRandomMap(std::mt19937& gen, int road_count, int size) {
+    std::uniform_int_distribution<int> coord(0, size);
+    std::uniform_int_distribution<int> kind(0, 1);
+
+    model::Map map{model::Map::Id{"random"}, "Random", 1.0};
+    for (int i = 0; i < road_count; ++i) {
+        model::Point start{coord(gen), coord(gen)};
+        if (kind(gen) == 0) {
+            map.AddRoad(model::Road{model::Road::HORIZONTAL, start, coord(gen)});
+        } else {
+            map.AddRoad(model::Road{model::Road::VERTICAL, start, coord(gen)});
+        }
+    }
+    return map;
+}
+
+// Прежний алгоритм: идём по накрывающим дорогам, пока упираемся в их край
+model::Position FindEdgeByScan(const model::Map& map, model::Position pos, model::Direction dir) {
+    const auto& roads = map.GetRoads();
+    std::vector<bool> viewed(roads.size());
+    for (;;) {
+        size_t id = 0;
+        while (id < roads.size() && (viewed[id] || !roads[id].Contains(pos.x, pos.y))) {
+            ++id;
+        }
+        if (id == roads.size()) {
+            return pos;
+        }
+        viewed[id] = true;
+
+        const auto& road = roads[id];
+        switch (dir) {
+            case model::Direction::NORTH:
+                pos.y = std::min(road.GetStart().y, road.GetEnd().y);
+                pos.y -= model::Road::HALF_WIDTH;
+                break;
+            case model::Direction::SOUTH:
+                pos.y = std::max(road.GetStart().y, road.GetEnd().y);
+                pos.y += model::Road::HALF_WIDTH;
+                break;
+            case model::Direction::WEST:
+                pos.x = std::min(road.GetStart().x, road.GetEnd().x);
+                pos.x -= model::Road::HALF_WIDTH;
+                break;
+            case model::Direction::EAST:
+                pos.x = std::max(road.GetStart().x, road.GetEnd().x);
+                pos.x += model::Road::HALF_WIDTH;
+                break;
+        }
+    }
+}
+
+class TestProvider : public model::ItemGathererProvider {
+public:
+    size_t ItemsCount() const override {
+        return items.size();
+    }
+
+    model::Item GetItem(size_t idx) const override {
+        return items[idx];
+    }
+
+    size_t GatherersCount() const override {
+        return gatherers.size();
+    }
+
+    model::Gatherer GetGatherer(size_t idx) const override {
+        return gatherers[idx];
+    }
+
+    std::vector<model::Item> items;
+    std::vector<model::Gatherer> gatherers;
+};
+
+}  // namespace
+
+TEST_CASE("Road index returns every road containing a point", "[RoadIndex]") {
+    std::mt19937 gen{42};
+    const auto map = MakeRandomMap(gen, 200, 100);
+    const auto& roads = map.GetRoads();
+
+    std::uniform_real_distribution<double> coord(-1.0, 101.0);
+    for (int i = 0; i < 10000; ++i) {
+        const double x = coord(gen);
+        const double y = coord(gen);
+
+        std::vector<size_t> expected;
+        for (size_t id = 0; id < roads.size(); ++id) {
+            if (roads[id].Contains(x, y)) {
+                expected.push_back(id);
+            }
+        }
+
+        std::vector<size_t> found;
+        for (size_t id : map.GetRoadIndex().GetRoadsNear(x, y)) {
+            if (roads[id].Contains(x, y)) {
+                found.push_back(id);
+            }
+        }
+        INFO("x: " << x << ", y: " << y);
+        REQUIRE(found == expected);
+    }
+}
+
+TEST_CASE("Road index handles points on the road border", "[RoadIndex]") {
+    model::Map map{model::Map::Id{"map"}, "Map", 1.0};
+    map.AddRoad(model::Road{model::Road::HORIZONTAL, {0, 0}, 40});
+    map.AddRoad(model::Road{model::Road::VERTICAL, {40, 0}, 30});
+
+    const auto& near = map.GetRoadIndex().GetRoadsNear(40.4, 30.4);
+    REQUIRE(near.size() == 1);
+    CHECK(near[0] == 1);
+    CHECK(map.GetRoadIndex().GetRoadsNear(-0.4, -0.4) == std::vector<size_t>{0});
+    CHECK(map.GetRoadIndex().GetRoadsNear(100.0, 100.0).empty());
+}
+
+TEST_CASE("Game builds the road graph of an added map", "[RoadGraph]") {
+    model::Map map{model::Map::Id{"map"}, "Map", 1.0};
+    map.AddRoad(model::Road{model::Road::HORIZONTAL, {0, 0}, 10});
+    CHECK_FALSE(map.IsRoadGraphBuilt());
+    map.BuildRoadGraph();
+    CHECK(map.IsRoadGraphBuilt());
+    // Дорога, добавленная после построения, делает граф устаревшим
+    map.AddRoad(model::Road{model::Road::VERTICAL, {10, 0}, 10});
+    CHECK_FALSE(map.IsRoadGraphBuilt());
+    map.SetLootGenerator(loot_gen::LootGenerator{std::chrono::seconds{1}, 0.5});
+
+    model::Game game;
+    game.AddMap(std::move(map));
+    const auto* added = game.FindMap(model::Map::Id{"map"});
+    REQUIRE(added);
+    REQUIRE(added->IsRoadGraphBuilt());
+
+    model::GameSession session{added};
+    auto* dog = session.CreateDog("dog");
+    player::Player player{&session, dog};
+    dog->SetCoord({10.0, 5.0});
+    player.ChangeDir(model::Direction::SOUTH);
+    player.Move(std::chrono::seconds{60});
+    CHECK(dog->GetCoord().x == 10.0);
+    CHECK(dog->GetCoord().y == 10.0 + model::Road::HALF_WIDTH);
+}
+
+TEST_CASE("Road graph finds the same edge as scanning the roads", "[RoadGraph]") {
+    using namespace std::literals;
+    std::mt19937 gen{7};
+    auto map = MakeRandomMap(gen, 150, 60);
+    map.BuildRoadGraph();
+    map.SetLootGenerator(loot_gen::LootGenerator{1s, 0.5});
+    const auto& roads = map.GetRoads();
+
+    model::GameSession session{&map};
+    auto* dog = session.CreateDog("dog");
+    player::Player player{&session, dog};
+
+    const model::Direction dirs[] = {model::Direction::NORTH, model::Direction::SOUTH,
+                                     model::Direction::WEST, model::Direction::EAST};
+    std::uniform_int_distribution<size_t> road_dist(0, roads.size() - 1);
+    std::uniform_real_distribution<double> shift(-model::Road::HALF_WIDTH, model::Road::HALF_WIDTH);
+    std::uniform_int_distribution<int> dir_dist(0, 3);
+    std::uniform_int_distribution<int> time_dist(1, 30000);
+
+    for (int i = 0; i < 20000; ++i) {
+        auto start = roads[road_dist(gen)].GetRandomPoint();
+        start.x += shift(gen);
+        start.y += shift(gen);
+        if (i % 3 == 0) {
+            // Точки на границах полос
+            start.x = std::round(start.x) + model::Road::HALF_WIDTH;
+        }
+        const auto dir = dirs[dir_dist(gen)];
+
+        dog->SetCoord({start.x, start.y});
+        player.ChangeDir(dir);
+        const auto time = std::chrono::milliseconds{time_dist(gen)};
+        const auto speed = dog->GetSpeed();
+        const double dt = std::chrono::duration<double>(time).count();
+        const model::Position next{start.x + speed.x * dt, start.y + speed.y * dt};
+        const bool next_on_road = std::any_of(roads.begin(), roads.end(), [&next](const model::Road& road) {
+            return road.Contains(next.x, next.y);
+        });
+        const auto expected = next_on_road ? next : FindEdgeByScan(map, start, dir);
+
+        player.Move(time);
+        INFO("start: " << start.x << ", " << start.y << ", dir: " << static_cast<int>(dir));
+        REQUIRE(dog->GetCoord().x == expected.x);
+        REQUIRE(dog->GetCoord().y == expected.y);
+    }
+}
+
+TEST_CASE("Grid gathering finds the same events as brute force", "[FindGatherEvents]") {
+    std::mt19937 gen{11};
+    std::uniform_real_distribution<double> coord(0.0, 50.0);
+    std::uniform_real_distribution<double> step(-3.0, 3.0);
+    std::uniform_int_distribution<int> long_step(0, 20);
+
+    for (int round = 0; round < 50; ++round) {
+        TestProvider provider;
+        for (int j = 0; j < 300; ++j) {
+            provider.items.push_back({{coord(gen), coord(gen)}, j % 10 == 0 ? 0.25 : 0.0});
+        }
+        for (int i = 0; i < 100; ++i) {
+            model::Position start{coord(gen), coord(gen)};
+            model::Position end{start.x + step(gen), start.y + step(gen)};
+            if (long_step(gen) == 0) {
+                end.x += 40.0;
+            }
+            provider.gatherers.push_back({start, end, 0.6});
+        }
+
+        const auto expected = model::FindGatherEvents(provider, model::GatherAlgorithm::BRUTE_FORCE);
+        const auto events = model::FindGatherEvents(provider, model::GatherAlgorithm::GRID);
+
+        REQUIRE(events.size() == expected.size());
+        for (size_t k = 0; k < events.size(); ++k) {
+            CHECK(events[k].item_id == expected[k].item_id);
+            CHECK(events[k].gatherer_id == expected[k].gatherer_id);
+            CHECK(events[k].sq_distance == expected[k].sq_distance);
+            CHECK(events[k].time == expected[k].time);
+        }
+    }
+}
+
+TEST_CASE("Slot map keeps handles valid after erasing other elements", "[SlotMap]") {
+    util::SlotMap<int> slots;
+    const auto a = slots.Insert(1);
+    const auto b = slots.Insert(2);
+    const auto c = slots.Insert(3);
+
+    REQUIRE(slots.Erase(a));
+    CHECK_FALSE(slots.Contains(a));
+    CHECK_FALSE(slots.Erase(a));
+    CHECK(slots.Size() == 2);
+    CHECK(*slots.Find(b) == 2);
+    CHECK(*slots.Find(c) == 3);
+
+    // Последний элемент перенесён на место удалённого
+    CHECK(slots[0] == 3);
+    CHECK(slots.GetHandle(0) == c);
+
+    const auto d = slots.Insert(4);
+    CHECK(d.slot == a.slot);
+    CHECK(d.generation != a.generation);
+    CHECK(slots.Find(a) == nullptr);
+    CHECK(*slots.Find(d) == 4);
+
+    slots.Clear();
+    CHECK(slots.Empty());
+    CHECK_FALSE(slots.Contains(b));
+}
+
+TEST_CASE("Sessions with the same seed generate the same loot", "[GameSession]") {
+    std::mt19937 gen{7};
+    auto map = MakeRandomMap(gen, 50, 40);
+    map.BuildRoadGraph();
+    map.SetLootTypeCount(4);
+    map.SetLootGenerator(loot_gen::LootGenerator{std::chrono::seconds{1}, 1.0});
+
+    auto spawn_loot = [&map](std::optional<std::uint64_t> seed) {
+        model::GameSession session{&map, model::GatherAlgorithm::GRID, seed};
+        for (int i = 0; i < 10; ++i) {
+            session.CreateDog("dog" + std::to_string(i));
+        }
+        session.AddRandomLoot(std::chrono::seconds{5});
+
+        std::vector<std::tuple<std::size_t, double, double>> result;
+        for (const auto& loot : session.GetLoots()) {
+            result.emplace_back(loot.type, loot.position.x, loot.position.y);
+        }
+        return result;
+    };
+
+    const auto first = spawn_loot(42);
+    CHECK(first.size() == 10);
+    CHECK(first == spawn_loot(42));
+    CHECK(first != spawn_loot(43));
+}
+
+TEST_CASE("MPSC queue keeps the order of every producer", "[MpscQueue]") {
+    constexpr int PRODUCERS = 4;
+    constexpr int PER_PRODUCER = 20000;
+    util::MpscQueue<std::pair<int, int>> queue{1024};
+    CHECK(queue.Capacity() == 1024);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&queue, p] {
+            for (int i = 0; i < PER_PRODUCER; ++i) {
+                while (!queue.TryPush({p, i})) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<int> next(PRODUCERS, 0);
+    int received = 0;
+    bool ordered = true;
+    while (received < PRODUCERS * PER_PRODUCER) {
+        if (auto item = queue.TryPop()) {
+            ordered = ordered && item->second == next[item->first];
+            ++next[item->first];
+            ++received;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    CHECK(ordered);
+    CHECK_FALSE(queue.TryPop());
+    CHECK(queue.Size() == 0);
+}
+
+TEST_CASE("MPSC queue rejects items when full", "[MpscQueue]") {
+    util::MpscQueue<int> queue{4};
+    for (int i = 0; i < 4; ++i) {
+        CHECK(queue.TryPush(i));
+    }
+    CHECK_FALSE(queue.TryPush(4));
+    CHECK(queue.Size() == 4);
+    CHECK(queue.TryPop() == 0);
+    CHECK(queue.TryPush(4));
+}
+
+TEST_CASE("Queued actions are applied in arrival order", "[GameSession]") {
+    model::Map map{model::Map::Id{"map"}, "Map", 2.0};
+    map.AddRoad(model::Road{model::Road::HORIZONTAL, {0, 0}, 10});
+    map.BuildRoadGraph();
+    map.SetLootGenerator(loot_gen::LootGenerator{std::chrono::seconds{1}, 0.0});
+
+    model::GameSession session{&map};
+    auto dog = session.CreateDog("dog");
+
+    CHECK(session.PushAction({dog->GetIndex(), model::Direction::EAST}));
+    CHECK(session.PushAction({dog->GetIndex(), model::Direction::SOUTH}));
+    CHECK(session.GetActionQueueDepth() == 2);
+    // До применения команды не влияют на собаку
+    CHECK(dog->GetSpeed().x == 0.0);
+
+    session.ApplyActions();
+    CHECK(session.GetActionQueueDepth() == 0);
+    CHECK(dog->GetDir() == model::Direction::SOUTH);
+    CHECK(dog->GetSpeed().y == 2.0);
+
+    CHECK(session.PushAction({dog->GetIndex(), std::nullopt}));
+    session.ApplyActions();
+    CHECK(dog->GetDir() == model::Direction::SOUTH);
+    CHECK(dog->GetSpeed().y == 0.0);
+
+    for (size_t i = 0; i < model::GameSession::ACTION_QUEUE_CAPACITY; ++i) {
+        session.PushAction({dog->GetIndex(), model::Direction::WEST});
+    }
+    CHECK_FALSE(session.PushAction({dog->GetIndex(), model::Direction::EAST}));
+    CHECK(session.GetDroppedActionCount() == 1);
+}
+
+TEST_CASE("Spatial grid follows moving objects", "[SpatialGrid]") {
+    model::SpatialGrid grid{10.0};
+    const auto key = [](std::int64_t x, std::int64_t y) {
+        return model::SpatialGrid::MakeCellKey(x, y);
+    };
+
+    grid.Update(1, {1.0, 1.0});
+    grid.Update(2, {9.5, 2.0});
+    grid.Update(3, {-0.5, 15.0});
+    REQUIRE(grid.GetCells().size() == 2);
+    CHECK(grid.GetCells().at(key(0, 0)).size() == 2);
+    CHECK(grid.GetCells().at(key(-1, 1)) == model::SpatialGrid::Ids{3});
+
+    // Внутри ячейки объект не перекладывается
+    grid.Update(1, {5.0, 5.0});
+    CHECK(grid.GetCells().at(key(0, 0)).size() == 2);
+
+    grid.Update(2, {10.5, 2.0});
+    CHECK(grid.GetCells().at(key(0, 0)) == model::SpatialGrid::Ids{1});
+    CHECK(grid.GetCells().at(key(1, 0)) == model::SpatialGrid::Ids{2});
+
+    grid.Erase(3);
+    grid.Erase(3);
+    CHECK_FALSE(grid.GetCells().contains(key(-1, 1)));
+    CHECK(grid.GetCells().size() == 2);
+
+    grid.Clear();
+    CHECK(grid.GetCells().empty());
+}
+
+TEST_CASE("Session keeps dog and loot grids in sync", "[GameSession][SpatialGrid]") {
+    model::Map map{model::Map::Id{"line"}, "Line", 1.0};
+    map.AddRoad(model::Road{model::Road::HORIZONTAL, model::Point{0, 0}, 100});
+    map.BuildRoadGraph();
+    map.SetLootTypeCount(2);
+    map.SetLootGenerator(loot_gen::LootGenerator{std::chrono::seconds{1}, 1.0});
+
+    model::GameSession session{&map, model::GatherAlgorithm::GRID, 1};
+    auto* dog = session.CreateDog("dog");
+    const auto& dog_cells = session.GetDogGrid().GetCells();
+    const auto cell_of = [](double x) {
+        return model::SpatialGrid::MakeCellKey(
+            model::SpatialGrid::GetCellIndex(x, model::GameSession::INTEREST_CELL_SIZE), 0);
+    };
+    CHECK(dog_cells.at(cell_of(0.0)) == model::SpatialGrid::Ids{dog->GetIndex()});
+
+    session.ChangeDogDir(dog->GetIndex(), model::Direction::EAST);
+    session.MoveDogs(std::chrono::seconds{25});
+    CHECK(dog_cells.size() == 1);
+    CHECK(dog_cells.at(cell_of(25.0)) == model::SpatialGrid::Ids{dog->GetIndex()});
+
+    session.AddRandomLoot(std::chrono::seconds{5});
+    size_t loot_in_grid = 0;
+    for (const auto& [key, ids] : session.GetLootGrid().GetCells()) {
+        loot_in_grid += ids.size();
+        for (auto id : ids) {
+            CHECK(session.FindLoot(id) != nullptr);
+        }
+    }
+    CHECK(loot_in_grid == session.GetLoots().Size());
+
+    session.ClearState();
+    CHECK(session.GetDogGrid().GetCells().empty());
+    CHECK(session.GetLootGrid().GetCells().empty());
+}
@@ -0,0 +1,205 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/router.h"
+
+using namespace std::literals;
+using router::Endpoint;
+using Status = router::RouteMatch::Status;
+namespace http = boost::beast::http;
+
+TEST_CASE("Router matches API paths and methods", "[Router]") {
+    auto match = router::MatchApiRoute(http::verb::post, "/api/v1/game/join");
+    REQUIRE(match.status == Status::FOUND);
+    CHECK(match.route->endpoint == Endpoint::JOIN);
+
+    match = router::MatchApiRoute(http::verb::head, "/api/v1/game/state?since=5");
+    REQUIRE(match.status == Status::FOUND);
+    CHECK(match.route->endpoint == Endpoint::STATE);
+
+    match = router::MatchApiRoute(http::verb::get, "/api/v1/maps");
+    REQUIRE(match.status == Status::FOUND);
+    CHECK(match.route->endpoint == Endpoint::MAPS);
+
+    match = router::MatchApiRoute(http::verb::get, "/api/v1/game/stream?token=abc");
+    REQUIRE(match.status == Status::FOUND);
+    CHECK(match.route->endpoint == Endpoint::STREAM);
+
+    match = router::MatchApiRoute(http::verb::get, "/api/v1/maps/map1");
+    REQUIRE(match.status == Status::FOUND);
+    CHECK(match.route->endpoint == Endpoint::MAP);
+    CHECK(match.params[0] == "map1"sv);
+}
+
+TEST_CASE("Every endpoint has a name", "[Router]") {
+    for (const auto& route : router::API_ROUTES) {
+        CHECK_FALSE(router::GetEndpointName(route.endpoint).empty());
+    }
+    static_assert(router::GetEndpointName(Endpoint::STATE) == "state"sv);
+    static_assert(router::GetEndpointName(Endpoint::STREAM) == "stream"sv);
+}
+
+TEST_CASE("Router reports method mismatches like the original handler", "[Router]") {
+    // Для join, action и players неверный метод означает неизвестный эндпоинт
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/game/join").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/game/player/action").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::post, "/api/v1/game/players").status == Status::NOT_FOUND);
+
+    auto match = router::MatchApiRoute(http::verb::post, "/api/v1/game/state");
+    REQUIRE(match.status == Status::METHOD_NOT_ALLOWED);
+    CHECK(match.route->allow == "GET, HEAD"sv);
+
+    match = router::MatchApiRoute(http::verb::get, "/api/v1/game/tick");
+    REQUIRE(match.status == Status::METHOD_NOT_ALLOWED);
+    CHECK(match.route->allow == "POST"sv);
+}
+
+TEST_CASE("Router rejects unknown paths", "[Router]") {
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/maps/").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/maps/map1/roads").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/game/stat").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v1/game/states").status == Status::NOT_FOUND);
+    CHECK(router::MatchApiRoute(http::verb::get, "/api/v2/maps").status == Status::NOT_FOUND);
+}
+
+TEST_CASE("Query parameters are extracted without decoding", "[Router]") {
+    constexpr auto target = "/api/v1/game/state?since=12&radius=4.5&flag"sv;
+    CHECK(router::GetQueryParam(target, "since") == "12"sv);
+    CHECK(router::GetQueryParam(target, "radius") == "4.5"sv);
+    CHECK(router::GetQueryParam(target, "flag") == ""sv);
+    CHECK_FALSE(router::GetQueryParam(target, "wait"));
+    CHECK_FALSE(router::GetQueryParam("/api/v1/game/state"sv, "since"));
+}
+
+TEST_CASE("Bearer token validation matches the previous regex", "[Router]") {
+    constexpr auto token = "0123456789abcdefABCDEF0123456789"sv;
+    static_assert(router::ParseBearerToken("Bearer 0123456789abcdefABCDEF0123456789") == token);
+
+    CHECK(router::ParseBearerToken("Bearer\t0123456789abcdefABCDEF0123456789") == token);
+    CHECK_FALSE(router::ParseBearerToken("Bearer  0123456789abcdefABCDEF0123456789"));
+    CHECK_FALSE(router::ParseBearerToken("bearer 0123456789abcdefABCDEF0123456789"));
+    CHECK_FALSE(router::ParseBearerToken("Bearer 0123456789abcdefABCDEF012345678"));
+    CHECK_FALSE(router::ParseBearerToken("Bearer 0123456789abcdefABCDEF01234567890"));
+    CHECK_FALSE(router::ParseBearerToken("Bearer 0123456789abcdefABCDEF012345678g"));
+    CHECK_FALSE(router::ParseBearerToken(""));
+}
+
+TEST_CASE("Accept header selects the response format", "[Router]") {
+    using router::NegotiateFormat;
+    using Format = router::ResponseFormat;
+    static_assert(NegotiateFormat("application/cbor") == Format::CBOR);
+
+    CHECK(NegotiateFormat("") == Format::JSON);
+    CHECK(NegotiateFormat("*/*") == Format::JSON);
+    CHECK(NegotiateFormat("application/json") == Format::JSON);
+    CHECK(NegotiateFormat("Application/CBOR") == Format::CBOR);
+    CHECK(NegotiateFormat("application/cbor, */*;q=0.1") == Format::CBOR);
+    CHECK(NegotiateFormat("application/cbor, */*") == Format::CBOR);
+    CHECK(NegotiateFormat("application/json, application/cbor") == Format::JSON);
+    CHECK(NegotiateFormat("application/json;q=0.5, application/cbor") == Format::CBOR);
+    CHECK(NegotiateFormat("application/cbor;q=0.5, application/json") == Format::JSON);
+    CHECK(NegotiateFormat("application/cbor; q=0.9, application/*; q=0.8") == Format::CBOR);
+    CHECK(NegotiateFormat("application/cbor;q=0, */*") == Format::JSON);
+    CHECK(NegotiateFormat("application/cbor;q=2") == Format::JSON);
+    CHECK(NegotiateFormat("text/html, application/cbor;q=1.000") == Format::CBOR);
+}
+
+TEST_CASE("Accept-Encoding header selects the compression", "[Router]") {
+    using router::NegotiateEncoding;
+    using compression::Encoding;
+    static_assert(NegotiateEncoding("gzip") == Encoding::GZIP);
+
+    CHECK(NegotiateEncoding("") == Encoding::IDENTITY);
+    CHECK(NegotiateEncoding("br") == Encoding::IDENTITY);
+    CHECK(NegotiateEncoding("gzip, deflate, br") == Encoding::GZIP);
+    CHECK(NegotiateEncoding("deflate") == Encoding::DEFLATE);
+    CHECK(NegotiateEncoding("X-GZIP") == Encoding::GZIP);
+    CHECK(NegotiateEncoding("gzip;q=0.5, deflate") == Encoding::DEFLATE);
+    CHECK(NegotiateEncoding("gzip;q=0, deflate;q=0") == Encoding::IDENTITY);
+    CHECK(NegotiateEncoding("*") == Encoding::GZIP);
+    CHECK(NegotiateEncoding("*, gzip;q=0") == Encoding::DEFLATE);
+    CHECK(NegotiateEncoding("identity, gzip;q=0.5") == Encoding::IDENTITY);
+    CHECK(NegotiateEncoding("gzip;q=0.5, identity;q=0.5") == Encoding::GZIP);
+}
+
+TEST_CASE("If-None-Match matches tags weakly", "[Router]") {
+    using router::MatchesEtag;
+    static_assert(MatchesEtag(R"("abc")", R"("abc")"));
+
+    CHECK(MatchesEtag(R"("abc")", R"("abc")"));
+    CHECK_FALSE(MatchesEtag(R"("abd")", R"("abc")"));
+    CHECK(MatchesEtag(R"(W/"abc")", R"("abc")"));
+    CHECK(MatchesEtag(R"("x", "y" , W/"abc")", R"("abc")"));
+    CHECK_FALSE(MatchesEtag(R"("x", "y")", R"("abc")"));
+    CHECK(MatchesEtag("*", R"("abc")"));
+    CHECK(MatchesEtag(R"("x", *)", R"("abc")"));
+    CHECK_FALSE(MatchesEtag("", R"("abc")"));
+    // Тег сравнивается целиком, вместе с кавычками
+    CHECK_FALSE(MatchesEtag("abc", R"("abc")"));
+}
+
+TEST_CASE("Range header selects one byte range", "[Router]") {
+    using router::RangeStatus;
+    router::ByteRange range;
+
+    REQUIRE(router::ParseRange("bytes=10-19", 100, range) == RangeStatus::PARTIAL);
+    CHECK(range.offset == 10);
+    CHECK(range.size == 10);
+
+    // Конец за пределами файла обрезается по размеру
+    REQUIRE(router::ParseRange("bytes=90-200", 100, range) == RangeStatus::PARTIAL);
+    CHECK(range.offset == 90);
+    CHECK(range.size == 10);
+
+    SECTION("open-ended range runs to the end of the file") {
+        REQUIRE(router::ParseRange("bytes=40-", 100, range) == RangeStatus::PARTIAL);
+        CHECK(range.offset == 40);
+        CHECK(range.size == 60);
+    }
+
+    SECTION("suffix range selects the last bytes") {
+        REQUIRE(router::ParseRange("bytes=-30", 100, range) == RangeStatus::PARTIAL);
+        CHECK(range.offset == 70);
+        CHECK(range.size == 30);
+
+        REQUIRE(router::ParseRange("bytes=-500", 100, range) == RangeStatus::PARTIAL);
+        CHECK(range.offset == 0);
+        CHECK(range.size == 100);
+
+        CHECK(router::ParseRange("bytes=-0", 100, range) == RangeStatus::UNSATISFIABLE);
+    }
+
+    SECTION("range starting past the end is unsatisfiable") {
+        CHECK(router::ParseRange("bytes=100-", 100, range) == RangeStatus::UNSATISFIABLE);
+        CHECK(router::ParseRange("bytes=150-160", 100, range) == RangeStatus::UNSATISFIABLE);
+    }
+
+    SECTION("no range of an empty file is satisfiable") {
+        CHECK(router::ParseRange("bytes=0-", 0, range) == RangeStatus::UNSATISFIABLE);
+        CHECK(router::ParseRange("bytes=-10", 0, range) == RangeStatus::UNSATISFIABLE);
+    }
+
+    SECTION("invalid and multiple ranges fall back to the whole file") {
+        CHECK(router::ParseRange("bytes=20-10", 100, range) == RangeStatus::FULL);
+        CHECK(router::ParseRange("bytes=0-9,20-29", 100, range) == RangeStatus::FULL);
+        CHECK(router::ParseRange("bytes=-", 100, range) == RangeStatus::FULL);
+        CHECK(router::ParseRange("bytes=a-b", 100, range) == RangeStatus::FULL);
+        CHECK(router::ParseRange("bytes=5", 100, range) == RangeStatus::FULL);
+        CHECK(router::ParseRange("items=0-9", 100, range) == RangeStatus::FULL);
+    }
+}
+
+TEST_CASE("Router benchmark", "[Router][!benchmark]") {
+    BENCHMARK("match state with query") {
+        return router::MatchApiRoute(http::verb::get, "/api/v1/game/state?since=100");
+    };
+    BENCHMARK("match map by id") {
+        return router::MatchApiRoute(http::verb::get, "/api/v1/maps/town");
+    };
+    BENCHMARK("reject unknown path") {
+        return router::MatchApiRoute(http::verb::get, "/api/v1/unknown/endpoint");
+    };
+    BENCHMARK("parse bearer token") {
+        return router::ParseBearerToken("Bearer 0123456789abcdefABCDEF0123456789");
+    };
+}
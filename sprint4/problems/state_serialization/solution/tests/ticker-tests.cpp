@@ -0,0 +1,88 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "../src/ticker.h"
+
+using namespace std::literals;
+using http_handler::CatchUpPolicy;
+using http_handler::PlanTick;
+
+TEST_CASE("Single delta policy passes all elapsed time at once", "[Ticker]") {
+    const auto plan = PlanTick(173ms, 50ms, CatchUpPolicy::SINGLE_DELTA);
+    CHECK(plan.run);
+    CHECK(plan.step == 173ms);
+    CHECK(plan.skipped == 0);
+    CHECK(plan.consumed == 173ms);
+}
+
+TEST_CASE("Skip policy runs one period and drops missed ticks", "[Ticker]") {
+    auto plan = PlanTick(50ms, 50ms, CatchUpPolicy::SKIP);
+    CHECK(plan.run);
+    CHECK(plan.skipped == 0);
+
+    plan = PlanTick(260ms, 50ms, CatchUpPolicy::SKIP);
+    CHECK(plan.run);
+    CHECK(plan.step == 50ms);
+    CHECK(plan.skipped == 4);
+    // Остаток 10 мс остаётся следующему тику
+    CHECK(plan.consumed == 250ms);
+
+    plan = PlanTick(30ms, 50ms, CatchUpPolicy::SKIP);
+    CHECK_FALSE(plan.run);
+    CHECK(plan.consumed == 0ms);
+}
+
+TEST_CASE("Catch-up policies are parsed by name", "[Ticker]") {
+    CHECK(http_handler::ParseCatchUpPolicy("single") == CatchUpPolicy::SINGLE_DELTA);
+    CHECK(http_handler::ParseCatchUpPolicy("skip") == CatchUpPolicy::SKIP);
+    CHECK_FALSE(http_handler::ParseCatchUpPolicy("fast").has_value());
+    // Короткие шаги задаются в Application, а не в таймере
+    CHECK_FALSE(http_handler::ParseCatchUpPolicy("substeps").has_value());
+}
+
+TEST_CASE("Ticker drops missed ticks after a stall", "[Ticker]") {
+    constexpr auto PERIOD = 20ms;
+    constexpr size_t TICKS = 6;
+    auto& overruns = metrics::Registry::GetInstance().GetCounter("ticker_overruns_total", "");
+    auto& failures = metrics::Registry::GetInstance().GetCounter("ticker_failures_total", "");
+    auto& skipped = metrics::Registry::GetInstance().GetCounter("ticker_skipped_ticks_total", "");
+    const auto overruns_before = overruns.Get();
+    const auto failures_before = failures.Get();
+    const auto skipped_before = skipped.Get();
+
+    boost::asio::io_context ioc;
+    std::vector<std::chrono::milliseconds> deltas;
+    auto ticker = std::make_shared<http_handler::Ticker>(
+        boost::asio::make_strand(ioc), PERIOD,
+        [&](std::chrono::milliseconds delta) {
+            deltas.push_back(delta);
+            if (deltas.size() == 1) {
+                // Ошибка тика пишется в лог, но не останавливает таймер
+                throw std::runtime_error("step failed");
+            }
+            if (deltas.size() == 2) {
+                // Затянувшийся тик: следующий получает один период, а пропущенные отбрасываются
+                std::this_thread::sleep_for(5 * PERIOD);
+            }
+            if (deltas.size() == TICKS) {
+                ioc.stop();
+            }
+        },
+        CatchUpPolicy::SKIP);
+
+    // Длительность проверки не ограничена временем: на загруженной машине тики просто идут реже
+    ticker->Start();
+    ioc.run();
+
+    REQUIRE(deltas.size() >= TICKS);
+    for (auto delta : deltas) {
+        CHECK(delta == PERIOD);
+    }
+    CHECK(overruns.Get() > overruns_before);
+    CHECK(failures.Get() == failures_before + 1);
+    CHECK(skipped.Get() > skipped_before);
+}